@@ -25,6 +25,8 @@ namespace flox {
 
 /* -------------------------------------------------------------------------- */
 
+struct DrvInfoFilter;
+
 class Descriptor {
   private:
     /* Check validity of fields, possibly returning an error message. */
@@ -62,6 +64,12 @@ class Descriptor {
 
     predicates::PkgPred pred( bool checkPath = false ) const;
 
+    /**
+     * Conditions from @a pred which may be checked by a `DrvDb' query.
+     * Path and `semver' conditions are not included.
+     */
+    DrvInfoFilter filter() const;
+
     nlohmann::json toJSON()   const;
     std::string    toString() const;
 };
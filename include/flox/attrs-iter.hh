@@ -45,26 +45,9 @@ class AttrSetIterClosure {
       nix::ref<nix::eval_cache::EvalCache>
     openEvalCache() const
     {
-      nix::flake::Fingerprint fingerprint = this->getFingerprint();
-      return nix::make_ref<nix::eval_cache::EvalCache>(
-        ( nix::evalSettings.useEvalCache && nix::evalSettings.pureEval )
-        ? std::optional { std::cref( fingerprint ) }
-        : std::nullopt
-      , * this->_state
-      , [&]()
-        {
-          nix::Value * vFlake = this->_state->allocValue();
-          nix::flake::callFlake( * this->_state, * this->_flake, * vFlake );
-          this->_state->forceAttrs(
-            * vFlake, nix::noPos, "while parsing cached flake data"
-          );
-          nix::Attr * aOutputs = vFlake->attrs->get(
-            this->_state->symbols.create( "outputs" )
-          );
-          assert( aOutputs != nullptr );
-          return aOutputs->value;
-        }
-      );
+      return resolve::getEvalCache( nix::ref<nix::EvalState>( this->_state )
+                                  , this->_flake
+                                  );
     }
 
 
@@ -0,0 +1,160 @@
+/* ========================================================================== *
+ *
+ * @file flox/cached-input.hh
+ *
+ * @brief An `Input' whose structure and package sets are backed by the
+ *        `DrvDb' of its locked flake.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+#include "flox/input.hh"
+#include "flox/flox-flake.hh"
+#include "flox/drv-cache.hh"
+#include "flox/cached-package-set.hh"
+#include "flox/index-package-set.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A flake input which answers structural queries from the prefixes recorded
+ * in its `DrvDb', probing the flake only for prefixes which haven't been
+ * recorded yet.
+ *
+ * Package sets are `CachedPackageSet's created on first use, which share a
+ * single `DrvDb' connection and the `EvalCache' of our flake.
+ * Only prefixes in `FloxFlake::getFlakeAttrPathPrefixes' are considered, so
+ * subtrees, systems, and stabilities which are disabled by preferences are
+ * reported as missing.
+ */
+class CachedInput : public Input {
+
+  private:
+
+    nix::ref<FloxFlake>    _flake;
+    std::shared_ptr<DrvDb> _db;
+
+    /** `<SUBTREE>.<SYSTEM>[.<STABILITY>]' prefixes which exist. */
+    std::optional<std::list<std::vector<std::string>>> _prefixes;
+
+    std::map<std::vector<std::string>, std::shared_ptr<CachedPackageSet>>
+      _packageSets;
+
+    /** Our `PackageIndex', if `scrape' has written one. */
+    std::optional<std::shared_ptr<const PackageIndex>> _index;
+
+    /** Lock our flake when a package set first needs it. */
+    std::shared_ptr<nix::flake::LockedFlake> getLockedFlake();
+
+
+/* -------------------------------------------------------------------------- */
+
+  public:
+
+    /**
+     * Construct an input from @a flake.
+     * Its locked reference and fingerprint are taken from the `LockCache'
+     * when they are recorded there, and the flake is only locked once a
+     * package set must be evaluated.
+     */
+    CachedInput( nix::ref<FloxFlake> flake );
+
+
+/* -------------------------------------------------------------------------- */
+
+    nix::ref<FloxFlake> getFlake() const { return this->_flake; }
+
+    /** Get our fingerprint, without locking if it is recorded. */
+      nix::flake::Fingerprint
+    getFingerprint() const
+    {
+      return this->_flake->getFingerprint();
+    }
+
+    /** Get the `DrvDb' shared by our package sets. */
+    nix::ref<DrvDb> getDrvDb() const { return (nix::ref<DrvDb>) this->_db; }
+
+    /**
+     * Get the `<SUBTREE>.<SYSTEM>[.<STABILITY>]' prefixes which exist,
+     * in order of preference.
+     */
+    const std::list<std::vector<std::string>> & getPrefixes();
+
+
+/* -------------------------------------------------------------------------- */
+
+    std::unordered_set<subtree_type> getSubtrees() override;
+
+    std::unordered_set<std::string_view> getSystems(
+      const subtree_type & subtree
+    ) override;
+    using Input::getSystems;
+
+      std::unordered_set<std::string_view>
+    getStabilities( std::string_view system ) override;
+
+
+/* -------------------------------------------------------------------------- */
+
+    /**
+     * Get the package set for @a prefix, creating it on first use.
+     * @return `nullptr' if @a prefix doesn't exist.
+     */
+    std::shared_ptr<CachedPackageSet> getCachedPackageSet(
+      const std::vector<std::string> & prefix
+    );
+
+    std::list<nix::ref<PackageSet>> getPackageSets() override;
+
+    /**
+     * Get the `PackageIndex' written for our fingerprint, opening it on
+     * first use.
+     * Only complete prefixes are indexed, so a prefix found in the index
+     * may be read from it in place of our `DrvDb'.
+     * @return `nullptr' if there is no valid index.
+     */
+    std::shared_ptr<const PackageIndex> getPackageIndex();
+
+    /**
+     * Catalogs have a package set for each stability, so they can't be
+     * looked up with this form.
+     */
+    std::shared_ptr<PackageSet> getPackageSet(
+      const subtree_type     & subtree
+    ,       std::string_view   system
+    ) override;
+
+      std::shared_ptr<PackageSet>
+    getPackageSet( std::string_view subtreeOrSystem
+                 , std::string_view systemOrCatalog
+                 ) override;
+
+
+/* -------------------------------------------------------------------------- */
+
+};  /* End class `CachedInput' */
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
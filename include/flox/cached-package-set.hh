@@ -36,7 +36,10 @@ class CachedPackageSet : public PackageSet {
     std::shared_ptr<FlakePackageSet>         _fps;
     std::shared_ptr<DbPackageSet>            _dbps;
     std::shared_ptr<DrvDb>                   _db;
+    progress_status                          _progress   = DBPS_NONE;
     bool                                     _populateDb = false;
+    std::size_t                              _batchSize  =
+      FLOX_DRVDB_BATCH_SIZE;
 
 
 /* -------------------------------------------------------------------------- */
@@ -62,60 +65,103 @@ class CachedPackageSet : public PackageSet {
     {
       if ( this->_dbps == nullptr )
         {
-          this->_dbps = std::make_shared<DbPackageSet>(
-            this->_flake
-          , this->_subtree
-          , this->_system
-          , this->_stability
-          );
+          if ( this->_db == nullptr )
+            {
+              this->_dbps = std::make_shared<DbPackageSet>(
+                this->_flake
+              , this->_subtree
+              , this->_system
+              , this->_stability
+              );
+            }
+          else
+            {
+              /* While populating, lookups share our database and fill info
+               * for paths which were recorded without it. */
+              this->_dbps = std::make_shared<DbPackageSet>(
+                this->_flake
+              , this->_db
+              , this->_subtree
+              , this->_system
+              , this->_stability
+              , this->_fps
+              );
+            }
         }
       return (nix::ref<DbPackageSet>) this->_dbps;
     }
 
+    /** Convert @a path to a `DrvDb' relative path, including stability. */
+      std::vector<std::string>
+    toDbPath( const std::list<std::string_view> & path ) const
+    {
+      std::vector<std::string> rsl;
+      if ( this->_stability.has_value() )
+        {
+          rsl.emplace_back( this->_stability.value() );
+        }
+      for ( const auto & p : path ) { rsl.emplace_back( p ); }
+      return rsl;
+    }
+
 
 /* -------------------------------------------------------------------------- */
 
   public:
 
+    /**
+     * @param db A writable `DrvDb' for @a flake shared with other package
+     *           sets, or `nullptr' to open our own when populating.
+     */
     CachedPackageSet(
             nix::ref<nix::EvalState>                   state
     ,       std::shared_ptr<nix::flake::LockedFlake>   flake
     , const subtree_type                             & subtree
     ,       std::string_view                           system
     , const std::optional<std::string_view>          & stability = std::nullopt
+    ,       std::shared_ptr<DrvDb>                     db        = nullptr
     ) : _subtree( subtree )
       , _system( system )
       , _stability( stability )
       , _flake( flake )
       , _state( state )
+      , _db( db )
     {
       /* Determine the Db status.
-       * We may be creating from scratch, or filling a missing package set. */
-      if ( ! std::filesystem::exists( getDrvDbName( * this->_flake ) ) )
+       * We may be creating from scratch, or filling a missing package set.
+       * Rows from a partial run are still used for lookups while we fill in
+       * the rest. */
+      std::optional<std::string_view> stab =
+        ( this->_subtree == ST_CATALOG ) ? this->getStability() : std::nullopt;
+      if ( this->_db != nullptr )
         {
-          this->_populateDb = true;
+          this->_progress = this->_db->getProgress(
+            subtreeTypeToString( this->_subtree )
+          , this->_system
+          , stab
+          );
         }
-      else
+      else if ( std::filesystem::exists( getDrvDbName( * this->_flake ) ) )
         {
           DrvDb db( this->_flake->getFingerprint(), false, false );
-          progress_status s = db.getProgress(
+          this->_progress = db.getProgress(
             subtreeTypeToString( this->_subtree )
           , this->_system
+          , stab
           );
-
-          if ( s == DBPS_INFO_DONE ) { this->_populateDb = false; }
-          else                       { this->_populateDb = true;  }
         }
+      this->_populateDb = this->_progress < DBPS_INFO_DONE;
 
       if ( this->_populateDb )
         {
-          this->_db = std::make_shared<DrvDb>( this->_flake->getFingerprint() );
+          if ( this->_db == nullptr )
+            {
+              this->_db =
+                std::make_shared<DrvDb>( this->_flake->getFingerprint() );
+            }
           this->getFlakePackageSet();
         }
-      else
-        {
-          this->getDbPackageSet();
-        }
+      this->getDbPackageSet();
     }
 
     CachedPackageSet(
@@ -126,9 +172,7 @@ class CachedPackageSet : public PackageSet {
     , const std::optional<std::string_view> & stability = std::nullopt
     ) : CachedPackageSet(
           state
-        , std::make_shared<nix::flake::LockedFlake>(
-            nix::flake::lockFlake( * state, flakeRef, floxFlakeLockFlags )
-          )
+        , lockFlakeCached( * state, flakeRef )
         , subtree
         , system
         , stability
@@ -163,6 +207,22 @@ class CachedPackageSet : public PackageSet {
       return this->_flake->flake.lockedRef;
     }
 
+    /**
+     * Set the number of packages written to the `DrvDb' per transaction when
+     * populating the database.
+     */
+    void setBatchSize( std::size_t batchSize ) { this->_batchSize = batchSize; }
+
+    /**
+     * Populate our `DrvDb' with every package in our prefix, after which
+     * lookups and iteration read stored rows.
+     * This continues from the sets and rows left by earlier runs, so only
+     * packages which haven't been stored are evaluated.
+     * If the prefix can't be completed, for instance because another process
+     * holds its sets for too long, iteration evaluates the flake instead.
+     */
+    void populate();
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -191,17 +251,25 @@ class CachedPackageSet : public PackageSet {
         std::shared_ptr<DrvDb>                           _db;
         bool                                             _populateDb;
 
-        void loadPkg();
+        /**
+         * Load the package at the current position.
+         * @return `false' if it failed to evaluate and should be skipped.
+         */
+        bool loadPkg();
+
+        /** Load the package at the current position or the next after it. */
+        void seek();
 
       public:
         const_iterator() = default;
 
-        explicit const_iterator( bool                             populateDb
-                               , std::shared_ptr<FlakePackageSet> fps
-                               , std::shared_ptr<DbPackageSet>    dbps
-                               , std::shared_ptr<DrvDb>           db
-                               )
-          : _db( db ), _populateDb( populateDb )
+        explicit const_iterator(
+          bool                             populateDb
+        , std::shared_ptr<FlakePackageSet> fps
+        , std::shared_ptr<DbPackageSet>    dbps
+        , std::shared_ptr<DrvDb>           db
+        , std::size_t                      batchSize = FLOX_DRVDB_BATCH_SIZE
+        ) : _db( db ), _populateDb( populateDb )
         {
           if ( _populateDb )
             {
@@ -212,7 +280,9 @@ class CachedPackageSet : public PackageSet {
                 fps->end()
               );
               assert( db != nullptr );
-              if ( ( * this->_fi ) != ( * this->_fe ) ) { loadPkg(); }
+              /* Hand writes off to a writer thread which groups them into
+               * transactions of `batchSize' rows. */
+              this->_db->startWriter( FLOX_DRVDB_QUEUE_SIZE, batchSize );
             }
           else
             {
@@ -222,8 +292,8 @@ class CachedPackageSet : public PackageSet {
               this->_de = std::make_shared<DbPackageSet::const_iterator>(
                 dbps->end()
               );
-              if ( ( * this->_di ) != ( * this->_de ) ) { loadPkg(); }
             }
+          this->seek();
         }
 
 
@@ -259,6 +329,11 @@ class CachedPackageSet : public PackageSet {
 
 /* -------------------------------------------------------------------------- */
 
+    /**
+     * Iterate over stored rows once our prefix is populated.
+     * Otherwise packages are evaluated as they are reached and stored, so
+     * callers should run `populate' first to reuse rows from earlier runs.
+     */
     const_iterator begin() const;
     const_iterator end()   const { return const_iterator(); }
 
@@ -273,8 +348,52 @@ class CachedPackageSet : public PackageSet {
 /**
  * Convert a `FlakePackageSet' to a `DbPackageSet' by writing its contents to
  * a database.
+ * Rows are committed in transactions of @a batchSize packages.
+ * Packages which fail to evaluate are recorded by `DrvDb::setFailedDrv' and
+ * skipped, while other errors are thrown.
+ */
+DbPackageSet cachePackageSet( FlakePackageSet & ps
+                            , std::size_t       batchSize =
+                                FLOX_DRVDB_BATCH_SIZE
+                            );
+
+/**
+ * Populate a `DrvDb' for @a ps cooperatively with other processes.
+ *
+ * Attribute sets marked with `recurseForDerivations', such as
+ * `haskellPackages', are recorded as tasks in the `DrvDb' as they are found.
+ * Any process running this routine for the same prefix claims tasks from that
+ * shared queue, so a single large set no longer bounds how quickly a prefix
+ * can be scraped.
+ * The time spent evaluating each set is recorded, and tasks with the highest
+ * recorded cost are claimed first.
+ *
+ * Rows are written through @a db, which must be a writable `DrvDb' for the
+ * flake of @a ps, and may be shared with other package sets.
+ * `DrvDb::resetSubtrees' must be called once before starting workers.
+ * The prefix is marked done by whichever worker finds no remaining tasks.
+ *
+ * @param pathsOnly Only record the paths of derivations, checking
+ *                  `isDerivation' without evaluating their `meta' or
+ *                  `outputs', and mark the prefix as `DBPS_PATHS_DONE'.
+ *                  Their info may be filled later by `fillDrvInfos'.
+ */
+void cacheSubtrees( DrvDb           & db
+                  , FlakePackageSet & ps
+                  , std::size_t       batchSize = FLOX_DRVDB_BATCH_SIZE
+                  , bool              pathsOnly = false
+                  );
+
+/**
+ * Record info for derivations of @a ps whose paths were recorded without it
+ * by `cacheSubtrees', marking the prefix as `DBPS_INFO_DONE'.
+ * Unlike `cacheSubtrees' this doesn't traverse attribute sets, and should
+ * only be run by a single process per prefix.
  */
-DbPackageSet cachePackageSet( FlakePackageSet & ps );
+void fillDrvInfos( DrvDb           & db
+                 , FlakePackageSet & ps
+                 , std::size_t       batchSize = FLOX_DRVDB_BATCH_SIZE
+                 );
 
 
 /* -------------------------------------------------------------------------- */
@@ -0,0 +1,382 @@
+/* ========================================================================== *
+ *
+ * @file flox/columnar-package-set.hh
+ *
+ * @brief Declares an in memory package set which stores metadata by column.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include "flox/util.hh"
+#include "flox/package-set.hh"
+#include "flox/predicates.hh"
+#include "flox/drv-cache.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Interns strings so that each distinct value is stored once and may be
+ * compared by its id.
+ * Views returned by @a get remain valid for the lifetime of the pool.
+ */
+class StringPool {
+
+  private:
+    std::deque<std::string>                        _strings;
+    std::unordered_map<std::string_view, uint32_t> _ids;
+
+  public:
+    /** Id used for absent strings. */
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    StringPool() = default;
+    /* Keys refer to our own strings, so they can't be copied. */
+    StringPool( const StringPool & )             = delete;
+    StringPool( StringPool && )                  = default;
+    StringPool & operator=( const StringPool & ) = delete;
+    StringPool & operator=( StringPool && )      = default;
+
+    /** @return The id of @a s, adding it to the pool if necessary. */
+    uint32_t intern( std::string_view s );
+
+    /** @return The id of @a s, or `npos` if it is not in the pool. */
+      uint32_t
+    find( std::string_view s ) const
+    {
+      auto search = this->_ids.find( s );
+      return ( search == this->_ids.end() ) ? npos : search->second;
+    }
+
+    std::string_view get( uint32_t id ) const { return this->_strings[id]; }
+
+    std::size_t size() const { return this->_strings.size(); }
+
+};  /* End class `StringPool' */
+
+
+/* -------------------------------------------------------------------------- */
+
+class ColumnarPackageSet;
+
+/**
+ * A view of a single package in a @a ColumnarPackageSet.
+ * Views are only valid for the lifetime of the set they refer to.
+ */
+class ColumnarPackage : public Package {
+
+  private:
+    const ColumnarPackageSet * _set;
+    uint32_t                   _id;
+
+  public:
+    ColumnarPackage( const ColumnarPackageSet * set, uint32_t id )
+      : _set( set ), _id( id )
+    {}
+
+    uint32_t getId() const { return this->_id; }
+
+    std::vector<std::string>   getPathStrs()         const override;
+    std::string                getFullName()         const override;
+    std::string                getPname()            const override;
+    std::optional<std::string> getVersion()          const override;
+    std::optional<std::string> getSemver()           const override;
+    std::optional<std::string> getLicense()          const override;
+    std::vector<std::string>   getOutputs()          const override;
+    std::vector<std::string>   getOutputsToInstall() const override;
+    std::optional<bool>        isBroken()            const override;
+    std::optional<bool>        isUnfree()            const override;
+    bool                       hasMetaAttr()         const override;
+    bool                       hasPnameAttr()        const override;
+    bool                       hasVersionAttr()      const override;
+
+};  /* End class `ColumnarPackage' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A package set held in memory in "struct of arrays" form.
+ *
+ * Rather than allocating an object per package, each field is a column with
+ * one element per package.
+ * Strings are interned in a shared @a StringPool so that columns hold only
+ * ids, boolean fields are packed into bitsets, and attribute paths and output
+ * lists are runs in shared arenas.
+ * Scans read each column front to back which is far friendlier to caches than
+ * chasing pointers between packages.
+ *
+ * Packages are referred to by their position in the set, and are read through
+ * @a ColumnarPackage views.
+ */
+class ColumnarPackageSet : public PackageSet {
+
+  private:
+    subtree_type               _subtree;
+    std::string                _system;
+    std::optional<std::string> _stability;
+    FloxFlakeRef               _ref;
+
+    StringPool _pool;
+
+    /* One element per package.
+     * Optional strings hold `StringPool::npos' when absent. */
+    std::vector<uint32_t> _fullNames;
+    std::vector<uint32_t> _pnames;
+    std::vector<uint32_t> _versions;
+    std::vector<uint32_t> _semvers;
+    std::vector<uint32_t> _licenses;
+    std::vector<bool>     _hasBroken;
+    std::vector<bool>     _broken;
+    std::vector<bool>     _hasUnfree;
+    std::vector<bool>     _unfree;
+    std::vector<bool>     _hasMetaAttr;
+    std::vector<bool>     _hasPnameAttr;
+    std::vector<bool>     _hasVersionAttr;
+
+    /* Arenas of string ids.
+     * Package `i' owns elements `[offsets[i], offsets[i + 1])'. */
+    std::vector<uint32_t> _paths;
+    std::vector<uint32_t> _pathOffsets             = { 0 };
+    std::vector<uint32_t> _outputs;
+    std::vector<uint32_t> _outputsOffsets          = { 0 };
+    std::vector<uint32_t> _outputsToInstall;
+    std::vector<uint32_t> _outputsToInstallOffsets = { 0 };
+
+    /** Relative attribute path -> package id. */
+    std::unordered_map<std::list<std::string_view>, uint32_t> _byPath;
+
+      template<typename Strings>
+      void
+    pushRun(       std::vector<uint32_t> & arena
+           ,       std::vector<uint32_t> & offsets
+           , const Strings               & strs
+           ,       std::size_t             skip = 0
+           )
+    {
+      for ( const auto & s : strs )
+        {
+          if ( 0 < skip ) { --skip; continue; }
+          arena.push_back( this->_pool.intern( s ) );
+        }
+      offsets.push_back( arena.size() );
+    }
+
+      std::vector<std::string>
+    getRun( const std::vector<uint32_t> & arena
+          , const std::vector<uint32_t> & offsets
+          ,       uint32_t                id
+          ) const
+    {
+      std::vector<std::string> rsl;
+      for ( uint32_t i = offsets[id]; i < offsets[id + 1]; ++i )
+        {
+          rsl.emplace_back( this->_pool.get( arena[i] ) );
+        }
+      return rsl;
+    }
+
+      std::optional<std::string>
+    getOptional( const std::vector<uint32_t> & column, uint32_t id ) const
+    {
+      if ( column[id] == StringPool::npos ) { return std::nullopt; }
+      return std::string( this->_pool.get( column[id] ) );
+    }
+
+    friend ColumnarPackage;
+
+
+/* -------------------------------------------------------------------------- */
+
+  public:
+
+    /**
+     * Constructs an empty package set associated with a flake and attr-path
+     * prefix.
+     * @param subtree Flake output "subtree" the package set comes from.
+     * @param system Architecture/Platform the package set comes from.
+     * @param stability `flox` _stability_ category the package set comes from.
+     *                  ( optional: `catalog` @a subtree only )
+     * @param ref Indicates the package set's "source".
+     */
+    ColumnarPackageSet(
+      subtree_type                    subtree
+    , std::string_view                system
+    , std::optional<std::string_view> stability
+    , FloxFlakeRef                    ref
+    ) : _subtree( subtree )
+      , _system( system )
+      , _stability( stability.has_value()
+                      ? std::make_optional( std::string( stability.value() ) )
+                      : std::nullopt
+                  )
+      , _ref( ref )
+    {}
+
+    ColumnarPackageSet( ColumnarPackageSet && ) = default;
+
+    /** Copy every package from another package set. */
+      template<typename PkgSet>
+      requires std::derived_from<PkgSet, PackageSet>
+    explicit ColumnarPackageSet( PkgSet & ps )
+      : ColumnarPackageSet( ps.getSubtree()
+                          , ps.getSystem()
+                          , ps.getStability()
+                          , ps.getRef()
+                          )
+    {
+      for ( const auto & p : ps ) { this->addPackage( (const Package &) p ); }
+    }
+
+    std::string_view getType()    const override { return "columnar";     }
+    subtree_type     getSubtree() const override { return this->_subtree; }
+    std::string_view getSystem()  const override { return this->_system;  }
+    FloxFlakeRef     getRef()     const override { return this->_ref;     }
+
+      std::optional<std::string_view>
+    getStability() const override
+    {
+      if ( this->_stability.has_value() ) { return this->_stability; }
+      else                                { return std::nullopt;     }
+    }
+
+    std::size_t size()  override { return this->_pnames.size();  }
+    std::size_t size()  const    { return this->_pnames.size();  }
+    bool        empty() override { return this->_pnames.empty(); }
+    bool        empty() const    { return this->_pnames.empty(); }
+
+      bool
+    hasRelPath( const std::list<std::string_view> & path ) override
+    {
+      return this->_byPath.find( path ) != this->_byPath.cend();
+    }
+
+    std::shared_ptr<Package> maybeGetRelPath(
+      const std::list<std::string_view> & path
+    ) override;
+
+    /**
+     * Adds package metadata to the package set.
+     * @a p is assumed to have an attribute path which is consistent
+     * with @a this package set.
+     * @param p Package metadata to be added.
+     * @return The id of the added package.
+     */
+    uint32_t addPackage( const Package & p );
+
+    /** @return A view of the package with id @a id. */
+      ColumnarPackage
+    get( uint32_t id ) const
+    {
+      return ColumnarPackage( this, id );
+    }
+
+    /**
+     * Collect the ids of packages satisfying @a filter.
+     * Conditions are checked against the interned columns, so no strings are
+     * copied and no `Package' objects are created.
+     */
+    std::vector<uint32_t> filter( const DrvInfoFilter & filter ) const;
+
+    /**
+     * Collect the ids of packages satisfying @a filter and @a pred.
+     * @a pred is only run on packages which satisfy @a filter.
+     */
+    std::vector<uint32_t> filter( const DrvInfoFilter       & filter
+                                , const predicates::PkgPred & pred
+                                ) const;
+
+
+/* -------------------------------------------------------------------------- */
+
+    /** Iterators used to visit members of a @a ColumnarPackageSet. */
+    struct const_iterator
+    {
+      using value_type = const ColumnarPackage;
+      using reference  = value_type &;
+      using pointer    = value_type *;
+
+      private:
+        const ColumnarPackageSet * _set;
+        ColumnarPackage            _pkg;
+
+      public:
+        const_iterator( const ColumnarPackageSet * set, uint32_t id )
+          : _set( set ), _pkg( set, id )
+        {}
+
+        std::string_view getType() const { return "columnar"; }
+
+          const_iterator &
+        operator++()
+        {
+          this->_pkg = ColumnarPackage( this->_set, this->_pkg.getId() + 1 );
+          return * this;
+        }
+
+          const_iterator
+        operator++( int )
+        {
+          const_iterator tmp = * this;
+          ++( * this );
+          return tmp;
+        }
+
+          bool
+        operator==( const const_iterator & other ) const
+        {
+          return ( this->_set == other._set ) &&
+                 ( this->_pkg.getId() == other._pkg.getId() );
+        }
+
+          bool
+        operator!=( const const_iterator & other ) const
+        {
+          return ! ( ( * this ) == other );
+        }
+
+        reference operator*()  const { return this->_pkg;   }
+        pointer   operator->() const { return & this->_pkg; }
+
+    };  /* End struct `ColumnarPackageSet::const_iterator' */
+
+
+/* -------------------------------------------------------------------------- */
+
+    const_iterator begin() const { return const_iterator( this, 0 ); }
+
+      const_iterator
+    end() const
+    {
+      return const_iterator( this, this->_pnames.size() );
+    }
+
+
+/* -------------------------------------------------------------------------- */
+
+};  /* End class `ColumnarPackageSet' */
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
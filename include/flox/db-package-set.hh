@@ -8,6 +8,7 @@
 
 #include <string>
 #include "flox/package-set.hh"
+#include "flox/flake-package-set.hh"
 #include "flox/drv-cache.hh"
 
 
@@ -28,6 +29,12 @@ class DbPackageSet : public PackageSet {
     std::shared_ptr<nix::flake::LockedFlake> _flake;
     std::shared_ptr<DrvDb>                   _db;
 
+    /**
+     * Used to evaluate derivations whose paths are known but whose info
+     * hasn't been recorded yet, if any.
+     */
+    std::shared_ptr<FlakePackageSet>         _fps;
+
       nix::Sync<DrvDb::State>::Lock
     getDbState()
     {
@@ -39,17 +46,24 @@ class DbPackageSet : public PackageSet {
 
   public:
 
+    /**
+     * @param fps When set, lookups of derivations whose paths have been
+     *            scraped without their info evaluate them with @a fps,
+     *            recording their info in @a db if it is writable.
+     */
     DbPackageSet(
             std::shared_ptr<nix::flake::LockedFlake>   flake
     ,       std::shared_ptr<DrvDb>                     db
     , const subtree_type                             & subtree
     ,       std::string_view                           system
     , const std::optional<std::string_view>          & stability = std::nullopt
+    ,       std::shared_ptr<FlakePackageSet>           fps       = nullptr
     ) : _subtree( subtree )
       , _system( system )
       , _stability( stability )
       , _flake( flake )
       , _db( db )
+      , _fps( fps )
     {}
 
     DbPackageSet(
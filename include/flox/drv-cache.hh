@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <map>
+#include <set>
 #include <nlohmann/json.hpp>
 #include <nix/flake/flake.hh>
 #include <nix/eval-cache.hh>
@@ -16,7 +18,23 @@
 
 /* -------------------------------------------------------------------------- */
 
-#define FLOX_DRVDB_SCHEMA_VERSION  "0.1.0"
+#define FLOX_DRVDB_SCHEMA_VERSION  "0.7.0"
+
+/* Default number of rows written per transaction when populating a `DrvDb'. */
+#ifndef FLOX_DRVDB_BATCH_SIZE
+#  define FLOX_DRVDB_BATCH_SIZE  1000
+#endif
+
+/* Default capacity of the queue used by a `DrvDb' writer thread. */
+#ifndef FLOX_DRVDB_QUEUE_SIZE
+#  define FLOX_DRVDB_QUEUE_SIZE  8192
+#endif
+
+/* Seconds a worker waits on tasks claimed by others, without any of them
+ * finishing, before it gives up on a subtree/system. */
+#ifndef FLOX_DRVDB_CLAIM_TIMEOUT
+#  define FLOX_DRVDB_CLAIM_TIMEOUT  600
+#endif
 
 
 /* -------------------------------------------------------------------------- */
@@ -60,6 +78,76 @@ getDrvDbName( const nix::flake::LockedFlake & flake )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Conditions on `DerivationInfos' rows which can be evaluated by SQLite.
+ *
+ * These are "pushed down" from `Descriptor' and `Preferences' so that cached
+ * lookups only load rows which may satisfy a query.
+ * A filter may accept rows which are rejected by the corresponding `PkgPred',
+ * so callers must still check their predicates against results.
+ */
+struct DrvInfoFilter {
+  /** Matches any of `pname', `fullName', or the attribute name. */
+  std::optional<std::string>              name;
+  std::optional<std::string>              version;
+  bool                                    requireMeta   = false;
+  bool                                    excludeUnfree = false;
+  bool                                    excludeBroken = false;
+  std::optional<std::vector<std::string>> licenses;
+
+  /** @return `true` iff no conditions are set. */
+  bool empty() const;
+
+  /**
+   * Combine conditions from two filters.
+   * When both filters set `name' or `version' to different values only one is
+   * kept, since the caller's predicate will reject those rows anyway.
+   */
+  DrvInfoFilter operator&&( const DrvInfoFilter & other ) const;
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Status of a task in the `Subtrees' table.
+ * Each task is an attribute set to be scraped, which may be claimed by any
+ * process populating the same subtree/system.
+ */
+typedef enum {
+  SS_PENDING   = 0 /* Waiting to be claimed. */
+, SS_CLAIMED   = 1 /* Being evaluated by a worker. */
+, SS_DONE      = 2 /* Evaluated. */
+, SS_ABANDONED = 3 /* Abandoned by a failed worker, and resumed by a new run. */
+}  subtree_status;
+
+
+/**
+ * Columns of rows read with `DrvDb::useAllDrvInfos', in the order they are
+ * selected.
+ */
+typedef enum {
+  ADI_SUBTREE            = 0
+, ADI_SYSTEM             = 1
+, ADI_STABILITY          = 2
+, ADI_PATH               = 3
+, ADI_FULL_NAME          = 4
+, ADI_PNAME              = 5
+, ADI_VERSION            = 6
+, ADI_SEMVER             = 7
+, ADI_LICENSE            = 8
+, ADI_OUTPUTS            = 9
+, ADI_OUTPUTS_TO_INSTALL = 10
+, ADI_BROKEN             = 11
+, ADI_UNFREE             = 12
+, ADI_HAS_META_ATTR      = 13
+, ADI_HAS_PNAME_ATTR     = 14
+, ADI_HAS_VERSION_ATTR   = 15
+}  all_drv_infos_column;
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -77,30 +165,104 @@ class DrvDb {
       nix::SQLiteStmt insertDrvInfo;
       nix::SQLiteStmt insertDrv;
       nix::SQLiteStmt insertProgress;
+      nix::SQLiteStmt insertPrefix;
+
+      /* Subtree tasks */
+      nix::SQLiteStmt insertSubtree;
+      nix::SQLiteStmt claimSubtree;
+      nix::SQLiteStmt queryClaimOwners;
+      nix::SQLiteStmt finishSubtree;
+      nix::SQLiteStmt resetSubtrees;
+      nix::SQLiteStmt abandonSubtrees;
+      nix::SQLiteStmt releaseSubtrees;
+      nix::SQLiteStmt resumeSubtrees;
+      nix::SQLiteStmt checkpointSubtree;
+      nix::SQLiteStmt querySubtreeCheckpoint;
+      nix::SQLiteStmt countOpenSubtrees;
+      nix::SQLiteStmt countSkippedSubtrees;
+
+      /* Evaluation failures */
+      nix::SQLiteStmt insertFailedDrv;
+      nix::SQLiteStmt queryFailedDrvs;
+      nix::SQLiteStmt countFailedDrvs;
 
       /* Queries */
-      nix::SQLiteStmt queryVersionInfo;
-
       nix::SQLiteStmt hasDrv;
+      nix::SQLiteStmt hasDrvInfo;
       nix::SQLiteStmt queryDrvs;
+      nix::SQLiteStmt queryDrvsMissingInfo;
       nix::SQLiteStmt countDrvs;
       nix::SQLiteStmt countDrvsStability;
 
       nix::SQLiteStmt queryDrvInfo;
       nix::SQLiteStmt queryDrvInfos;
       nix::SQLiteStmt queryDrvInfosStability;
+      nix::SQLiteStmt queryAllDrvInfos;
       nix::SQLiteStmt countDrvInfos;
       nix::SQLiteStmt countDrvInfosStability;
 
       nix::SQLiteStmt queryProgress;
       nix::SQLiteStmt queryProgresses;
 
+      /* Filtered queries compiled on demand, keyed by their SQL text. */
+      std::unordered_map<std::string, std::unique_ptr<nix::SQLiteStmt>>
+        queryDrvInfosFiltered;
+
+    };
+
+    /**
+     * A plain record of a derivation as it is written to the database.
+     * These are detached from `Package' objects so that they may be handed
+     * off to a writer thread.
+     */
+    struct Row {
+      std::string                subtree;
+      std::string                system;
+      std::string                path;  /**< Relative path as a JSON list. */
+      std::optional<std::string> stability;
+
+      /** Whether this row should be written to `DerivationInfos'. */
+      bool                       hasInfo        = false;
+      std::string                fullName;
+      std::string                pname;
+      std::optional<std::string> version;
+      std::optional<std::string> semver;
+      std::optional<std::string> license;
+      std::string                outputs;
+      std::string                outputsToInstall;
+      std::optional<bool>        broken;
+      std::optional<bool>        unfree;
+      bool                       hasMetaAttr    = false;
+      bool                       hasPnameAttr   = false;
+      bool                       hasVersionAttr = false;
+      std::string                attrName;
+
+      /** Set for rows written to `FailedDerivations' instead. */
+      std::optional<std::string> errorClass;
+
+      /**
+       * Set for rows which checkpoint the `Subtrees' task at `path' instead,
+       * holding the name of the last attribute it completed.
+       */
+      std::optional<std::string> resumeAfter;
     };
 
   private:
+    struct WriteQueue;
+
     std::atomic_bool                  failed { false };
     std::unique_ptr<nix::Sync<State>> _state;
     bool                              _write;
+    std::size_t                       _batchWrites = 0;
+    std::unique_ptr<WriteQueue>       _queue;
+
+    /** Paths which failed to evaluate, loaded by `isFailedDrv'. */
+    std::map<std::pair<std::string, std::string>
+            , std::set<std::vector<std::string>>
+            > _failed;
+
+    void writeRow( Row && row );
+    void writerLoop();
 
   public:
     const nix::flake::Fingerprint fingerprint;
@@ -111,14 +273,55 @@ class DrvDb {
          ,       bool                      trace       = false
          );
 
-    ~DrvDb()
-    {
-      try { this->endCommit(); } catch( ... ) {}
-    }
+    /**
+     * Open the database at @a path instead of the one named by
+     * `getDrvDbName', which is useful for tests and scratch copies.
+     */
+    DrvDb( const nix::flake::Fingerprint & fingerprint
+         , const std::string               & path
+         ,       bool                      create      = true
+         ,       bool                      write       = true
+         ,       bool                      trace       = false
+         );
+
+    ~DrvDb();
 
     void startCommit();
     void endCommit();
 
+    /**
+     * Start a writer thread which performs inserts made by `setDrv' and
+     * `setDrvInfo' in the background.
+     * Rows are passed through a queue holding at most @a capacity rows, and
+     * are written in batches of up to @a batchSize rows per transaction.
+     * While the writer is running `startCommit' and `commitBatch' have no
+     * effect, and `endCommit' waits for queued rows to be written.
+     */
+    void startWriter( std::size_t capacity  = FLOX_DRVDB_QUEUE_SIZE
+                    , std::size_t batchSize = FLOX_DRVDB_BATCH_SIZE
+                    );
+
+    /**
+     * Block until all queued rows have been written.
+     * If the writer thread failed with an error, it is rethrown here.
+     */
+    void flush();
+
+    /**
+     * Write any queued rows and stop the writer thread, rethrowing any error
+     * it failed with.
+     */
+    void stopWriter();
+
+    bool hasWriter() const { return this->_queue != nullptr; }
+
+    /**
+     * Record a write made in the open transaction.
+     * Once @a batchSize writes have accumulated the transaction is committed,
+     * making its rows visible to readers, and a new one is started.
+     */
+    void commitBatch( std::size_t batchSize = FLOX_DRVDB_BATCH_SIZE );
+
       nix::Sync<DrvDb::State>::Lock
     getDbState()
     {
@@ -141,11 +344,29 @@ class DrvDb {
                               , const std::vector<std::string> & path
                               );
 
+    /** @return `true' iff info has been recorded for the derivation. */
+    bool hasDrvInfo(       std::string_view           subtree
+                   ,       std::string_view           system
+                   , const std::vector<std::string> & path
+                   );
+
     std::optional<std::list<std::vector<std::string>>> getDrvPaths(
       std::string_view subtree
     , std::string_view system
     );
 
+    /**
+     * Get paths of derivations which are known to exist, but whose info
+     * hasn't been recorded yet.
+     * These are left behind by scraping paths before info, and may be filled
+     * later with `setDrvInfo'.
+     * Paths which are known to fail to evaluate are included.
+     */
+    std::list<std::vector<std::string>> getDrvPathsMissingInfo(
+      std::string_view subtree
+    , std::string_view system
+    );
+
     std::optional<nlohmann::json> getDrvInfo(
             std::string_view           subtree
     ,       std::string_view           system
@@ -157,11 +378,36 @@ class DrvDb {
     , std::string_view system
     );
 
+    /**
+     * Get info for derivations in a subtree/system which satisfy @a filter.
+     * Rows are filtered by SQLite, using indexes where possible.
+     */
+    std::list<nlohmann::json> getDrvInfos(
+            std::string_view   subtree
+    ,       std::string_view   system
+    , const DrvInfoFilter    & filter
+    );
+
     nix::SQLiteStmt::Use useDrvInfos(
       std::string_view subtree
     , std::string_view system
     );
 
+    /**
+     * Query info for derivations in a prefix satisfying @a filter, ordered
+     * from the shortest attribute path to the longest with ties broken by
+     * attribute name.
+     * Callers may stop stepping the query at the first row they accept.
+     * @param stability Catalog stability, or `std::nullopt' for other
+     *                  subtrees.
+     */
+    nix::SQLiteStmt::Use useDrvInfosRanked(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    ,       std::optional<std::string_view>   stability
+    , const DrvInfoFilter                   & filter
+    );
+
     std::list<nlohmann::json> getDrvInfosStability(
       std::string_view system
     , std::string_view stability
@@ -172,15 +418,38 @@ class DrvDb {
     , std::string_view stability
     );
 
+    /**
+     * Query info for every derivation, ordered by prefix.
+     * Columns are indexed by `all_drv_infos_column'.
+     */
+    nix::SQLiteStmt::Use useAllDrvInfos();
+
     /* Get status of a subtree/system collection. */
     progress_status getProgress( std::string_view subtree
                                , std::string_view system
                                );
+    /**
+     * Get status of a catalog stability, which is done if either it or its
+     * whole subtree/system collection is done.
+     * Without a @a stability this is the status of the whole collection.
+     */
+    progress_status getProgress(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    );
     /* Set status of a subtree/system collection, returning the old value. */
     progress_status setProgress( std::string_view subtree
                                , std::string_view system
                                , progress_status  status
                                );
+    /* Set status of a catalog stability, returning the old value. */
+    progress_status setProgress(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    ,       progress_status                   status
+    );
     /* Set status of a subtree/system collection if `status' is "higher" than
      * the existing value.
      * Returns the old value. */
@@ -188,12 +457,192 @@ class DrvDb {
                                    , std::string_view system
                                    , progress_status  status
                                    );
+    /* Set status of a catalog stability if `status' is "higher" than the
+     * existing value.
+     * Returns the old value. */
+    progress_status promoteProgress(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    ,       progress_status                   status
+    );
+
+    /**
+     * Record whether a `<SUBTREE>.<SYSTEM>[.<STABILITY>]' prefix exists in
+     * our flake, so that later processes needn't probe for it again.
+     * Missing prefixes are marked `DBPS_MISSING', while prefixes which exist
+     * are given a `DBPS_NONE' status unless they already have one.
+     */
+    void recordPrefix(       std::string_view                  subtree
+                     ,       std::string_view                  system
+                     , const std::optional<std::string_view> & stability
+                     ,       bool                              exists
+                     );
+
+    /**
+     * Check whether a prefix is known to exist, either because it was
+     * recorded by `recordPrefix' or because it has been populated.
+     * A catalog stability is missing if its whole subtree/system is.
+     * @return `std::nullopt' if the prefix hasn't been probed.
+     */
+    std::optional<bool> hasPrefix(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    );
+
+    /* Get status of every subtree/system collection. */
   std::unordered_map<std::string
                     , std::unordered_map<std::string
                                         , progress_status
                                         >
                     >                                     getProgresses();
 
+    /**
+     * Record an attribute set marked with `recurseForDerivations' as a task
+     * which may be claimed by any process populating this subtree/system.
+     * Sets which are already known keep their status and cost.
+     */
+    void pushSubtree(       std::string_view           subtree
+                    ,       std::string_view           system
+                    , const std::vector<std::string> & path
+                    );
+
+    /**
+     * Claim the pending task with the highest recorded cost on behalf of
+     * @a owner, usually a process id.
+     * Tasks without a recorded cost are claimed last.
+     * @return The relative path of the claimed set, or `std::nullopt` if no
+     *         tasks are pending.
+     */
+    std::optional<std::vector<std::string>> claimSubtree(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    ,       int64_t                           owner
+    );
+
+    /**
+     * Mark a claimed task as done, recording its cost in milliseconds and the
+     * number of known failures that were skipped.
+     */
+    void finishSubtree(       std::string_view           subtree
+                      ,       std::string_view           system
+                      , const std::vector<std::string> & path
+                      ,       uint64_t                   cost
+                      ,       uint64_t                   skipped = 0
+                      );
+
+    /**
+     * Mark every known task as pending so that they may be claimed by a new
+     * run, keeping their recorded costs.
+     * This should be called once before starting workers for a subtree/system.
+     */
+    void resetSubtrees(       std::string_view                  subtree
+                      ,       std::string_view                  system
+                      , const std::optional<std::string_view> & stability
+                      );
+
+    /**
+     * Mark tasks claimed by @a owner as abandoned, which counts as done for
+     * this run.
+     * Used when a worker exits early so that others don't wait on it.
+     */
+    void abandonSubtrees( int64_t owner );
+
+    /**
+     * Mark tasks of this subtree/system as pending if they are claimed by
+     * @a self, or by processes which no longer exist, so that they may be
+     * claimed again.
+     * Used by workers waiting on claims which would never be finished.
+     * Partially scraped sets continue from their checkpoints.
+     * @return The number of owners whose tasks were released.
+     */
+    std::size_t releaseStaleSubtrees(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    ,       int64_t                           self
+    );
+
+    /**
+     * Prepare to continue a run which was interrupted, marking tasks which
+     * were claimed or abandoned as pending while keeping finished tasks and
+     * checkpoints.
+     * This may be called instead of `resetSubtrees' before starting workers.
+     * @return The number of tasks left to claim, which is `0' if the last
+     *         run finished, in which case `resetSubtrees' should be used.
+     */
+    std::size_t resumeSubtrees(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    );
+
+    /**
+     * Record that the claimed task at @a path has completed every attribute
+     * up to and including @a resumeAfter.
+     * The checkpoint is written in order with rows set before it, so it
+     * becomes visible in the same transaction as those rows or a later one.
+     */
+    void checkpointSubtree(       std::string_view           subtree
+                          ,       std::string_view           system
+                          , const std::vector<std::string> & path
+                          ,       std::string_view           resumeAfter
+                          );
+
+    /**
+     * @return The last attribute completed by the task at @a path in an
+     *         earlier run, or `std::nullopt' if it should start over.
+     */
+    std::optional<std::string> getSubtreeCheckpoint(
+            std::string_view           subtree
+    ,       std::string_view           system
+    , const std::vector<std::string> & path
+    );
+
+    /** Count tasks which are pending or claimed. */
+    std::size_t countOpenSubtrees(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    );
+
+    /** Count known failures skipped by tasks since they were last reset. */
+    std::size_t countSkippedSubtrees(
+            std::string_view                  subtree
+    ,       std::string_view                  system
+    , const std::optional<std::string_view> & stability
+    );
+
+    /**
+     * Record that the attribute at @a path failed to evaluate.
+     * Locked flakes are evaluated purely, so the failure will recur and later
+     * traversals may skip the attribute.
+     * @param errorClass A short description of the error, as returned by
+     *                   `getEvalErrorClass'.
+     */
+    void setFailedDrv(       std::string_view           subtree
+                     ,       std::string_view           system
+                     , const std::vector<std::string> & path
+                     ,       std::string_view           errorClass
+                     );
+
+    /**
+     * @return `true' if the attribute at @a path is known to fail to
+     *         evaluate.
+     * Failures for each subtree/system are loaded once and kept in memory.
+     */
+    bool isFailedDrv(       std::string_view           subtree
+                    ,       std::string_view           system
+                    , const std::vector<std::string> & path
+                    );
+
+    /** Count attributes which are known to fail to evaluate. */
+    std::size_t countFailedDrvs( std::string_view subtree
+                               , std::string_view system
+                               );
+
   std::size_t countDrvs( std::string_view subtree
                        , std::string_view system
                        );
@@ -214,6 +663,15 @@ class DrvDb {
 
 nlohmann::json infoFromQuery( nix::SQLiteStmt::Use & query );
 
+/**
+ * Classify the exception currently being handled for `DrvDb::setFailedDrv'.
+ * This must only be called from within a `catch' block.
+ * @return `std::nullopt' for anything other than `nix::EvalError' and its
+ *         subclasses, since those errors may not recur and so shouldn't be
+ *         recorded.
+ */
+std::optional<std::string> getEvalErrorClass();
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -10,6 +10,7 @@
 #include "flox/util.hh"
 #include "flox/package-set.hh"
 #include "flox/flake-package.hh"
+#include "flox/lock-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -29,53 +30,50 @@ class FlakePackageSet : public PackageSet {
     std::shared_ptr<nix::flake::LockedFlake> _flake;
     nix::ref<nix::EvalState>                 _state;
 
+    /* Opened on first use, and shared with anything else using `_flake'. */
+    mutable std::shared_ptr<nix::eval_cache::EvalCache> _evalCache;
+    mutable MaybeCursor                                 _systemCursor;
+    mutable MaybeCursor                                 _cursor;
+    mutable bool                                        _cursorsOpened = false;
+
       nix::ref<nix::eval_cache::EvalCache>
     openEvalCache() const
     {
-      nix::flake::Fingerprint fingerprint = this->getFingerprint();
-      return nix::make_ref<nix::eval_cache::EvalCache>(
-        ( nix::evalSettings.useEvalCache && nix::evalSettings.pureEval )
-        ? std::optional { std::cref( fingerprint ) }
-        : std::nullopt
-      , * this->_state
-      , [&]()
+      if ( this->_evalCache == nullptr )
         {
-          nix::Value * vFlake = this->_state->allocValue();
-          nix::flake::callFlake( * this->_state, * this->_flake, * vFlake );
-          this->_state->forceAttrs(
-            * vFlake, nix::noPos, "while parsing cached flake data"
-          );
-          nix::Attr * aOutputs = vFlake->attrs->get(
-            this->_state->symbols.create( "outputs" )
-          );
-          assert( aOutputs != nullptr );
-          return aOutputs->value;
+          this->_evalCache = (std::shared_ptr<nix::eval_cache::EvalCache>)
+            getEvalCache( this->_state, this->_flake );
         }
-      );
+      return nix::ref<nix::eval_cache::EvalCache>( this->_evalCache );
     }
 
-      MaybeCursor
-    openCursor() const
+    /**
+     * Walk to `<subtree>.<system>' and our prefix once, keeping the cursors
+     * for later lookups.
+     */
+      void
+    openCursors() const
     {
+      if ( this->_cursorsOpened ) { return; }
       MaybeCursor curr = this->openEvalCache()->getRoot();
-      if ( this->_subtree == ST_PACKAGES )
-        {
-          curr = curr->maybeGetAttr( "packages" );
-          if ( curr == nullptr ) { return nullptr; }
-          curr = curr->maybeGetAttr( this->_system );
-        }
-      else
+      curr = curr->maybeGetAttr( subtreeTypeToString( this->_subtree ) );
+      if ( curr != nullptr ) { curr = curr->maybeGetAttr( this->_system ); }
+      this->_systemCursor = curr;
+      if ( ( curr != nullptr ) && ( this->_subtree != ST_PACKAGES ) &&
+           this->_stability.has_value()
+         )
         {
-          curr = curr->maybeGetAttr( subtreeTypeToString( this->_subtree ) );
-          if ( curr == nullptr ) { return nullptr; }
-          curr = curr->maybeGetAttr( this->_system );
-          if ( this->_stability.has_value() )
-            {
-              if ( curr == nullptr ) { return nullptr; }
-              curr = curr->maybeGetAttr( this->_stability.value() );
-            }
+          curr = curr->maybeGetAttr( this->_stability.value() );
         }
-      return curr;
+      this->_cursor        = curr;
+      this->_cursorsOpened = true;
+    }
+
+      MaybeCursor
+    openCursor() const
+    {
+      this->openCursors();
+      return this->_cursor;
     }
 
 
@@ -104,9 +102,7 @@ class FlakePackageSet : public PackageSet {
     , const std::optional<std::string_view> & stability = std::nullopt
     ) : FlakePackageSet(
           state
-        , std::make_shared<nix::flake::LockedFlake>(
-            nix::flake::lockFlake( * state, flakeRef, floxFlakeLockFlags )
-          )
+        , lockFlakeCached( * state, flakeRef )
         , subtree
         , system
         , stability
@@ -129,6 +125,25 @@ class FlakePackageSet : public PackageSet {
       return this->_flake->getFingerprint();
     }
 
+    nix::SymbolTable * getSymbolTable() const { return & this->_state->symbols; }
+
+    /**
+     * Open a cursor at @a relPath relative to `<subtree>.<system>'.
+     * As in a `DrvDb', catalog paths begin with their stability.
+     */
+      MaybeCursor
+    openRelCursor( const std::vector<std::string> & relPath ) const
+    {
+      this->openCursors();
+      MaybeCursor curr = this->_systemCursor;
+      for ( const std::string & p : relPath )
+        {
+          if ( curr == nullptr ) { return nullptr; }
+          curr = curr->maybeGetAttr( p );
+        }
+      return curr;
+    }
+
 
 /* -------------------------------------------------------------------------- */
 
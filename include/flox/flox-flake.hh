@@ -6,7 +6,9 @@
 
 #pragma once
 
+#include <functional>
 #include "flox/types.hh"
+#include "flox/lock-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -14,6 +16,12 @@
 namespace flox {
   namespace resolve {
 
+/* -------------------------------------------------------------------------- */
+
+/** Produces an `EvalState' when one is first needed. */
+using EvalStateGetter = std::function<nix::ref<nix::EvalState>()>;
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -25,16 +33,34 @@ namespace flox {
  *
  * It is recommended that only one `FloxFlake' be created for a unique `flake'
  * to avoid synchronization slowdowns with its databases.
+ *
+ * The `EvalState' is only requested once evaluation or locking is needed.
+ * References which were locked before can be mapped to their locked
+ * reference and fingerprint through a `LockCache' without either.
  */
 class FloxFlake : public std::enable_shared_from_this<FloxFlake> {
   private:
-    nix::ref<nix::EvalState> _state;
-    FloxFlakeRef             _flakeRef;
-    std::list<std::string>   _systems;
-    std::vector<std::string> _prefsPrefixes;
-    std::vector<std::string> _prefsStabilities;
+    EvalStateGetter            _getState;
+    std::shared_ptr<LockCache> _lockCache;
+    FloxFlakeRef               _flakeRef;
+    std::list<std::string>     _systems;
+    std::vector<std::string>   _prefsPrefixes;
+    std::vector<std::string>   _prefsStabilities;
 
     std::shared_ptr<nix::flake::LockedFlake> lockedFlake;
+    std::optional<LockedRefInfo>             lockedInfo;
+
+    std::shared_ptr<nix::eval_cache::EvalCache>   evalCache;
+    /** Cursors for `getFlakeAttrPathPrefixes', `nullptr' if missing. */
+    std::map<std::list<std::string>, MaybeCursor> prefixCursors;
+    /** Prefixes in `getFlakeAttrPathPrefixes' which exist. */
+    std::optional<std::list<std::list<std::string>>> existingPrefixes;
+
+    /** Fill `lockedInfo' from the `LockCache', or by locking. */
+    const LockedRefInfo & getLockedInfo();
+
+    /** Walk to @a prefix once, returning `nullptr' if it is missing. */
+    MaybeCursor getPrefixCursor( const std::list<std::string> & prefix );
 
   public:
     FloxFlake(       nix::ref<nix::EvalState>   state
@@ -44,15 +70,36 @@ class FloxFlake : public std::enable_shared_from_this<FloxFlake> {
              , const std::list<std::string>   & systems = defaultSystems
              );
 
+    /**
+     * @param getState Called the first time an `EvalState' is needed.
+     * @param lockCache Used to look up and record locked references,
+     *                  or `nullptr' to always lock.
+     */
+    FloxFlake(       EvalStateGetter              getState
+             ,       std::string_view             id
+             , const FloxFlakeRef               & ref
+             , const Preferences                & prefs
+             , const std::list<std::string>     & systems   = defaultSystems
+             ,       std::shared_ptr<LockCache>   lockCache = nullptr
+             );
+
+    nix::ref<nix::EvalState> getEvalState() { return this->_getState(); }
+
     std::shared_ptr<nix::flake::LockedFlake> getLockedFlake();
-    nix::ref<nix::eval_cache::EvalCache>     openEvalCache();
+
+    /** Opens our `EvalCache' once, keeping it open as long as we live. */
+    nix::ref<nix::eval_cache::EvalCache> openEvalCache();
 
     FloxFlakeRef getFlakeRef() const { return this->_flakeRef; }
 
-      FloxFlakeRef
-    getLockedFlakeRef()
+    /** Get our locked reference, without locking if it is recorded. */
+    FloxFlakeRef getLockedFlakeRef() { return this->getLockedInfo().lockedRef; }
+
+    /** Get our fingerprint, without locking if it is recorded. */
+      nix::flake::Fingerprint
+    getFingerprint()
     {
-      return this->getLockedFlake()->flake.lockedRef;
+      return this->getLockedInfo().fingerprint;
     }
 
     std::list<std::string> getSystems() const { return this->_systems; }
@@ -60,13 +107,21 @@ class FloxFlake : public std::enable_shared_from_this<FloxFlake> {
     std::list<std::list<std::string>> getFlakeAttrPathPrefixes() const;
 
     /**
-     * Like `findAttrAlongPath' but without suggestions.
-     * Note that each invocation opens the `EvalCache', so use sparingly.
+     * Get each prefix in `getFlakeAttrPathPrefixes' which exists.
+     * Prefixes are probed once for each fingerprint, and whether they exist
+     * is recorded in our `DrvDb' so that later processes can answer this
+     * without opening our `EvalCache'.
      */
+    std::list<std::list<std::string>> getExistingFlakeAttrPathPrefixes();
+
+    /** Like `findAttrAlongPath' but without suggestions. */
     Cursor      openCursor(      const std::vector<nix::Symbol> & path );
     MaybeCursor maybeOpenCursor( const std::vector<nix::Symbol> & path );
 
-    /** Opens `EvalCache' once, staying open until all cursors die. */
+    /**
+     * Get cursors for each prefix in `getExistingFlakeAttrPathPrefixes'.
+     * Cursors are kept, so each prefix is only walked to once.
+     */
     std::list<Cursor> getFlakePrefixCursors();
 
 };
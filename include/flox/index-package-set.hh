@@ -0,0 +1,223 @@
+/* ========================================================================== *
+ *
+ * @file flox/index-package-set.hh
+ *
+ * @brief A `PackageSet' backed by a memory mapped `PackageIndex'.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <string>
+#include "flox/package-set.hh"
+#include "flox/package-index.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A read-only package set served from a `PackageIndex'.
+ * Unlike `DbPackageSet' no SQL is run and no JSON is parsed; lookups hash
+ * into the mapped index and packages refer to its strings in place.
+ */
+class IndexPackageSet : public PackageSet {
+
+  private:
+
+    std::shared_ptr<const PackageIndex> _index;
+    FloxFlakeRef                        _ref;
+    subtree_type                        _subtree;
+    std::string                         _system;
+    std::optional<std::string>          _stability;
+    /** Position of our prefix in the index, or `PackageIndex::npos'. */
+    uint32_t                            _prefix;
+
+
+/* -------------------------------------------------------------------------- */
+
+  public:
+
+    IndexPackageSet(
+            std::shared_ptr<const PackageIndex>   index
+    , const FloxFlakeRef                        & ref
+    , const subtree_type                        & subtree
+    ,       std::string_view                      system
+    , const std::optional<std::string_view>     & stability = std::nullopt
+    ) : _index( index )
+      , _ref( ref )
+      , _subtree( subtree )
+      , _system( system )
+      , _stability( stability )
+      , _prefix( index->findPrefix( subtreeTypeToString( subtree )
+                                  , system
+                                  , stability
+                                  )
+               )
+    {}
+
+    /** Open the default index for @a flake. */
+    IndexPackageSet(
+            std::shared_ptr<nix::flake::LockedFlake>   flake
+    , const subtree_type                             & subtree
+    ,       std::string_view                           system
+    , const std::optional<std::string_view>          & stability = std::nullopt
+    ) : IndexPackageSet(
+          std::make_shared<const PackageIndex>(
+            getPackageIndexName( flake->getFingerprint() )
+          )
+        , flake->flake.lockedRef
+        , subtree
+        , system
+        , stability
+        )
+    {}
+
+
+/* -------------------------------------------------------------------------- */
+
+    std::string_view getType()    const override { return "index";        }
+    subtree_type     getSubtree() const override { return this->_subtree; }
+    std::string_view getSystem()  const override { return this->_system;  }
+    FloxFlakeRef     getRef()     const override { return this->_ref;     }
+
+      std::optional<std::string_view>
+    getStability() const override
+    {
+      if ( this->_stability.has_value() ) { return this->_stability; }
+      else                                { return std::nullopt;     }
+    }
+
+      std::shared_ptr<const PackageIndex>
+    getIndex() const
+    {
+      return this->_index;
+    }
+
+
+/* -------------------------------------------------------------------------- */
+
+    bool        hasRelPath( const std::list<std::string_view> & path ) override;
+    std::size_t size() override;
+
+    std::shared_ptr<Package> maybeGetRelPath(
+      const std::list<std::string_view> & path
+    ) override;
+
+    /** @return Every package in the set with the given `pname'. */
+    std::vector<IndexedPackage> getPname( std::string_view pname ) const;
+
+
+/* -------------------------------------------------------------------------- */
+
+    struct const_iterator
+    {
+      using value_type = const IndexedPackage;
+      using reference  = value_type &;
+      using pointer    = value_type *;
+
+      private:
+        std::shared_ptr<const PackageIndex> _index;
+        uint32_t                            _id  = 0;
+        uint32_t                            _end = 0;
+        std::optional<IndexedPackage>       _pkg;
+
+          void
+        loadPkg()
+        {
+          if ( this->_id < this->_end )
+            {
+              this->_pkg.emplace( this->_index, this->_id );
+            }
+          else
+            {
+              this->_index = nullptr;
+              this->_id    = 0;
+              this->_end   = 0;
+              this->_pkg   = std::nullopt;
+            }
+        }
+
+      public:
+        const_iterator() = default;
+
+        const_iterator( std::shared_ptr<const PackageIndex> index
+                      , uint32_t                            first
+                      , uint32_t                            count
+                      )
+          : _index( index ), _id( first ), _end( first + count )
+        {
+          this->loadPkg();
+        }
+
+        std::string_view getType() const { return "index"; }
+
+          const_iterator &
+        operator++()
+        {
+          ++this->_id;
+          this->loadPkg();
+          return * this;
+        }
+
+          const_iterator
+        operator++( int )
+        {
+          const_iterator tmp = * this;
+          ++( * this );
+          return tmp;
+        }
+
+          bool
+        operator==( const const_iterator & other ) const
+        {
+          return ( this->_index == other._index ) && ( this->_id == other._id );
+        }
+
+          bool
+        operator!=( const const_iterator & other ) const
+        {
+          return ! ( ( * this ) == other );
+        }
+
+        reference operator*()  const { return * this->_pkg;     }
+        pointer   operator->() const { return & ( * this->_pkg ); }
+
+    };  /* End struct `IndexPackageSet::const_iterator' */
+
+
+/* -------------------------------------------------------------------------- */
+
+      const_iterator
+    begin() const
+    {
+      if ( this->_prefix == PackageIndex::npos ) { return const_iterator(); }
+      const PackageIndex::Prefix & p =
+        this->_index->getPrefixes()[this->_prefix];
+      return const_iterator( this->_index, p.first, p.count );
+    }
+
+    const_iterator end() const { return const_iterator(); }
+
+
+/* -------------------------------------------------------------------------- */
+
+};  /* End class `IndexPackageSet' */
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
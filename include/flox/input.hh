@@ -38,11 +38,18 @@ class Input {
      */
     std::shared_ptr<nix::flake::LockedFlake> _lockedFlake;
 
+    /** Constructs an @a Input from a flake which is already locked. */
+    Input( std::shared_ptr<nix::flake::LockedFlake> lockedFlake )
+      : _lockedFlake( lockedFlake )
+    {}
+
 
 /* -------------------------------------------------------------------------- */
 
   public:
 
+    virtual ~Input() = default;
+
     /** Constructs an @a Input from a _flake reference_ URI string. */
     Input( std::string_view refURI );
     /** Constructs an @a Input from a parsed _flake reference_ object. */
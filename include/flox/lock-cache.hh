@@ -0,0 +1,142 @@
+/* ========================================================================== *
+ *
+ * @file flox/lock-cache.hh
+ *
+ * @brief A persistent record of locked flake references and fingerprints.
+ *
+ * Locking a flake fetches its source tree and hashes its lockfile, which
+ * requires an evaluator even when a reference is already locked, and
+ * unlocked references need to ask their source for the latest revision.
+ * Recording what we learned the first time lets later processes map a
+ * reference straight to the fingerprint of its `DrvDb', and lock the
+ * recorded revision rather than looking one up again.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+#include <nix/sqlite.hh>
+#include <nix/eval.hh>
+#include <nix/flake/flake.hh>
+#include "flox/sqlite.hh"
+#include "flox/types.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Seconds for which the revision an unlocked reference was locked to is
+ * reused, unless `FLOX_LOCK_CACHE_TTL' is set in the environment.
+ * Locked references never expire.
+ */
+#ifndef FLOX_LOCK_CACHE_TTL
+#  define FLOX_LOCK_CACHE_TTL  3600
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+/** Get an absolute path to the lock cache database. */
+std::string getLockCacheName();
+
+/**
+ * Get the default TTL of lock cache records, which is read from the
+ * `FLOX_LOCK_CACHE_TTL' environment variable if it is set.
+ */
+uint64_t getLockCacheTTL();
+
+
+/** What locking a reference produced. */
+struct LockedRefInfo {
+  FloxFlakeRef            lockedRef;
+  nix::flake::Fingerprint fingerprint;
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A SQLite3 database mapping flake references to the locked reference and
+ * fingerprint produced by `nix::flake::lockFlake'.
+ *
+ * Records of locked references never expire, while records of unlocked
+ * references are only used for @a ttl seconds after they were locked.
+ */
+class LockCache {
+
+  private:
+    sqlite::SQLiteDb _db;
+    nix::SQLiteStmt  _queryLocked;
+    nix::SQLiteStmt  _insertLocked;
+    uint64_t         _ttl;
+
+  public:
+    LockCache( const std::string & path = getLockCacheName()
+             ,       uint64_t      ttl  = getLockCacheTTL()
+             );
+
+    /**
+     * Set the seconds for which records of unlocked references are used.
+     * This applies to records made before the change as well.
+     */
+    void     setTTL( uint64_t ttl ) { this->_ttl = ttl;  }
+    uint64_t getTTL()         const { return this->_ttl; }
+
+    /** @return What locking @a ref produced, if it is known and fresh. */
+    std::optional<LockedRefInfo> get( const FloxFlakeRef & ref );
+
+    /**
+     * Record what locking @a ref produced.
+     * The locked reference is recorded as mapping to itself as well, since
+     * it is what we pass around once an input is locked.
+     */
+    void put( const FloxFlakeRef            & ref
+            , const nix::flake::LockedFlake & locked
+            );
+
+};  /* End class `LockCache' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Lock @a ref as `nix::flake::lockFlake' would, using @a cache to skip
+ * looking up the latest revision of references that were locked recently.
+ * @param cache Where locks are looked up and recorded, or `nullptr' to
+ *              always lock @a ref as is.
+ */
+std::shared_ptr<nix::flake::LockedFlake> lockFlakeCached(
+        nix::EvalState & state
+, const FloxFlakeRef   & ref
+,       LockCache      * cache
+);
+
+/** Lock @a ref using the default `LockCache', if it can be opened. */
+std::shared_ptr<nix::flake::LockedFlake> lockFlakeCached(
+        nix::EvalState & state
+, const FloxFlakeRef   & ref
+);
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
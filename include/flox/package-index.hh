@@ -0,0 +1,395 @@
+/* ========================================================================== *
+ *
+ * @file flox/package-index.hh
+ *
+ * @brief A compact, read-only snapshot of a `DrvDb' which is memory mapped.
+ *
+ * Package indexes hold the same metadata as `DerivationInfos' rows with
+ * interned strings, fixed width package records, and perfect hash tables
+ * keyed on attribute paths and `pname'.
+ * Lookups read directly from the mapped file without parsing or copying.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <nix/flake/flake.hh>
+#include "flox/package.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+#define FLOX_PKGINDEX_VERSION  1
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+class DrvDb;
+
+/** Get an absolute path to the package index for a given fingerprint hash. */
+std::string getPackageIndexName( const nix::flake::Fingerprint & fingerprint );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A memory mapped package index file.
+ *
+ * Packages are grouped by `( subtree, system[, stability] )' prefix, and are
+ * referred to by their position in the index.
+ */
+class PackageIndex {
+
+  public:
+    /** A string held in the index's string table. */
+    struct StrRef {
+      uint32_t offset;
+      uint32_t size;
+    };
+
+    /** A run of elements held in one of the index's list tables. */
+    struct ListRef {
+      uint32_t offset;
+      uint32_t size;
+    };
+
+    struct Header {
+      char     magic[8];
+      uint32_t version;
+      uint32_t nPrefixes;
+      uint32_t nRecords;
+      uint32_t nPathBuckets;
+      uint32_t nPathSlots;
+      uint32_t nPnameBuckets;
+      uint32_t nPnameSlots;
+      uint32_t reserved;
+      uint64_t prefixesOffset;
+      uint64_t recordsOffset;
+      uint64_t strListsOffset;
+      uint64_t idsOffset;
+      uint64_t stringsOffset;
+      uint64_t pathSeedsOffset;
+      uint64_t pathSlotsOffset;
+      uint64_t pnameSeedsOffset;
+      uint64_t pnameSlotsOffset;
+      uint64_t fileSize;
+    };
+
+    struct Prefix {
+      StrRef   subtree;
+      StrRef   system;
+      StrRef   stability;
+      uint32_t hasStability;
+      uint32_t first;  /**< Index of the prefix's first record. */
+      uint32_t count;  /**< Number of records in the prefix. */
+    };
+
+    /** Bits used in `Record::flags'. */
+    typedef enum {
+      PF_VERSION      = 1 << 0
+    , PF_SEMVER       = 1 << 1
+    , PF_LICENSE      = 1 << 2
+    , PF_HAS_BROKEN   = 1 << 3
+    , PF_BROKEN       = 1 << 4
+    , PF_HAS_UNFREE   = 1 << 5
+    , PF_UNFREE       = 1 << 6
+    , PF_META_ATTR    = 1 << 7
+    , PF_PNAME_ATTR   = 1 << 8
+    , PF_VERSION_ATTR = 1 << 9
+    } record_flag;
+
+    struct Record {
+      uint32_t prefix;
+      uint32_t flags;
+      ListRef  path;  /**< Relative path, excluding any stability. */
+      StrRef   fullName;
+      StrRef   pname;
+      StrRef   version;
+      StrRef   semver;
+      StrRef   license;
+      ListRef  outputs;
+      ListRef  outputsToInstall;
+    };
+
+    /** Entry in the `pname' table, holding every record with that `pname'. */
+    struct PnameSlot {
+      uint32_t prefix;
+      StrRef   pname;
+      ListRef  ids;
+    };
+
+    /** Marks an unused slot in a hash table. */
+    static constexpr uint32_t npos = UINT32_MAX;
+
+
+/* -------------------------------------------------------------------------- */
+
+  private:
+    const char   * _data = nullptr;
+    std::size_t    _size = 0;
+    const Header * _header;
+
+    template<typename T>
+      std::span<const T>
+    region( uint64_t offset, std::size_t count ) const
+    {
+      return std::span<const T>(
+        reinterpret_cast<const T *>( this->_data + offset )
+      , count
+      );
+    }
+
+
+/* -------------------------------------------------------------------------- */
+
+  public:
+    /**
+     * Map an index file.
+     * Throws `CacheException' if the file is missing, truncated, or was
+     * written by an incompatible version.
+     */
+    PackageIndex( const std::string & path );
+    ~PackageIndex();
+
+    PackageIndex( const PackageIndex & )             = delete;
+    PackageIndex & operator=( const PackageIndex & ) = delete;
+
+      std::string_view
+    getString( StrRef s ) const
+    {
+      return std::string_view( this->_data + this->_header->stringsOffset
+                                           + s.offset
+                             , s.size
+                             );
+    }
+
+      std::span<const StrRef>
+    getStrings( ListRef l ) const
+    {
+      return this->region<StrRef>(
+        this->_header->strListsOffset + ( l.offset * sizeof( StrRef ) )
+      , l.size
+      );
+    }
+
+      std::span<const Prefix>
+    getPrefixes() const
+    {
+      return this->region<Prefix>( this->_header->prefixesOffset
+                                 , this->_header->nPrefixes
+                                 );
+    }
+
+      const Record &
+    getRecord( uint32_t id ) const
+    {
+      return this->region<Record>( this->_header->recordsOffset
+                                 , this->_header->nRecords
+                                 )[id];
+    }
+
+    std::size_t size() const { return this->_header->nRecords; }
+
+    /** @return The index of a prefix, or `npos` if it is absent. */
+    uint32_t findPrefix(       std::string_view                  subtree
+                       ,       std::string_view                  system
+                       , const std::optional<std::string_view> & stability
+                       ) const;
+
+    /**
+     * @return The record at @a relPath in @a prefix, or `npos` if it
+     *         is absent.
+     */
+    uint32_t findRelPath(       uint32_t                      prefix
+                        , const std::list<std::string_view> & relPath
+                        ) const;
+
+    /** @return Records in @a prefix with the given `pname'. */
+      std::span<const uint32_t>
+    findPname( uint32_t prefix, std::string_view pname ) const;
+
+};  /* End class `PackageIndex' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A package read from a `PackageIndex'.
+ * String accessors ending in `View' refer directly to the mapped index.
+ */
+class IndexedPackage : public Package {
+
+  private:
+    std::shared_ptr<const PackageIndex>   _index;
+    const PackageIndex::Record          * _record;
+
+      bool
+    hasFlag( uint32_t flag ) const
+    {
+      return ( this->_record->flags & flag ) != 0;
+    }
+
+      std::optional<std::string>
+    maybeString( uint32_t flag, PackageIndex::StrRef s ) const
+    {
+      if ( ! this->hasFlag( flag ) ) { return std::nullopt; }
+      return std::string( this->_index->getString( s ) );
+    }
+
+    std::vector<std::string> getStrings( PackageIndex::ListRef l ) const;
+
+  public:
+    IndexedPackage( std::shared_ptr<const PackageIndex> index, uint32_t id )
+      : _index( index ), _record( & index->getRecord( id ) )
+    {}
+
+      std::string_view
+    getFullNameView() const
+    {
+      return this->_index->getString( this->_record->fullName );
+    }
+
+      std::string_view
+    getPnameView() const
+    {
+      return this->_index->getString( this->_record->pname );
+    }
+
+      std::optional<std::string_view>
+    getVersionView() const
+    {
+      if ( ! this->hasFlag( PackageIndex::PF_VERSION ) )
+        {
+          return std::nullopt;
+        }
+      return this->_index->getString( this->_record->version );
+    }
+
+    std::vector<std::string> getPathStrs() const override;
+
+      std::string
+    getFullName() const override
+    {
+      return std::string( this->getFullNameView() );
+    }
+
+      std::string
+    getPname() const override
+    {
+      return std::string( this->getPnameView() );
+    }
+
+      std::optional<std::string>
+    getVersion() const override
+    {
+      return this->maybeString( PackageIndex::PF_VERSION
+                              , this->_record->version
+                              );
+    }
+
+      std::optional<std::string>
+    getSemver() const override
+    {
+      return this->maybeString( PackageIndex::PF_SEMVER
+                              , this->_record->semver
+                              );
+    }
+
+      std::optional<std::string>
+    getLicense() const override
+    {
+      return this->maybeString( PackageIndex::PF_LICENSE
+                              , this->_record->license
+                              );
+    }
+
+      std::vector<std::string>
+    getOutputs() const override
+    {
+      return this->getStrings( this->_record->outputs );
+    }
+
+      std::vector<std::string>
+    getOutputsToInstall() const override
+    {
+      return this->getStrings( this->_record->outputsToInstall );
+    }
+
+      std::optional<bool>
+    isBroken() const override
+    {
+      if ( ! this->hasFlag( PackageIndex::PF_HAS_BROKEN ) )
+        {
+          return std::nullopt;
+        }
+      return this->hasFlag( PackageIndex::PF_BROKEN );
+    }
+
+      std::optional<bool>
+    isUnfree() const override
+    {
+      if ( ! this->hasFlag( PackageIndex::PF_HAS_UNFREE ) )
+        {
+          return std::nullopt;
+        }
+      return this->hasFlag( PackageIndex::PF_UNFREE );
+    }
+
+      bool
+    hasMetaAttr() const override
+    {
+      return this->hasFlag( PackageIndex::PF_META_ATTR );
+    }
+
+      bool
+    hasPnameAttr() const override
+    {
+      return this->hasFlag( PackageIndex::PF_PNAME_ATTR );
+    }
+
+      bool
+    hasVersionAttr() const override
+    {
+      return this->hasFlag( PackageIndex::PF_VERSION_ATTR );
+    }
+
+};  /* End class `IndexedPackage' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Write a package index holding every package in @a db to @a path.
+ * The file is written to a temporary path and renamed into place, so readers
+ * never see a partially written index.
+ */
+void writePackageIndex( DrvDb & db, const std::string & path );
+
+/** Write a package index for @a db to its default location. */
+void writePackageIndex( DrvDb & db );
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -12,7 +12,10 @@
 #include "flox/util.hh"
 #include "flox/types.hh"
 #include "flox/flox-flake.hh"
+#include "flox/lock-cache.hh"
+#include "flox/cached-input.hh"
 #include "flox/resolved.hh"
+#include "flox/result-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -31,14 +34,25 @@ namespace flox {
  * If you need to create multiple it is strongly recommended that you close
  * all previously constructed `ResolverState' objects first.
  * This is to avoid synchronization slowdowns in underlying databases.
+ *
+ * `nix' is initialized, and the store and evaluator are opened, the first
+ * time that they are needed.
+ * Inputs which were locked before, and whose `DrvDb' prefixes are fully
+ * cached, are resolved without any of these.
  */
 class ResolverState {
   private:
-    std::shared_ptr<nix::Store>                       _store;
-    std::shared_ptr<nix::Store>                       evalStore;
-    std::shared_ptr<nix::EvalState>                   evalState;
-    std::map<std::string, std::shared_ptr<FloxFlake>> _inputs;
-    const Preferences                                 _prefs;
+    std::shared_ptr<nix::Store>                         _store;
+    std::shared_ptr<nix::Store>                         evalStore;
+    std::shared_ptr<nix::EvalState>                     evalState;
+    std::map<std::string, std::shared_ptr<FloxFlake>>   _inputs;
+    std::map<std::string, std::shared_ptr<CachedInput>> _cachedInputs;
+    const Preferences                                   _prefs;
+    std::size_t                                         _jobs = 0;
+    std::optional<std::string>                          _workerProgram;
+    std::shared_ptr<LockCache>                          _lockCache;
+    bool                                                _useResultCache = true;
+    std::unique_ptr<ResultCache>                        _resultCache;
 
   public:
 
@@ -52,16 +66,109 @@ class ResolverState {
                  , const std::list<std::string> & systems = defaultSystems
                  );
 
+    /* Our inputs hold on to `this' to create an evaluator on demand. */
+    ResolverState( const ResolverState & ) = delete;
+    ResolverState( ResolverState && )      = delete;
+
     Preferences getPreferences() const { return this->_prefs; }
 
+    /**
+     * Set the number of worker processes used to resolve inputs in parallel.
+     * `1' resolves every input in this process, and `0' uses one process per
+     * available CPU.
+     */
+    void setJobs( std::size_t jobs ) { this->_jobs = jobs; }
+
+    /** @return The number of worker processes used to resolve inputs. */
+    std::size_t getJobs() const;
+
+    /**
+     * Set the program executed by worker processes, which must accept the
+     * arguments of `resolver --worker'.
+     * Without one every input is resolved in this process.
+     */
+      void
+    setWorkerProgram( std::string_view path )
+    {
+      this->_workerProgram = std::string( path );
+    }
+
+      const std::optional<std::string> &
+    getWorkerProgram() const
+    {
+      return this->_workerProgram;
+    }
+
+    /**
+     * Set the seconds for which inputs with unlocked references reuse the
+     * revision they were last locked to, overriding `getLockCacheTTL'.
+     * Inputs which were already locked aren't affected.
+     */
+    void setLockCacheTTL( uint64_t ttl );
+
+    /** Enable or disable the persistent cache of resolution results. */
+    void setUseResultCache( bool use ) { this->_useResultCache = use; }
+
+    /**
+     * @return The persistent cache of resolution results, or `nullptr' if it
+     *         is disabled or could not be opened.
+     */
+    ResultCache * getResultCache();
+
     std::map<std::string, nix::ref<FloxFlake>> getInputs() const;
     std::list<std::string_view>                getInputNames() const;
 
     std::optional<nix::ref<FloxFlake>> getInput( std::string_view id ) const;
 
+    /**
+     * Get a `CachedInput' for the input @a id, created on first use.
+     * It shares our evaluator and the input's `FloxFlake', and locks the
+     * input if it isn't locked already.
+     * @return `std::nullopt' if there is no input named @a id.
+     */
+    std::optional<nix::ref<CachedInput>> getCachedInput( std::string_view id );
+
     std::list<Resolved> resolveInInput(       std::string_view   id
                                       , const Descriptor       & desc
                                       );
+
+    /**
+     * Resolve a descriptor with an `absAttrPath' or `relAttrPath' by looking
+     * up its path under each matching `<SUBTREE>.<SYSTEM>' prefix.
+     * Paths are answered from our `DrvDb' where possible.
+     * Only paths which it doesn't rule out are evaluated, and whatever is
+     * evaluated is written back to it.
+     */
+    std::list<Resolved> resolvePathInInput(       std::string_view   id
+                                          , const Descriptor       & desc
+                                          );
+
+    /**
+     * Find the single best resolution of @a desc in an input.
+     *
+     * Prefixes are searched by subtree and catalog stability in order of
+     * preference, and the search stops at the first of these with a match.
+     * Within it the match with the shortest attribute path wins, with ties
+     * broken by attribute name.
+     * Cached prefixes are read with ranked queries which stop at the first
+     * acceptable row, so remaining matches are never loaded.
+     */
+    std::optional<Resolved> resolveOneInInput(       std::string_view   id
+                                             , const Descriptor       & desc
+                                             );
+
+    /**
+     * Resolve many descriptors in a single pass over an input.
+     * Descriptors without attribute paths share one read of each prefix,
+     * with every package checked only against descriptors whose `name' it
+     * could satisfy.
+     * @return Results for each descriptor, in the order of @a descs, in the
+     *         same form as `resolveInInput'.
+     */
+    std::vector<std::list<Resolved>> resolveBatchInInput(
+            std::string_view          id
+    , const std::vector<Descriptor> & descs
+    );
 };
 
 
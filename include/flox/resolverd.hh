@@ -0,0 +1,68 @@
+/* ========================================================================== *
+ *
+ * @file flox/resolverd.hh
+ *
+ * @brief Client side of the `resolverd' protocol.
+ *
+ * `resolverd' is a long running process which keeps `ResolverState' instances
+ * warm between requests, avoiding the cost of initializing `nix', locking
+ * inputs, and opening caches for every resolution.
+ *
+ * Requests and responses are newline delimited JSON objects sent over a Unix
+ * domain socket, one response per request, in order.
+ * A request has the form:
+ *   { "inputs": {...}, "preferences": {...}, "descriptor": {...}
+ *   , "one": false
+ *   }
+ * and is answered by `{ "result": ... }' holding the same JSON `resolver'
+ * would print, or by `{ "error": "<MESSAGE>" }'.
+ * Batches are requested with a `descriptors' list in place of `descriptor',
+ * and are answered with a list holding the result for each descriptor.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get the default path to the `resolverd' socket.
+ * This is `$XDG_RUNTIME_DIR/flox/resolverd.sock' when `XDG_RUNTIME_DIR' is set,
+ * and otherwise lives in the user's cache directory.
+ */
+std::string getResolverdSocketName();
+
+/**
+ * Send a single request to a running `resolverd' and wait for its result.
+ * Throws `ResolverException' if the daemon can't be reached, or if it
+ * reports an error.
+ * @param socketPath Path to the daemon's socket.
+ * @param request A request as described above.
+ * @return The `result' field of the daemon's response.
+ */
+nlohmann::json resolverdRequest( const std::string    & socketPath
+                               , const nlohmann::json & request
+                               );
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -0,0 +1,100 @@
+/* ========================================================================== *
+ *
+ * @file flox/result-cache.hh
+ *
+ * @brief A persistent cache of resolution results.
+ *
+ * Once its inputs are locked a resolution is a pure function of the
+ * descriptor, locked inputs, preferences, systems, and resolver version.
+ * Results are stored by a hash of those so that repeated resolutions are
+ * answered without opening a `DrvDb' or evaluating anything.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+#include <nix/sqlite.hh>
+#include "flox/sqlite.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Bytes of results kept before the least recently used are evicted. */
+#ifndef FLOX_RESULT_CACHE_SIZE
+#  define FLOX_RESULT_CACHE_SIZE  ( 64 * 1024 * 1024 )
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+/** Get an absolute path to the result cache database. */
+std::string getResultCacheName();
+
+/**
+ * Hash a JSON object describing a resolution to get its cache key.
+ * The object must hold everything the results depend on.
+ */
+std::string getResultCacheKey( const nlohmann::json & query );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A SQLite3 database holding serialized lists of `Resolved' keyed by
+ * `getResultCacheKey'.
+ *
+ * Empty lists are stored like any other so that failed resolutions are
+ * cached too.
+ * When the stored results exceed @a maxSize bytes the least recently used
+ * are evicted.
+ * Their total size is kept up to date by triggers, so checking it is cheap.
+ */
+class ResultCache {
+
+  private:
+    sqlite::SQLiteDb _db;
+    nix::SQLiteStmt  _queryResult;
+    nix::SQLiteStmt  _touchResult;
+    nix::SQLiteStmt  _insertResult;
+    nix::SQLiteStmt  _querySize;
+    nix::SQLiteStmt  _evictResults;
+    std::size_t      _maxSize;
+
+    /** Evict the least recently used results until we fit in `_maxSize'. */
+    void evict();
+
+  public:
+    ResultCache( const std::string & path    = getResultCacheName()
+               ,       std::size_t   maxSize = FLOX_RESULT_CACHE_SIZE
+               );
+
+    /** @return The results stored for @a key, if any. */
+    std::optional<nlohmann::json> get( const std::string & key );
+
+    /** Store @a results for @a key, replacing any existing results. */
+    void put( const std::string & key, const nlohmann::json & results );
+
+};  /* End class `ResultCache' */
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -101,8 +101,8 @@ typedef enum {
 , DBPS_PARTIAL    = 1 /* Indicates some partially populated state. */
 , DBPS_PATHS_DONE = 2 /* Indicates that we know all derivation paths. */
 , DBPS_INFO_DONE  = 3 /* Indicates that we have collected info metadata. */
-, DBPS_EMPTY      = 4 /* Indicates that a prefix has no values. */
-, DBPS_MISSING    = 5 /* Indicates that a DB is completely fresh. */
+, DBPS_EMPTY      = 4 /* Indicates that a prefix has no derivations. */
+, DBPS_MISSING    = 5 /* Indicates that a prefix doesn't exist. */
 , DBPS_FORCE      = 6 /* This should always have highest value. */
 }  progress_status;
 
@@ -177,6 +177,7 @@ void to_json(         nlohmann::json & j, const Inputs & i );
 /* -------------------------------------------------------------------------- */
 
 namespace predicates { struct PkgPred; };
+struct DrvInfoFilter;
 
 struct Preferences {
   std::vector<std::string> inputs;
@@ -197,6 +198,9 @@ struct Preferences {
 
   flox::resolve::predicates::PkgPred pred_V2() const;
 
+  /** Conditions from @a pred_V2 which may be checked by a `DrvDb' query. */
+  DrvInfoFilter filter_V2() const;
+
   int compareInputs(
         const std::string_view idA, const FloxFlakeRef & a
       , const std::string_view idB, const FloxFlakeRef & b
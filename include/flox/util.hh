@@ -165,6 +165,20 @@ static const nix::flake::LockFlags floxFlakeLockFlags = {
 bool isSubstitutable( std::string_view storePath );
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get an `EvalCache' for the outputs of @a flake evaluated by @a state.
+ * Handles are shared by everything using the same flake and evaluator, so
+ * the database is opened and the root of the flake is evaluated once for
+ * as long as anyone holds on to the handle.
+ */
+nix::ref<nix::eval_cache::EvalCache> getEvalCache(
+  nix::ref<nix::EvalState>                 state
+, std::shared_ptr<nix::flake::LockedFlake> flake
+);
+
+
 /* -------------------------------------------------------------------------- */
 
   }  /* End namespace `flox::resolve' */
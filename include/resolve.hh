@@ -48,6 +48,12 @@ bool isMatchingAttrPath( const AttrPathGlob                & prefix
 
 /* -------------------------------------------------------------------------- */
 
+/**
+ * Resolve a descriptor in each input, ordered by `Preferences::compareInputs'.
+ * @param one When `true', return only the best result from the most
+ *            preferred input with a match.
+ *            See `ResolverState::resolveOneInInput'.
+ */
 std::list<Resolved> resolve_V2(       ResolverState & rs
                               , const Descriptor    & desc
                               ,       bool            one  = false
@@ -57,6 +63,20 @@ std::optional<Resolved> resolveOne_V2(       ResolverState & rs
                                      , const Descriptor    & desc
                                      );
 
+/**
+ * Resolve many descriptors.
+ * Unless @a one is set, each package set is visited once per input.
+ * @param one When `true', each descriptor stops at its first resolution,
+ *            found by the ranked search of `ResolverState::resolveOneInInput'
+ *            so that it matches `resolveOne_V2'.
+ * @return Results for each descriptor in the order of @a descs.
+ */
+std::vector<std::list<Resolved>> resolveBatch_V2(
+        ResolverState           & rs
+, const std::vector<Descriptor> & descs
+,       bool                      one = false
+);
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -14,6 +14,8 @@
 #include <regex>
 #include <optional>
 #include <list>
+#include <vector>
+#include <cstdint>
 #include <nix/util.hh>
 
 
@@ -51,6 +53,120 @@ bool isCoercibleToSemver( std::string_view version );
 std::optional<std::string> coerceSemver( std::string_view version );
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A parsed _semantic version_.
+ *
+ * Parsing and comparison follow `node-semver` so that results are identical to
+ * those produced by @a runSemver.
+ * Numeric prerelease identifiers are stored in their canonical form
+ * ( `01` becomes `1` ), and build metadata is discarded since it is never used
+ * in comparisons.
+ */
+struct Semver {
+  uint64_t                 major      = 0;
+  uint64_t                 minor      = 0;
+  uint64_t                 patch      = 0;
+  std::vector<std::string> prerelease = {};
+
+  /**
+   * @return `-1`, `0`, or `1` if @a this is less than, equal to, or greater
+   *         than @a other by _semantic version_ precedence.
+   */
+  int compare( const Semver & other ) const;
+
+  bool operator==( const Semver & other ) const;
+  bool operator<(  const Semver & other ) const;
+
+  /** @return The _cleaned_ version string, without build metadata. */
+  std::string toString() const;
+};
+
+
+/**
+ * Parse a _semantic version_ string.
+ * @param version A _semantic version_ string such as `4.2.0-pre`.
+ * @param loose Whether to accept _loose_ forms such as `v1.2.3`, `=1.2.3`,
+ *              or `1.2.3beta` ( `node-semver --loose` ).
+ * @return `std::nullopt` iff @a version is not a valid _semantic version_.
+ */
+std::optional<Semver> parseSemver( std::string_view version
+                                 , bool             loose = false
+                                 );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A _semantic version range_ as taken by `node-semver`, compiled once so that
+ * it may be tested against many versions without being re-parsed.
+ *
+ * Supports comparators ( `<`, `<=`, `>`, `>=`, `=` ), X-ranges ( `1.2.x` ),
+ * tilde ranges ( `~1.2.3` ), caret ranges ( `^1.2.3` ), hyphen ranges
+ * ( `1.2.3 - 2.3.4` ), and unions ( `||` ).
+ */
+class SemverRange {
+
+  public:
+
+    typedef enum {
+      OP_ANY = 0  /**< Matches all versions. */
+    , OP_EQ  = 1
+    , OP_LT  = 2
+    , OP_LE  = 3
+    , OP_GT  = 4
+    , OP_GE  = 5
+    } op_type;
+
+    /** A single primitive comparison such as `>=1.2.3`. */
+    struct Comparator {
+      op_type op      = OP_ANY;
+      Semver  version = {};
+
+      bool test( const Semver & version ) const;
+    };
+
+  private:
+    /** A union of intersections ( `A B || C D` ). */
+    std::vector<std::vector<Comparator>> _set;
+    bool                                 _loose             = false;
+    bool                                 _includePrerelease = false;
+
+    SemverRange() = default;
+
+  public:
+
+    /**
+     * Compile a _semantic version range_.
+     * @param range A _semantic version range_ as taken by `node-semver`.
+     * @param loose Whether to accept _loose_ version forms
+     *              ( `node-semver --loose` ).
+     * @param includePrerelease Whether prerelease versions may satisfy ranges
+     *                          that do not explicitly mention them
+     *                          ( `node-semver --include-prerelease` ).
+     * @return `std::nullopt` iff @a range is not a valid range.
+     */
+    static std::optional<SemverRange> parse(
+      std::string_view range
+    , bool             loose             = false
+    , bool             includePrerelease = false
+    );
+
+    /** @return `true` iff @a version falls in the range. */
+    bool test( const Semver & version ) const;
+
+    /**
+     * @return `true` iff @a version is a valid _semantic version_ which falls
+     *         in the range.
+     */
+    bool test( std::string_view version ) const;
+
+    /** @return The normalized range string, e.g. `>=1.2.3 <2.0.0-0`. */
+    std::string toString() const;
+};
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -62,6 +178,9 @@ std::pair<int, std::string> runSemver( const std::list<std::string> & args );
 
 /**
  * Filter a list of versions by a `node-semver` _semantic version range_.
+ *
+ * This is evaluated natively, and is equivalent to
+ * `semver --include-prerelease --loose --range RANGE VERSIONS...`.
  * @param range A _semantic version range_ as taken by `node-semver`.
  * @param versions A list of _semantic versions_ to filter.
  * @return The list of _semantic versions_ from @a versions which fall in the
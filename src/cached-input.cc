@@ -0,0 +1,228 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <filesystem>
+#include "flox/cached-input.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+CachedInput::CachedInput( nix::ref<FloxFlake> flake )
+  : Input( std::shared_ptr<nix::flake::LockedFlake>() )
+  , _flake( flake )
+  , _db( std::make_shared<DrvDb>( flake->getFingerprint() ) )
+{
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<nix::flake::LockedFlake>
+CachedInput::getLockedFlake()
+{
+  if ( this->_lockedFlake == nullptr )
+    {
+      this->_lockedFlake = this->_flake->getLockedFlake();
+    }
+  return this->_lockedFlake;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  const std::list<std::vector<std::string>> &
+CachedInput::getPrefixes()
+{
+  if ( ! this->_prefixes.has_value() )
+    {
+      std::list<std::vector<std::string>> rsl;
+      for ( const std::list<std::string> & prefix :
+              this->_flake->getExistingFlakeAttrPathPrefixes()
+          )
+        {
+          rsl.emplace_back( prefix.begin(), prefix.end() );
+        }
+      this->_prefixes = std::move( rsl );
+    }
+  return this->_prefixes.value();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::unordered_set<subtree_type>
+CachedInput::getSubtrees()
+{
+  std::unordered_set<subtree_type> rsl;
+  for ( const std::vector<std::string> & prefix : this->getPrefixes() )
+    {
+      rsl.emplace( parseSubtreeType( prefix[0] ) );
+    }
+  return rsl;
+}
+
+
+  std::unordered_set<std::string_view>
+CachedInput::getSystems( const subtree_type & subtree )
+{
+  std::unordered_set<std::string_view> rsl;
+  for ( const std::vector<std::string> & prefix : this->getPrefixes() )
+    {
+      if ( parseSubtreeType( prefix[0] ) == subtree )
+        {
+          rsl.emplace( prefix[1] );
+        }
+    }
+  return rsl;
+}
+
+
+  std::unordered_set<std::string_view>
+CachedInput::getStabilities( std::string_view system )
+{
+  std::unordered_set<std::string_view> rsl;
+  for ( const std::vector<std::string> & prefix : this->getPrefixes() )
+    {
+      if ( ( prefix[0] == "catalog" ) && ( prefix[1] == system ) &&
+           ( 2 < prefix.size() )
+         )
+        {
+          rsl.emplace( prefix[2] );
+        }
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<CachedPackageSet>
+CachedInput::getCachedPackageSet( const std::vector<std::string> & prefix )
+{
+  auto search = this->_packageSets.find( prefix );
+  if ( search != this->_packageSets.end() ) { return search->second; }
+
+  const std::list<std::vector<std::string>> & prefixes = this->getPrefixes();
+  if ( std::find( prefixes.begin(), prefixes.end(), prefix ) ==
+       prefixes.end()
+     )
+    {
+      return nullptr;
+    }
+
+  std::optional<std::string_view> stability;
+  if ( 2 < prefix.size() ) { stability = prefix[2]; }
+  std::shared_ptr<CachedPackageSet> ps = std::make_shared<CachedPackageSet>(
+    this->_flake->getEvalState()
+  , this->getLockedFlake()
+  , parseSubtreeType( prefix[0] )
+  , prefix[1]
+  , stability
+  , this->_db
+  );
+  this->_packageSets.emplace( prefix, ps );
+  return ps;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::list<nix::ref<PackageSet>>
+CachedInput::getPackageSets()
+{
+  std::list<nix::ref<PackageSet>> rsl;
+  for ( const std::vector<std::string> & prefix : this->getPrefixes() )
+    {
+      rsl.push_back( (nix::ref<PackageSet>) std::shared_ptr<PackageSet>(
+        this->getCachedPackageSet( prefix )
+      ) );
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<const PackageIndex>
+CachedInput::getPackageIndex()
+{
+  if ( ! this->_index.has_value() )
+    {
+      this->_index = nullptr;
+      std::string path = getPackageIndexName( this->getFingerprint() );
+      if ( std::filesystem::exists( path ) )
+        {
+          /* Outdated or damaged indexes are ignored. */
+          try
+            {
+              this->_index = std::make_shared<const PackageIndex>( path );
+            }
+          catch( const CacheException & )
+            {
+            }
+        }
+    }
+  return this->_index.value();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<PackageSet>
+CachedInput::getPackageSet( const subtree_type     & subtree
+                          ,       std::string_view   system
+                          )
+{
+  if ( subtree == ST_CATALOG )
+    {
+      throw ResolverException(
+        "CachedInput::getPackageSet(): Catalog package sets must be looked "
+        "up with a stability."
+      );
+    }
+  return this->getCachedPackageSet( {
+    std::string( subtreeTypeToString( subtree ) )
+  , std::string( system )
+  } );
+}
+
+
+  std::shared_ptr<PackageSet>
+CachedInput::getPackageSet( std::string_view subtreeOrSystem
+                          , std::string_view systemOrCatalog
+                          )
+{
+  if ( isPkgsSubtree( subtreeOrSystem ) )
+    {
+      return this->getPackageSet( parseSubtreeType( subtreeOrSystem )
+                                , systemOrCatalog
+                                );
+    }
+  return this->getCachedPackageSet( {
+    "catalog"
+  , std::string( subtreeOrSystem )
+  , std::string( systemOrCatalog )
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -4,6 +4,10 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
 #include "flox/types.hh"
 #include "flox/cached-package-set.hh"
 
@@ -13,13 +17,47 @@
 namespace flox {
   namespace resolve {
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Handle the exception being thrown while evaluating the package at @a path,
+ * which is relative to `<subtree>.<system>'.
+ * Evaluation errors recur in locked flakes, so they are recorded and the
+ * package may be skipped; anything else is rethrown.
+ * This must be called from a `catch' block.
+ */
+  static void
+skipFailedDrv(       DrvDb                    & db
+             ,       std::string_view           subtree
+             ,       std::string_view           system
+             , const std::vector<std::string> & path
+             )
+{
+  std::optional<std::string> err = getEvalErrorClass();
+  if ( ! err.has_value() ) { throw; }
+  db.setFailedDrv( subtree, system, path, * err );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   bool
 CachedPackageSet::hasRelPath( const std::list<std::string_view> & path )
 {
-  if ( this->_populateDb ) { return this->_fps->hasRelPath( path );  }
-  else                     { return this->_dbps->hasRelPath( path ); }
+  if ( ! this->_populateDb ) { return this->_dbps->hasRelPath( path ); }
+
+  /* Once paths are known the database is conclusive. */
+  std::string              subtree( subtreeTypeToString( this->_subtree ) );
+  std::vector<std::string> p     = this->toDbPath( path );
+  std::optional<bool>      known = this->_db->hasDrv( subtree
+                                                    , this->_system
+                                                    , p
+                                                    );
+  if ( known.has_value() ) { return known.value(); }
+
+  bool rsl = this->_fps->hasRelPath( path );
+  if ( rsl ) { this->_db->setDrv( subtree, this->_system, p ); }
+  return rsl;
 }
 
 
@@ -28,8 +66,23 @@ CachedPackageSet::hasRelPath( const std::list<std::string_view> & path )
   std::shared_ptr<Package>
 CachedPackageSet::maybeGetRelPath( const std::list<std::string_view> & path )
 {
-  if ( this->_populateDb ) { return this->_fps->maybeGetRelPath( path );  }
-  else                     { return this->_dbps->maybeGetRelPath( path ); }
+  /* This fills info for paths which were recorded without it. */
+  std::shared_ptr<Package> pkg = this->_dbps->maybeGetRelPath( path );
+  if ( ( pkg != nullptr ) || ( ! this->_populateDb ) ) { return pkg; }
+
+  /* Once paths are known a miss means there's no derivation to evaluate. */
+  std::string              subtree( subtreeTypeToString( this->_subtree ) );
+  std::vector<std::string> p = this->toDbPath( path );
+  if ( ( DBPS_PATHS_DONE <= this->_progress ) ||
+       this->_db->isFailedDrv( subtree, this->_system, p )
+     )
+    {
+      return nullptr;
+    }
+
+  pkg = this->_fps->maybeGetRelPath( path );
+  if ( pkg != nullptr ) { this->_db->setDrvInfo( * pkg ); }
+  return pkg;
 }
 
 
@@ -38,8 +91,18 @@ CachedPackageSet::maybeGetRelPath( const std::list<std::string_view> & path )
   std::size_t
 CachedPackageSet::size()
 {
-  if ( this->_populateDb ) { return this->_fps->size();  }
-  else                     { return this->_dbps->size(); }
+  if ( ! this->_populateDb ) { return this->_dbps->size(); }
+  if ( this->_progress < DBPS_PATHS_DONE ) { return this->_fps->size(); }
+  /* Paths are known, so we can count them without their info. */
+  if ( this->_stability.has_value() )
+    {
+      return this->_db->countDrvsStability( this->_system
+                                          , this->_stability.value()
+                                          );
+    }
+  return this->_db->countDrvs( subtreeTypeToString( this->_subtree )
+                             , this->_system
+                             );
 }
 
 
@@ -55,18 +118,19 @@ CachedPackageSet::begin() const
       , this->_fps
       , nullptr
       , this->_db
+      , this->_batchSize
       );
     }
   else
     {
-      return const_iterator( this->_populateDb, nullptr, this->_dbps, nullptr );
+      return const_iterator( false, nullptr, this->_dbps, nullptr );
     }
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-  void
+  bool
 CachedPackageSet::const_iterator::loadPkg()
 {
   /* If we are populating the DB then evaluate the next package, cache the
@@ -75,24 +139,49 @@ CachedPackageSet::const_iterator::loadPkg()
     {
       const Package * p = this->_fi->operator->().get_ptr().get();
 
-      this->_db->setDrvInfo( * p );
-
-      this->_ptr = std::make_shared<value_type>(
-        p->getPathStrs()
-      , p->getFullName()
-      , p->getPname()
-      , p->getVersion()
-      , p->getSemver()
-      , p->getLicense()
-      , p->getOutputs()
-      , p->getOutputsToInstall()
-      , p->isBroken()
-      , p->isUnfree()
-      , p->hasMetaAttr()
-      , p->hasPnameAttr()
-      , p->hasVersionAttr()
-      );
+      /* Rows from an earlier run save us from evaluating the rest of the
+       * package's fields, and known failures are skipped. */
+      std::vector<std::string> path = p->getPathStrs();
+      std::vector<std::string> relPath( path.begin() + 2, path.end() );
+      if ( this->_db->isFailedDrv( path[0], path[1], relPath ) )
+        {
+          return false;
+        }
+      std::optional<nlohmann::json> info =
+        this->_db->getDrvInfo( path[0], path[1], relPath );
+      if ( info.has_value() )
+        {
+          this->_ptr = std::make_shared<CachedPackage>(
+            std::move( info.value() )
+          );
+          return true;
+        }
 
+      try
+        {
+          this->_db->setDrvInfo( * p );
+
+          this->_ptr = std::make_shared<value_type>(
+            p->getPathStrs()
+          , p->getFullName()
+          , p->getPname()
+          , p->getVersion()
+          , p->getSemver()
+          , p->getLicense()
+          , p->getOutputs()
+          , p->getOutputsToInstall()
+          , p->isBroken()
+          , p->isUnfree()
+          , p->hasMetaAttr()
+          , p->hasPnameAttr()
+          , p->hasVersionAttr()
+          );
+        }
+      catch( ... )
+        {
+          skipFailedDrv( * this->_db, path[0], path[1], relPath );
+          return false;
+        }
     }
   else
     {
@@ -100,77 +189,120 @@ CachedPackageSet::const_iterator::loadPkg()
         this->_di->operator->().get_ptr()
       );
     }
+  return true;
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-  CachedPackageSet::const_iterator &
-CachedPackageSet::const_iterator::operator++()
+  void
+CachedPackageSet::const_iterator::seek()
 {
-  /* If we are populating the DB then evaluate the next package, cache the
-   * result in our DB, then return the result. */
   if ( this->_populateDb )
     {
-      ++( * this->_fi );
-      if ( ( * this->_fi ) != ( * this->_fe ) ) { loadPkg(); }
+      for ( ; ( * this->_fi ) != ( * this->_fe ); ++( * this->_fi ) )
+        {
+          if ( this->loadPkg() ) { return; }
+        }
+      this->_db->stopWriter();
     }
-  else
+  else if ( ( * this->_di ) != ( * this->_de ) )
     {
-      ++( * this->_di );
-      if ( ( * this->_di ) != ( * this->_de ) ) { loadPkg(); }
+      this->loadPkg();
+      return;
     }
+  this->_ptr = nullptr;
+}
+
+
+/* -------------------------------------------------------------------------- */
 
+  CachedPackageSet::const_iterator &
+CachedPackageSet::const_iterator::operator++()
+{
+  if ( this->_populateDb ) { ++( * this->_fi ); }
+  else                     { ++( * this->_di ); }
+  this->seek();
   return * this;
 }  /* End `CachedPackageSet::const_iterator::operator++()' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get the stability @a ps records progress under, which is only set for
+ * catalogs.
+ */
+  static std::optional<std::string_view>
+progressStability( const PackageSet & ps )
+{
+  if ( ps.getSubtree() != ST_CATALOG ) { return std::nullopt; }
+  return ps.getStability();
+}
+
+
+/**
+ * Mark the prefix of @a ps as @a status.
+ * Catalog stabilities are marked on their own, leaving the catalog as a whole
+ * partially populated.
+ * Completed prefixes without any derivations are marked `DBPS_EMPTY'.
+ */
+  static void
+promotePrefix( DrvDb & db, const PackageSet & ps, progress_status status )
+{
+  std::string subtree( subtreeTypeToString( ps.getSubtree() ) );
+  std::optional<std::string_view> stability = progressStability( ps );
+  if ( status == DBPS_INFO_DONE )
+    {
+      db.flush();
+      std::size_t count =
+        stability.has_value()
+        ? db.countDrvsStability( ps.getSystem(), stability.value() )
+        : db.countDrvs( subtree, ps.getSystem() );
+      if ( count == 0 ) { status = DBPS_EMPTY; }
+    }
+  db.promoteProgress( subtree, ps.getSystem(), stability, status );
+  if ( stability.has_value() )
+    {
+      db.promoteProgress( subtree, ps.getSystem(), DBPS_PARTIAL );
+    }
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   DbPackageSet
-cachePackageSet( FlakePackageSet & ps )
+cachePackageSet( FlakePackageSet & ps, std::size_t batchSize )
 {
   std::shared_ptr<DrvDb> db = std::make_shared<DrvDb>( ps.getFingerprint() );
   /* Check to see if this db already exists and is "done". */
   progress_status s = db->getProgress( subtreeTypeToString( ps.getSubtree() )
                                      , ps.getSystem()
+                                     , progressStability( ps )
                                      );
 
-  if ( ! ( ( s == DBPS_INFO_DONE ) ||
-           /* Check if stability is done by comparing sizes. */
-           ( ( ps.getSubtree() == ST_CATALOG ) &&
-             ( s == DBPS_PARTIAL ) &&
-             ( db->countDrvInfosStability( ps.getSystem()
-                                         , ps.getStability().value()
-                                         )
-               == ps.size()
-             )
-           )
-         )
-     )
+  if ( s < DBPS_INFO_DONE )
     {
       /* Populate the DB. */
+      db->startWriter( FLOX_DRVDB_QUEUE_SIZE, batchSize );
       for ( const FlakePackage & pkg : ps )
         {
-          db->setDrvInfo( (const Package &) pkg );
+          std::vector<std::string> path = pkg.getPathStrs();
+          std::vector<std::string> relPath( path.begin() + 2, path.end() );
+          if ( db->isFailedDrv( path[0], path[1], relPath ) ) { continue; }
+          try
+            {
+              db->setDrvInfo( (const Package &) pkg );
+            }
+          catch( ... )
+            {
+              skipFailedDrv( * db, path[0], path[1], relPath );
+            }
         }
+      db->stopWriter();
 
-      /* Mark subtree/system as "done". */
-      // TODO: find a way to mark catalog stabilities.
-      if ( ps.getSubtree() != ST_CATALOG )
-        {
-          db->promoteProgress( subtreeTypeToString( ps.getSubtree() )
-                             , ps.getSystem()
-                             , DBPS_INFO_DONE
-                             );
-        }
-      else
-        {
-          db->promoteProgress( subtreeTypeToString( ps.getSubtree() )
-                             , ps.getSystem()
-                             , DBPS_PARTIAL
-                             );
-        }
+      /* Mark subtree/system, or catalog stability, as "done". */
+      promotePrefix( * db, ps, DBPS_INFO_DONE );
     }
 
    return DbPackageSet( ps.getFlake()
@@ -182,6 +314,306 @@ cachePackageSet( FlakePackageSet & ps )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  void
+cacheSubtrees( DrvDb           & db
+             , FlakePackageSet & ps
+             , std::size_t       batchSize
+             , bool              pathsOnly
+             )
+{
+  std::string subtree( subtreeTypeToString( ps.getSubtree() ) );
+  std::string system( ps.getSystem() );
+  std::optional<std::string_view> stability = ps.getStability();
+  nix::SymbolTable              * symtab    = ps.getSymbolTable();
+
+  /* Every task is resolved relative to this cursor so that we share a single
+   * `EvalCache' for the whole run. */
+  MaybeCursor base = ps.openRelCursor( {} );
+  if ( base == nullptr )
+    {
+      /* Record the prefix as missing so that it isn't scraped again. */
+      db.recordPrefix( subtree, system, stability, false );
+      return;
+    }
+
+  std::vector<std::string> root;
+  if ( stability.has_value() ) { root.emplace_back( stability.value() ); }
+
+  int64_t owner = getpid();
+  /* Rows left by earlier runs, which may not have recorded their sets as
+   * tasks, are kept rather than evaluated again. */
+  bool resumed = DBPS_PARTIAL <= db.getProgress( subtree, system, stability );
+  db.pushSubtree( subtree, system, root );
+  db.startWriter( FLOX_DRVDB_QUEUE_SIZE, batchSize );
+
+  /* Sets are checkpointed once per batch, as rows are committed. */
+  std::size_t checkpointEvery = std::max( batchSize, (std::size_t) 1 );
+
+  /* Tracks whether other workers are making progress while we wait. */
+  std::size_t lastOpen  = 0;
+  auto        lastMoved = std::chrono::steady_clock::now();
+
+  while ( true )
+    {
+      std::optional<std::vector<std::string>> path =
+        db.claimSubtree( subtree, system, stability, owner );
+      if ( ! path.has_value() )
+        {
+          std::size_t open = db.countOpenSubtrees( subtree, system, stability );
+          if ( open == 0 ) { break; }
+          /* Claims left by crashed workers, or by an earlier failure of our
+           * own, will never be finished, so we take them over. */
+          if ( 0 < db.releaseStaleSubtrees( subtree
+                                          , system
+                                          , stability
+                                          , owner
+                                          )
+             )
+            {
+              continue;
+            }
+          auto now = std::chrono::steady_clock::now();
+          if ( open != lastOpen )
+            {
+              lastOpen  = open;
+              lastMoved = now;
+            }
+          else if ( std::chrono::seconds( FLOX_DRVDB_CLAIM_TIMEOUT ) <
+                    ( now - lastMoved )
+                  )
+            {
+              /* Leave the prefix partial for a later run to resume. */
+              db.stopWriter();
+              promotePrefix( db, ps, DBPS_PARTIAL );
+              return;
+            }
+          /* Others may still discover sets for us to claim. */
+          std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+          continue;
+        }
+
+      auto start = std::chrono::steady_clock::now();
+
+      MaybeCursor              curr = base;
+      std::vector<nix::Symbol> attrs;
+      try
+        {
+          for ( const std::string & p : path.value() )
+            {
+              curr = curr->maybeGetAttr( p );
+              if ( curr == nullptr ) { break; }
+            }
+          if ( curr != nullptr ) { attrs = curr->getAttrs(); }
+        }
+      catch( ... )
+        {
+          curr = nullptr;
+        }
+
+      /* Continue after the last checkpoint of an interrupted run. */
+      std::size_t first = 0;
+      if ( std::optional<std::string> resume =
+             db.getSubtreeCheckpoint( subtree, system, path.value() )
+         )
+        {
+          for ( std::size_t i = 0; i < attrs.size(); ++i )
+            {
+              std::string name = ( * symtab )[attrs[i]];
+              if ( name == resume.value() ) { first = i + 1; break; }
+            }
+        }
+
+      uint64_t skipped = 0;
+      if ( curr != nullptr )
+        {
+          for ( std::size_t i = first; i < attrs.size(); ++i )
+            {
+              const nix::Symbol & s = attrs[i];
+              /* Every attribute before this one is done. */
+              if ( ( first < i ) &&
+                   ( ( ( i - first ) % checkpointEvery ) == 0 )
+                 )
+                {
+                  db.checkpointSubtree( subtree
+                                      , system
+                                      , path.value()
+                                      , ( * symtab )[attrs[i - 1]]
+                                      );
+                }
+              std::vector<std::string> child = path.value();
+              child.emplace_back( ( * symtab )[s] );
+              if ( db.isFailedDrv( subtree, system, child ) )
+                {
+                  ++skipped;
+                  continue;
+                }
+              if ( resumed &&
+                   ( pathsOnly
+                     ? db.hasDrv( subtree, system, child ).value_or( false )
+                     : db.hasDrvInfo( subtree, system, child )
+                   )
+                 )
+                {
+                  continue;
+                }
+              try
+                {
+                  Cursor c = curr->getAttr( s );
+                  if ( ( ps.getSubtree() == ST_PACKAGES ) ||
+                       c->isDerivation()
+                     )
+                    {
+                      if ( pathsOnly ) { db.setDrv( subtree, system, child ); }
+                      else
+                        {
+                          db.setDrvInfo( FlakePackage( c, symtab, false ) );
+                        }
+                      continue;
+                    }
+                  MaybeCursor m = c->maybeGetAttr( "recurseForDerivations" );
+                  if ( ( m != nullptr ) && m->getBool() )
+                    {
+                      db.pushSubtree( subtree, system, child );
+                    }
+                }
+              catch( ... )
+                {
+                  /* If eval fails ignore the package, and remember that it
+                   * failed so that we don't try again. */
+                  skipFailedDrv( db, subtree, system, child );
+                }
+            }
+        }
+
+      /* The last worker to finish marks the prefix as done, so our rows must
+       * be written before we finish this set. */
+      db.flush();
+      db.finishSubtree(
+        subtree
+      , system
+      , path.value()
+      , std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start
+        ).count()
+      , skipped
+      );
+    }
+
+  db.stopWriter();
+
+  /* A resumed run may have skipped sets which an earlier run scraped with
+   * `pathsOnly', leaving their info to be filled. */
+  progress_status done = pathsOnly ? DBPS_PATHS_DONE : DBPS_INFO_DONE;
+  if ( ! pathsOnly )
+    {
+      for ( const std::vector<std::string> & p :
+              db.getDrvPathsMissingInfo( subtree, system )
+          )
+        {
+          if ( ( ( ! stability.has_value() ) ||
+                 ( ( ! p.empty() ) && ( p[0] == stability.value() ) )
+               ) &&
+               ( ! db.isFailedDrv( subtree, system, p ) )
+             )
+            {
+              done = DBPS_PATHS_DONE;
+              break;
+            }
+        }
+    }
+
+  promotePrefix( db, ps, done );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+fillDrvInfos( DrvDb & db, FlakePackageSet & ps, std::size_t batchSize )
+{
+  std::string subtree( subtreeTypeToString( ps.getSubtree() ) );
+  std::string system( ps.getSystem() );
+  std::optional<std::string_view> stability = ps.getStability();
+  nix::SymbolTable              * symtab    = ps.getSymbolTable();
+
+  db.startWriter( FLOX_DRVDB_QUEUE_SIZE, batchSize );
+
+  for ( const std::vector<std::string> & path :
+          db.getDrvPathsMissingInfo( subtree, system )
+      )
+    {
+      /* Other catalog stabilities are filled by their own workers. */
+      if ( stability.has_value() &&
+           ( path.empty() || ( path[0] != stability.value() ) )
+         )
+        {
+          continue;
+        }
+      if ( db.isFailedDrv( subtree, system, path ) ) { continue; }
+      try
+        {
+          MaybeCursor c = ps.openRelCursor( path );
+          if ( c != nullptr )
+            {
+              db.setDrvInfo( FlakePackage( (Cursor) c, symtab, false ) );
+            }
+        }
+      catch( ... )
+        {
+          skipFailedDrv( db, subtree, system, path );
+        }
+    }
+
+  db.stopWriter();
+
+  promotePrefix( db, ps, DBPS_INFO_DONE );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+CachedPackageSet::populate()
+{
+  if ( ! this->_populateDb ) { return; }
+
+  std::string subtree( subtreeTypeToString( this->_subtree ) );
+  std::optional<std::string_view> stability = progressStability( * this );
+
+  if ( this->_progress < DBPS_PATHS_DONE )
+    {
+      /* Sets left by an interrupted run are resumed from their last
+       * checkpoint, otherwise we start over while keeping stored rows. */
+      if ( this->_db->resumeSubtrees( subtree, this->_system, stability ) ==
+           0
+         )
+        {
+          this->_db->resetSubtrees( subtree, this->_system, stability );
+        }
+      cacheSubtrees( * this->_db
+                   , * this->getFlakePackageSet()
+                   , this->_batchSize
+                   );
+      this->_progress =
+        this->_db->getProgress( subtree, this->_system, stability );
+    }
+
+  if ( this->_progress == DBPS_PATHS_DONE )
+    {
+      fillDrvInfos( * this->_db
+                  , * this->getFlakePackageSet()
+                  , this->_batchSize
+                  );
+      this->_progress =
+        this->_db->getProgress( subtree, this->_system, stability );
+    }
+
+  this->_populateDb = this->_progress < DBPS_INFO_DONE;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   }  /* End Namespace `flox::resolve' */
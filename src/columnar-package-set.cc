@@ -0,0 +1,298 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include "flox/columnar-package-set.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+  uint32_t
+StringPool::intern( std::string_view s )
+{
+  auto search = this->_ids.find( s );
+  if ( search != this->_ids.end() ) { return search->second; }
+  uint32_t id = this->_strings.size();
+  /* `std::deque' never moves its elements, so keys remain valid. */
+  this->_strings.emplace_back( s );
+  this->_ids.emplace( this->_strings.back(), id );
+  return id;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::vector<std::string>
+ColumnarPackage::getPathStrs() const
+{
+  std::vector<std::string> rsl;
+  rsl.emplace_back( subtreeTypeToString( this->_set->_subtree ) );
+  rsl.emplace_back( this->_set->_system );
+  if ( this->_set->_stability.has_value() )
+    {
+      rsl.emplace_back( this->_set->_stability.value() );
+    }
+  for ( std::string & p : this->_set->getRun( this->_set->_paths
+                                            , this->_set->_pathOffsets
+                                            , this->_id
+                                            )
+      )
+    {
+      rsl.emplace_back( std::move( p ) );
+    }
+  return rsl;
+}
+
+  std::string
+ColumnarPackage::getFullName() const
+{
+  return std::string(
+    this->_set->_pool.get( this->_set->_fullNames[this->_id] )
+  );
+}
+
+  std::string
+ColumnarPackage::getPname() const
+{
+  return std::string( this->_set->_pool.get( this->_set->_pnames[this->_id] ) );
+}
+
+  std::optional<std::string>
+ColumnarPackage::getVersion() const
+{
+  return this->_set->getOptional( this->_set->_versions, this->_id );
+}
+
+  std::optional<std::string>
+ColumnarPackage::getSemver() const
+{
+  return this->_set->getOptional( this->_set->_semvers, this->_id );
+}
+
+  std::optional<std::string>
+ColumnarPackage::getLicense() const
+{
+  return this->_set->getOptional( this->_set->_licenses, this->_id );
+}
+
+  std::vector<std::string>
+ColumnarPackage::getOutputs() const
+{
+  return this->_set->getRun( this->_set->_outputs
+                           , this->_set->_outputsOffsets
+                           , this->_id
+                           );
+}
+
+  std::vector<std::string>
+ColumnarPackage::getOutputsToInstall() const
+{
+  return this->_set->getRun( this->_set->_outputsToInstall
+                           , this->_set->_outputsToInstallOffsets
+                           , this->_id
+                           );
+}
+
+  std::optional<bool>
+ColumnarPackage::isBroken() const
+{
+  if ( ! this->_set->_hasBroken[this->_id] ) { return std::nullopt; }
+  return this->_set->_broken[this->_id];
+}
+
+  std::optional<bool>
+ColumnarPackage::isUnfree() const
+{
+  if ( ! this->_set->_hasUnfree[this->_id] ) { return std::nullopt; }
+  return this->_set->_unfree[this->_id];
+}
+
+  bool
+ColumnarPackage::hasMetaAttr() const
+{
+  return this->_set->_hasMetaAttr[this->_id];
+}
+
+  bool
+ColumnarPackage::hasPnameAttr() const
+{
+  return this->_set->_hasPnameAttr[this->_id];
+}
+
+  bool
+ColumnarPackage::hasVersionAttr() const
+{
+  return this->_set->_hasVersionAttr[this->_id];
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  uint32_t
+ColumnarPackageSet::addPackage( const Package & p )
+{
+  uint32_t id = this->_pnames.size();
+
+  auto internOpt = [&]( const std::optional<std::string> & s )
+  {
+    return s.has_value() ? this->_pool.intern( s.value() ) : StringPool::npos;
+  };
+
+  this->_fullNames.push_back( this->_pool.intern( p.getFullName() ) );
+  this->_pnames.push_back( this->_pool.intern( p.getPname() ) );
+  this->_versions.push_back( internOpt( p.getVersion() ) );
+  this->_semvers.push_back( internOpt( p.getSemver() ) );
+  this->_licenses.push_back( internOpt( p.getLicense() ) );
+
+  std::optional<bool> broken = p.isBroken();
+  this->_hasBroken.push_back( broken.has_value() );
+  this->_broken.push_back( broken.value_or( false ) );
+  std::optional<bool> unfree = p.isUnfree();
+  this->_hasUnfree.push_back( unfree.has_value() );
+  this->_unfree.push_back( unfree.value_or( false ) );
+  this->_hasMetaAttr.push_back( p.hasMetaAttr() );
+  this->_hasPnameAttr.push_back( p.hasPnameAttr() );
+  this->_hasVersionAttr.push_back( p.hasVersionAttr() );
+
+  /* Drop the `<SUBTREE>.<SYSTEM>[.<STABILITY>]' prefix from the path. */
+  this->pushRun( this->_paths
+               , this->_pathOffsets
+               , p.getPathStrs()
+               , this->_stability.has_value() ? 3 : 2
+               );
+  this->pushRun( this->_outputs, this->_outputsOffsets, p.getOutputs() );
+  this->pushRun( this->_outputsToInstall
+               , this->_outputsToInstallOffsets
+               , p.getOutputsToInstall()
+               );
+
+  std::list<std::string_view> relPath;
+  for ( uint32_t i = this->_pathOffsets[id]; i < this->_pathOffsets[id + 1];
+        ++i
+      )
+    {
+      relPath.push_back( this->_pool.get( this->_paths[i] ) );
+    }
+  this->_byPath.emplace( std::move( relPath ), id );
+
+  return id;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<Package>
+ColumnarPackageSet::maybeGetRelPath( const std::list<std::string_view> & path )
+{
+  auto search = this->_byPath.find( path );
+  if ( search == this->_byPath.cend() ) { return nullptr; }
+  return std::make_shared<ColumnarPackage>( this, search->second );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::vector<uint32_t>
+ColumnarPackageSet::filter( const DrvInfoFilter & filter ) const
+{
+  std::vector<uint32_t> rsl;
+
+  /* Resolve strings to ids once up front.
+   * A string which was never interned can't match any package. */
+  uint32_t name    = StringPool::npos;
+  uint32_t version = StringPool::npos;
+  if ( filter.name.has_value() )
+    {
+      name = this->_pool.find( filter.name.value() );
+      if ( name == StringPool::npos ) { return rsl; }
+    }
+  if ( filter.version.has_value() )
+    {
+      version = this->_pool.find( filter.version.value() );
+      if ( version == StringPool::npos ) { return rsl; }
+    }
+  std::vector<uint32_t> licenses;
+  if ( filter.licenses.has_value() )
+    {
+      for ( const std::string & l : filter.licenses.value() )
+        {
+          uint32_t id = this->_pool.find( l );
+          if ( id != StringPool::npos ) { licenses.push_back( id ); }
+        }
+      if ( licenses.empty() ) { return rsl; }
+    }
+
+  for ( uint32_t i = 0; i < this->_pnames.size(); ++i )
+    {
+      if ( filter.name.has_value() &&
+           ( this->_pnames[i] != name ) &&
+           ( this->_fullNames[i] != name ) &&
+           /* Attribute name, being the last element of the path. */
+           ( ( this->_pathOffsets[i] == this->_pathOffsets[i + 1] ) ||
+             ( this->_paths[this->_pathOffsets[i + 1] - 1] != name )
+           )
+         )
+        {
+          continue;
+        }
+      if ( filter.version.has_value() && ( this->_versions[i] != version ) )
+        {
+          continue;
+        }
+      if ( filter.requireMeta && ( ! this->_hasMetaAttr[i] ) ) { continue; }
+      if ( filter.excludeUnfree && this->_unfree[i] )          { continue; }
+      if ( filter.excludeBroken && this->_broken[i] )          { continue; }
+      if ( filter.licenses.has_value() &&
+           ( std::find( licenses.begin(), licenses.end(), this->_licenses[i] )
+             == licenses.end()
+           )
+         )
+        {
+          continue;
+        }
+      rsl.push_back( i );
+    }
+
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::vector<uint32_t>
+ColumnarPackageSet::filter( const DrvInfoFilter       & filter
+                          , const predicates::PkgPred & pred
+                          ) const
+{
+  std::vector<uint32_t> rsl = this->filter( filter );
+  rsl.erase( std::remove_if( rsl.begin(), rsl.end()
+                           , [&]( uint32_t id )
+                             {
+                               return ! pred( ColumnarPackage( this, id ) );
+                             }
+                           )
+           , rsl.end()
+           );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
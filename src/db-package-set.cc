@@ -72,8 +72,36 @@ DbPackageSet::maybeGetRelPath( const std::list<std::string_view> & path )
     {
       return std::make_shared<CachedPackage>( mi.value() );
     }
-  else
+
+  /* Paths may have been scraped before their info, in which case we fill
+   * the missing row now. */
+  std::string subtree( subtreeTypeToString( this->_subtree ) );
+  if ( ( this->_fps == nullptr ) ||
+       ( ! this->_db->hasDrv( subtree, this->_system, p ).value_or( false ) ) ||
+       this->_db->isFailedDrv( subtree, this->_system, p )
+     )
+    {
+      return nullptr;
+    }
+  try
+    {
+      MaybeCursor c = this->_fps->openRelCursor( p );
+      if ( c == nullptr ) { return nullptr; }
+      std::shared_ptr<Package> pkg = std::make_shared<FlakePackage>(
+        (Cursor) c
+      , this->_fps->getSymbolTable()
+      , false
+      );
+      if ( this->_db->isWritable() ) { this->_db->setDrvInfo( * pkg ); }
+      return pkg;
+    }
+  catch( ... )
     {
+      std::optional<std::string> err = getEvalErrorClass();
+      if ( err.has_value() && this->_db->isWritable() )
+        {
+          this->_db->setFailedDrv( subtree, this->_system, p, * err );
+        }
       return nullptr;
     }
 }
@@ -9,6 +9,7 @@
 #include <optional>
 #include <nlohmann/json.hpp>
 #include "resolve.hh"
+#include "flox/drv-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -378,6 +379,18 @@ Descriptor::pred( bool checkPath ) const
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  DrvInfoFilter
+Descriptor::filter() const
+{
+  DrvInfoFilter rsl;
+  rsl.name    = this->name;
+  rsl.version = this->version;
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   void
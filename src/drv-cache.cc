@@ -8,6 +8,7 @@
 #include <nlohmann/json.hpp>
 #include <nix/flake/flake.hh>
 #include <nix/fetchers.hh>
+#include <nix/eval.hh>
 #include <nix/eval-cache.hh>
 #include <nix/sqlite.hh>
 #include <nix/store-api.hh>
@@ -17,6 +18,13 @@
 #include "flox/drv-cache.hh"
 #include "resolve.hh"
 #include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cerrno>
+#include <signal.h>
 
 
 /* -------------------------------------------------------------------------- */
@@ -87,12 +95,16 @@ getDrvDbName( const nix::flake::Fingerprint & fingerprint )
 
 static const char * schema = R"sql(
 CREATE TABLE IF NOT EXISTS Derivations (
-  subtree  TEXT  NOT NULL
-, system   TEXT  NOT NULL
-, path     JSON  NOT NULL
-, PRIMARY  KEY ( subtree, system, path )
+  subtree    TEXT  NOT NULL
+, system     TEXT  NOT NULL
+, path       JSON  NOT NULL
+, stability  TEXT
+, PRIMARY    KEY ( subtree, system, path )
 );
 
+CREATE INDEX IF NOT EXISTS idx_Derivations_stability
+  ON Derivations ( subtree, system, stability );
+
 CREATE VIEW IF NOT EXISTS v_DerivationsAbs AS SELECT
   subtree, system, path AS relPath
 , ( '["'||subtree||'","'||system||'",'||ltrim( path, '[' ) ) AS absPath
@@ -115,15 +127,53 @@ CREATE TABLE IF NOT EXISTS DerivationInfos (
 , hasMetaAttr       BOOL  NOT NULL
 , hasPnameAttr      BOOL  NOT NULL
 , hasVersionAttr    BOOL  NOT NULL
+, attrName          TEXT  NOT NULL
+, stability         TEXT
 
 , PRIMARY  KEY ( subtree, system, path )
 );
 
+CREATE INDEX IF NOT EXISTS idx_DerivationInfos_stability
+  ON DerivationInfos ( subtree, system, stability );
+
+CREATE INDEX IF NOT EXISTS idx_DerivationInfos_pname
+  ON DerivationInfos ( subtree, system, pname );
+CREATE INDEX IF NOT EXISTS idx_DerivationInfos_fullName
+  ON DerivationInfos ( subtree, system, fullName );
+CREATE INDEX IF NOT EXISTS idx_DerivationInfos_attrName
+  ON DerivationInfos ( subtree, system, attrName );
+
 CREATE TABLE IF NOT EXISTS Progress (
-  subtree  TEXT     NOT NULL
-, system   TEXT     NOT NULL
-, status   INTEGER  NOT NULL DEFAULT 0
-, PRIMARY  KEY ( subtree, system )
+  subtree    TEXT     NOT NULL
+, system     TEXT     NOT NULL
+, stability  TEXT     NOT NULL DEFAULT ''
+, status     INTEGER  NOT NULL DEFAULT 0
+, PRIMARY    KEY ( subtree, system, stability )
+);
+
+CREATE TABLE IF NOT EXISTS Subtrees (
+  subtree      TEXT     NOT NULL
+, system       TEXT     NOT NULL
+, path         JSON     NOT NULL
+, stability    TEXT
+, state        INTEGER  NOT NULL DEFAULT 0
+, owner        INTEGER
+, cost         INTEGER
+, skipped      INTEGER  NOT NULL DEFAULT 0
+, resumeAfter  TEXT
+, PRIMARY      KEY ( subtree, system, path )
+);
+
+CREATE INDEX IF NOT EXISTS idx_Subtrees_state
+  ON Subtrees ( subtree, system, stability, state );
+
+CREATE TABLE IF NOT EXISTS FailedDerivations (
+  subtree     TEXT  NOT NULL
+, system      TEXT  NOT NULL
+, path        JSON  NOT NULL
+, stability   TEXT
+, errorClass  TEXT  NOT NULL
+, PRIMARY     KEY ( subtree, system, path )
 );
 
 CREATE TABLE IF NOT EXISTS VersionInfo (
@@ -170,8 +220,8 @@ initStatements( nix::Sync<DrvDb::State>::Lock & state )
 
   state->insertDrv.create(
     state->db
-  , "INSERT OR REPLACE INTO Derivations ( subtree, system, path ) VALUES "
-    "( ?, ?, ? )"
+  , "INSERT OR REPLACE INTO Derivations ( subtree, system, path, stability ) "
+    "VALUES ( ?, ?, ?, ? )"
   );
 
   state->insertDrvInfo.create(
@@ -179,24 +229,133 @@ initStatements( nix::Sync<DrvDb::State>::Lock & state )
   , "INSERT OR REPLACE INTO DerivationInfos ("
     "  subtree, system, path"
     ", fullName, pname, version, semver, license, outputs, outputsToInstall"
-    ", broken, unfree, hasMetaAttr, hasPnameAttr, hasVersionAttr"
-    ") VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )"
+    ", broken, unfree, hasMetaAttr, hasPnameAttr, hasVersionAttr, attrName"
+    ", stability"
+    ") VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )"
   );
 
   state->insertProgress.create(
     state->db
-  , "INSERT OR REPLACE INTO Progress ( subtree, system, status ) VALUES "
-    "( ?, ?, ? )"
+  , "INSERT OR REPLACE INTO Progress ( subtree, system, stability, status ) "
+    "VALUES ( ?, ?, ?, ? )"
   );
 
+  state->insertPrefix.create(
+    state->db
+  , "INSERT OR IGNORE INTO Progress ( subtree, system, stability, status ) "
+    "VALUES ( ?, ?, ?, ? )"
+  );
 
-  /* Queries */
 
-  state->queryVersionInfo.create(
+  /* Subtree tasks */
+
+  state->insertSubtree.create(
+    state->db
+  , "INSERT OR IGNORE INTO Subtrees ( subtree, system, path, stability ) "
+    "VALUES ( ?, ?, ?, ? )"
+  );
+
+  /* The claimed row is returned by the same statement, so we can't read back
+   * a different claim with the same owner. */
+  state->claimSubtree.create(
+    state->db
+  , "UPDATE Subtrees SET state = 1, owner = ? WHERE rowid = ("
+    "  SELECT rowid FROM Subtrees WHERE ( subtree = ? ) AND ( system = ? ) "
+    "  AND ( stability IS ? ) AND ( state = 0 ) "
+    "  ORDER BY ( cost IS NULL ), cost DESC LIMIT 1"
+    ") AND ( state = 0 ) RETURNING path"
+  );
+
+  state->queryClaimOwners.create(
+    state->db
+  , "SELECT DISTINCT owner FROM Subtrees "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( stability IS ? ) "
+    "AND ( state = 1 ) AND ( owner IS NOT NULL )"
+  );
+
+  state->finishSubtree.create(
+    state->db
+  , "UPDATE Subtrees SET state = 2, owner = NULL, cost = ?, skipped = ?, "
+    "resumeAfter = NULL "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( path = ? )"
+  );
+
+  state->resetSubtrees.create(
+    state->db
+  , "UPDATE Subtrees SET state = 0, owner = NULL, skipped = 0, "
+    "resumeAfter = NULL "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( stability IS ? )"
+  );
+
+  state->abandonSubtrees.create(
     state->db
-  , "SELECT version FROM VersionInfo WHERE ( id = ? )"
+  , "UPDATE Subtrees SET state = 3, owner = NULL "
+    "WHERE ( owner = ? ) AND ( state = 1 )"
   );
 
+  state->releaseSubtrees.create(
+    state->db
+  , "UPDATE Subtrees SET state = 0, owner = NULL "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( stability IS ? ) "
+    "AND ( owner = ? ) AND ( state = 1 )"
+  );
+
+  state->resumeSubtrees.create(
+    state->db
+  , "UPDATE Subtrees SET state = 0, owner = NULL "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( stability IS ? ) "
+    "AND ( state IN ( 1, 3 ) )"
+  );
+
+  state->checkpointSubtree.create(
+    state->db
+  , "UPDATE Subtrees SET resumeAfter = ? "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( path = ? )"
+  );
+
+  state->querySubtreeCheckpoint.create(
+    state->db
+  , "SELECT resumeAfter FROM Subtrees "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( path = ? ) "
+    "AND ( resumeAfter IS NOT NULL )"
+  );
+
+  state->countOpenSubtrees.create(
+    state->db
+  , "SELECT COUNT( * ) FROM Subtrees WHERE ( subtree = ? ) AND ( system = ? ) "
+    "AND ( stability IS ? ) AND ( state < 2 )"
+  );
+
+  state->countSkippedSubtrees.create(
+    state->db
+  , "SELECT COALESCE( SUM( skipped ), 0 ) FROM Subtrees "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( stability IS ? )"
+  );
+
+
+  /* Evaluation failures */
+
+  state->insertFailedDrv.create(
+    state->db
+  , "INSERT OR REPLACE INTO FailedDerivations "
+    "( subtree, system, path, stability, errorClass ) VALUES ( ?, ?, ?, ?, ? )"
+  );
+
+  state->queryFailedDrvs.create(
+    state->db
+  , "SELECT path FROM FailedDerivations "
+    "WHERE ( subtree = ? ) AND ( system = ? )"
+  );
+
+  state->countFailedDrvs.create(
+    state->db
+  , "SELECT COUNT( * ) FROM FailedDerivations "
+    "WHERE ( subtree = ? ) AND ( system = ? )"
+  );
+
+
+  /* Queries */
+
 
   state->hasDrv.create(
     state->db
@@ -204,11 +363,25 @@ initStatements( nix::Sync<DrvDb::State>::Lock & state )
     "WHERE ( subtree = ? ) AND ( system = ? ) AND ( path = ? )"
   );
 
+  state->hasDrvInfo.create(
+    state->db
+  , "SELECT COUNT( * ) FROM DerivationInfos "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( path = ? )"
+  );
+
   state->queryDrvs.create(
     state->db
   , "SELECT * FROM Derivations WHERE ( subtree = ? ) AND ( system = ? )"
   );
 
+  state->queryDrvsMissingInfo.create(
+    state->db
+  , "SELECT d.path FROM Derivations d LEFT JOIN DerivationInfos i "
+    "ON ( d.subtree = i.subtree ) AND ( d.system = i.system ) AND "
+    "( d.path = i.path ) "
+    "WHERE ( d.subtree = ? ) AND ( d.system = ? ) AND ( i.path IS NULL )"
+  );
+
   state->countDrvs.create(
     state->db
   , "SELECT COUNT( subtree ) FROM Derivations WHERE"
@@ -218,8 +391,7 @@ initStatements( nix::Sync<DrvDb::State>::Lock & state )
   state->countDrvsStability.create(
     state->db
   , "SELECT COUNT( subtree ) FROM Derivations WHERE"
-    "( subtree = 'catalog' ) AND ( system = ? ) AND "
-    "( json_extract( path, '$[0]' ) = ? )"
+    "( subtree = 'catalog' ) AND ( system = ? ) AND ( stability = ? )"
   );
 
 
@@ -236,8 +408,16 @@ initStatements( nix::Sync<DrvDb::State>::Lock & state )
 
   state->queryDrvInfosStability.create(
     state->db
-    , "SELECT * FROM DerivationInfos WHERE ( subtree = 'catalog' ) AND "
-      "( system = ? ) AND ( json_extract( path, '$[0]' ) = ? )"
+  , "SELECT * FROM DerivationInfos WHERE ( subtree = 'catalog' ) AND "
+    "( system = ? ) AND ( stability = ? )"
+  );
+
+  state->queryAllDrvInfos.create(
+    state->db
+  , "SELECT subtree, system, stability, path, fullName, pname, version, "
+    "semver, license, outputs, outputsToInstall, broken, unfree, "
+    "hasMetaAttr, hasPnameAttr, hasVersionAttr "
+    "FROM DerivationInfos ORDER BY subtree, system, stability"
   );
 
   state->countDrvInfos.create(
@@ -249,27 +429,50 @@ initStatements( nix::Sync<DrvDb::State>::Lock & state )
   state->countDrvInfosStability.create(
     state->db
   , "SELECT COUNT( subtree ) FROM DerivationInfos WHERE"
-    "( subtree = 'catalog' ) AND ( system = ? ) AND "
-    "( json_extract( path, '$[0]' ) = ? )"
+    "( subtree = 'catalog' ) AND ( system = ? ) AND ( stability = ? )"
   );
 
 
   state->queryProgress.create(
     state->db
-  , "SELECT status FROM Progress WHERE ( subtree = ? ) AND ( system = ? )"
+  , "SELECT status FROM Progress "
+    "WHERE ( subtree = ? ) AND ( system = ? ) AND ( stability = ? )"
   );
 
-  state->queryProgresses.create( state->db, "SELECT * FROM Progress" );
+  state->queryProgresses.create(
+    state->db
+  , "SELECT subtree, system, status FROM Progress WHERE ( stability = '' )"
+  );
 
 }
 
 
 /* -------------------------------------------------------------------------- */
 
+/**
+ * Check resolver and schema versions recorded in a database.
+ * The query is prepared and finalized here, before any other statements are
+ * prepared, so that an outdated database may be closed and recreated.
+ */
   static inline void
-auditVersions( nix::Sync<DrvDb::State>::Lock & state )
+auditVersions( sqlite::SQLiteDb & db )
 {
-  auto query1 = state->queryVersionInfo.use()( "resolver" );
+  nix::SQLiteStmt queryVersionInfo;
+  try
+    {
+      queryVersionInfo.create(
+        db
+      , "SELECT version FROM VersionInfo WHERE ( id = ? )"
+      );
+    }
+  catch( const nix::SQLiteError & e )
+    {
+      throw CacheException(
+        "DrvDb(): Failed to read version info from database"
+      );
+    }
+
+  auto query1 = queryVersionInfo.use()( "resolver" );
   if ( ! query1.next() )
     {
       throw CacheException(
@@ -284,7 +487,7 @@ auditVersions( nix::Sync<DrvDb::State>::Lock & state )
       );
     }
 
-  auto query2 = state->queryVersionInfo.use()( "drvCacheSchema" );
+  auto query2 = queryVersionInfo.use()( "drvCacheSchema" );
   if ( ! query2.next() )
     {
       throw CacheException(
@@ -324,7 +527,42 @@ createDb( bool recreate, bool trace, std::string_view path )
 
 /* -------------------------------------------------------------------------- */
 
+/**
+ * A bounded single-producer/single-consumer queue of rows waiting to be
+ * written by a `DrvDb' writer thread.
+ */
+struct DrvDb::WriteQueue {
+  std::vector<Row>        ring;
+  std::size_t             head      = 0;
+  std::size_t             count     = 0;
+  std::size_t             batchSize = FLOX_DRVDB_BATCH_SIZE;
+  uint64_t                pushed    = 0;
+  uint64_t                written   = 0;
+  bool                    stop      = false;
+  /** Set if writing failed, and rethrown by `flush' or `stopWriter'. */
+  std::exception_ptr      error;
+  std::mutex              mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::condition_variable drained;
+  std::thread             writer;
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+DrvDb::DrvDb( const nix::flake::Fingerprint & fingerprint
+            ,       bool                      create
+            ,       bool                      write
+            ,       bool                      trace
+            )
+  : DrvDb( fingerprint, getDrvDbName( fingerprint ), create, write, trace )
+{
+}
+
+
 DrvDb::DrvDb( const nix::flake::Fingerprint & fingerprint
+            , const std::string               & path
             ,       bool                      create
             ,       bool                      write
             ,       bool                      trace
@@ -333,9 +571,6 @@ DrvDb::DrvDb( const nix::flake::Fingerprint & fingerprint
   , _write( write )
   , fingerprint( fingerprint )
 {
-  std::string fpStr = this->fingerprint.to_string( nix::Base16, false );
-  std::string path  = getDrvDbName( this->fingerprint );
-
   auto state( _state->lock() );
 
   /* Boilerplate DB init. */
@@ -348,15 +583,14 @@ DrvDb::DrvDb( const nix::flake::Fingerprint & fingerprint
   , trace
   );
 
-  /* Populate statement templates, and audit existing version and schema info on
-   * the off chance that there's already a DB with this fingerprint. */
-  initStatements( state );
-
-  /* Assert that the database's schema versions are good.
-   * If they arent' recreate a fresh DB if able. */
+  /* Assert that the database's schema versions are good on the off chance
+   * that there's already a DB with this fingerprint.
+   * If they arent' recreate a fresh DB if able.
+   * This must happen before statements are prepared since they may refer to
+   * tables or columns that an outdated DB lacks. */
   try
     {
-      auditVersions( state );
+      auditVersions( state->db );
     }
   catch( const CacheException & e )
     {
@@ -382,13 +616,16 @@ DrvDb::DrvDb( const nix::flake::Fingerprint & fingerprint
           sqlite::SQLiteDb reopen( path, false, write, true, trace );
           state->db.db = reopen.db;
           reopen.db    = nullptr;
-          auditVersions( state );
+          auditVersions( state->db );
         }
       else
         {
           throw e;
         }
     }
+
+  /* Populate statement templates. */
+  initStatements( state );
 }
 
 
@@ -397,6 +634,8 @@ DrvDb::DrvDb( const nix::flake::Fingerprint & fingerprint
   void
 DrvDb::startCommit()
 {
+  /* The writer thread manages its own transactions. */
+  if ( this->hasWriter() ) { return; }
   auto state( this->getDbState() );
   /* Close existing commit if one is open. */
   if ( state->txn != nullptr )
@@ -405,11 +644,13 @@ DrvDb::startCommit()
       state->txn.reset();
     }
   state->txn = std::make_unique<nix::SQLiteTxn>( state->db );
+  this->_batchWrites = 0;
 }
 
   void
 DrvDb::endCommit()
 {
+  if ( this->hasWriter() ) { this->flush(); }
   auto state( this->getDbState() );
   if ( state->txn != nullptr )
     {
@@ -417,6 +658,16 @@ DrvDb::endCommit()
       state->txn.reset();
       assert( state->txn == nullptr );
     }
+  this->_batchWrites = 0;
+}
+
+  void
+DrvDb::commitBatch( std::size_t batchSize )
+{
+  if ( this->hasWriter() ) { return; }
+  ++this->_batchWrites;
+  if ( this->_batchWrites < batchSize ) { return; }
+  this->startCommit();
 }
 
 
@@ -441,6 +692,232 @@ DrvDb::doSQLite( F && fun )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get the catalog stability of a relative attribute path.
+ * Only `catalog' paths have a stability, which is their first element.
+ */
+  static std::optional<std::string>
+stabilityOf( std::string_view subtree, const nlohmann::json & relPath )
+{
+  if ( ( subtree != "catalog" ) || relPath.empty() ) { return std::nullopt; }
+  return relPath[0].get<std::string>();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Insert a row into `Derivations', and `DerivationInfos' if it has info.
+ * Failures are only written to `FailedDerivations', and checkpoints update
+ * their `Subtrees' task.
+ */
+  static void
+insertRow( nix::Sync<DrvDb::State>::Lock & state, const DrvDb::Row & row )
+{
+  if ( row.resumeAfter.has_value() )
+    {
+      state->checkpointSubtree.use()
+        ( row.resumeAfter.value() )
+        ( row.subtree )
+        ( row.system )
+        ( row.path )
+        .exec();
+      return;
+    }
+
+  if ( row.errorClass.has_value() )
+    {
+      state->insertFailedDrv.use()
+        ( row.subtree )
+        ( row.system )
+        ( row.path )
+        ( row.stability.value_or( "" ), row.stability.has_value() )
+        ( row.errorClass.value() )
+        .exec();
+      return;
+    }
+
+  state->insertDrv.use()
+    ( row.subtree )
+    ( row.system )
+    ( row.path )
+    ( row.stability.value_or( "" ), row.stability.has_value() )
+    .exec();
+  assert( state->db.getLastInsertedRowId() != 0 );
+
+  if ( ! row.hasInfo ) { return; }
+
+  state->insertDrvInfo.use()
+    ( row.subtree )
+    ( row.system )
+    ( row.path )
+    ( row.fullName )
+    ( row.pname )
+    ( row.version.value_or( "" ), row.version.has_value() )
+    ( row.semver.value_or( "" ), row.semver.has_value() )
+    ( row.license.value_or( "" ), row.license.has_value() )
+    ( row.outputs )
+    ( row.outputsToInstall )
+    ( row.broken.value_or( false ), row.broken.has_value() )
+    ( row.unfree.value_or( false ), row.unfree.has_value() )
+    ( row.hasMetaAttr )
+    ( row.hasPnameAttr )
+    ( row.hasVersionAttr )
+    ( row.attrName )
+    ( row.stability.value_or( "" ), row.stability.has_value() )
+    .exec();
+  assert( state->db.getLastInsertedRowId() != 0 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Write a row immediately, or hand it off to the writer thread. */
+  void
+DrvDb::writeRow( Row && row )
+{
+  if ( ! this->hasWriter() )
+    {
+      this->doSQLite( [&]() {
+        auto state( this->getDbState() );
+        insertRow( state, row );
+        return 1;
+      } );
+      return;
+    }
+
+  WriteQueue & q = * this->_queue;
+  std::unique_lock<std::mutex> lock( q.mutex );
+  q.notFull.wait( lock, [&]() { return q.count < q.ring.size(); } );
+  q.ring[( q.head + q.count ) % q.ring.size()] = std::move( row );
+  ++q.count;
+  ++q.pushed;
+  lock.unlock();
+  q.notEmpty.notify_one();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+DrvDb::~DrvDb()
+{
+  /* Errors from the writer can't be thrown from here, so they're reported. */
+  try { this->stopWriter(); } catch( ... ) { nix::ignoreException(); }
+  try { this->endCommit();  } catch( ... ) {}
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::startWriter( std::size_t capacity, std::size_t batchSize )
+{
+  requireWritable( * this, "startWriter" );
+  if ( this->hasWriter() ) { return; }
+  /* The writer can't open transactions while ours is open. */
+  this->endCommit();
+  this->_queue = std::make_unique<WriteQueue>();
+  this->_queue->ring.resize( std::max( capacity, (std::size_t) 1 ) );
+  this->_queue->batchSize = std::max( batchSize, (std::size_t) 1 );
+  this->_queue->writer    = std::thread( [this]() { this->writerLoop(); } );
+}
+
+
+  void
+DrvDb::flush()
+{
+  if ( ! this->hasWriter() ) { return; }
+  WriteQueue & q = * this->_queue;
+  std::unique_lock<std::mutex> lock( q.mutex );
+  q.drained.wait( lock, [&]() { return q.written == q.pushed; } );
+  if ( q.error != nullptr )
+    {
+      std::exception_ptr error = nullptr;
+      std::swap( error, q.error );
+      std::rethrow_exception( error );
+    }
+}
+
+
+  void
+DrvDb::stopWriter()
+{
+  if ( ! this->hasWriter() ) { return; }
+  WriteQueue & q = * this->_queue;
+  {
+    std::lock_guard<std::mutex> lock( q.mutex );
+    q.stop = true;
+  }
+  q.notEmpty.notify_one();
+  q.writer.join();
+  std::exception_ptr error = q.error;
+  this->_queue.reset();
+  if ( error != nullptr ) { std::rethrow_exception( error ); }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Drain the queue into the database until `stopWriter' is called. */
+  void
+DrvDb::writerLoop()
+{
+  WriteQueue       & q = * this->_queue;
+  std::vector<Row>   batch;
+  batch.reserve( q.batchSize );
+  while ( true )
+    {
+      {
+        std::unique_lock<std::mutex> lock( q.mutex );
+        q.notEmpty.wait( lock, [&]() { return ( 0 < q.count ) || q.stop; } );
+        /* We only exit once the queue is empty. */
+        if ( q.count == 0 ) { return; }
+        while ( ( 0 < q.count ) && ( batch.size() < q.batchSize ) )
+          {
+            batch.push_back( std::move( q.ring[q.head] ) );
+            q.head = ( q.head + 1 ) % q.ring.size();
+            --q.count;
+          }
+      }
+      q.notFull.notify_one();
+
+      /* Rows are dropped if we've failed, but still count as "written" so
+       * that `flush' doesn't block forever.
+       * Anything other than a SQLite error would terminate the process if it
+       * escaped this thread, so it is handed to the producer instead. */
+      std::exception_ptr error = nullptr;
+      try
+        {
+          this->doSQLite( [&]() {
+            auto state( this->getDbState() );
+            nix::SQLiteTxn txn( state->db );
+            for ( const Row & row : batch ) { insertRow( state, row ); }
+            txn.commit();
+            return (uint64_t) batch.size();
+          } );
+        }
+      catch( ... )
+        {
+          error        = std::current_exception();
+          this->failed = true;
+        }
+
+      {
+        std::lock_guard<std::mutex> lock( q.mutex );
+        q.written += batch.size();
+        if ( ( error != nullptr ) && ( q.error == nullptr ) )
+          {
+            q.error = error;
+          }
+      }
+      q.drained.notify_all();
+      batch.clear();
+    }
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /* Records that a derivation exists at an attrpath.
@@ -453,14 +930,12 @@ DrvDb::setDrv(       std::string_view           subtree
 {
   requireWritable( * this, "setDrv" );
   nlohmann::json relPath = path;
-  this->doSQLite( [&]()
-  {
-    auto state( this->getDbState() );
-    state->insertDrv.use()( subtree )( system )( relPath.dump() ).exec();
-    uint64_t rowId = state->db.getLastInsertedRowId();
-    assert( rowId != 0 );
-    return rowId;
-  } );
+  Row            row;
+  row.subtree   = subtree;
+  row.system    = system;
+  row.path      = relPath.dump();
+  row.stability = stabilityOf( subtree, relPath );
+  this->writeRow( std::move( row ) );
 }
 
 
@@ -479,13 +954,12 @@ DrvDb::setDrv( const Package & p )
     {
       relPath.push_back( path[i] );
     }
-  doSQLite( [&]() {
-    auto state( this->getDbState() );
-    state->insertDrv.use()( path[0] )( path[1] )( relPath.dump() ).exec();
-    uint64_t rowId = state->db.getLastInsertedRowId();
-    assert( rowId != 0 );
-    return rowId;
-  } );
+  Row row;
+  row.subtree   = path[0];
+  row.system    = path[1];
+  row.path      = relPath.dump();
+  row.stability = stabilityOf( path[0], relPath );
+  this->writeRow( std::move( row ) );
 }
 
 
@@ -500,9 +974,10 @@ DrvDb::hasDrv(       std::string_view           subtree
              , const std::vector<std::string> & path
              )
 {
-  progress_status s = this->getProgress( subtree, system );
+  nlohmann::json             relPath   = path;
+  std::optional<std::string> stability = stabilityOf( subtree, relPath );
+  progress_status s = this->getProgress( subtree, system, stability );
   if ( s < DBPS_PARTIAL ) { return std::nullopt; }
-  nlohmann::json relPath  = path;
   std::optional<bool> rsl = std::nullopt;
   this->doSQLite( [&]() {
     auto state( this->getDbState() );
@@ -517,6 +992,27 @@ DrvDb::hasDrv(       std::string_view           subtree
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  bool
+DrvDb::hasDrvInfo(       std::string_view           subtree
+                 ,       std::string_view           system
+                 , const std::vector<std::string> & path
+                 )
+{
+  nlohmann::json relPath = path;
+  bool           rsl     = false;
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    nix::SQLiteStmt::Use query =
+      state->hasDrvInfo.use()( subtree )( system )( relPath.dump() );
+    rsl = query.next() && ( query.getInt( 0 ) != 0 );
+    return 0;
+  } );
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /* Dump all paths to derivations.
@@ -542,6 +1038,27 @@ DrvDb::getDrvPaths( std::string_view subtree, std::string_view system )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  std::list<std::vector<std::string>>
+DrvDb::getDrvPathsMissingInfo( std::string_view subtree
+                             , std::string_view system
+                             )
+{
+  std::list<std::vector<std::string>> rsl;
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    auto query = state->queryDrvsMissingInfo.use()( subtree )( system );
+    while ( query.next() )
+      {
+        rsl.push_back( nlohmann::json::parse( query.getStr( 0 ) ) );
+      }
+    return 0;
+  } );
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   void
@@ -555,36 +1072,26 @@ DrvDb::setDrvInfo( const Package & p )
       relPath.push_back( path[i] );
     }
 
-  nlohmann::json outputs          = p.getOutputs();
-  nlohmann::json outputsToInstall = p.getOutputsToInstall();
-
-  this->doSQLite( [&]() {
-    auto state( this->getDbState() );
-    state->insertDrv.use()( path[0] )( path[1] )( relPath.dump() ).exec();
-    uint64_t rowId = state->db.getLastInsertedRowId();
-    assert( rowId != 0 );
-
-    state->insertDrvInfo.use()
-      ( path[0] )
-      ( path[1] )
-      ( relPath.dump() )
-      ( p.getFullName() )
-      ( p.getPname() )
-      ( p.getVersion().value_or( "" ), p.getVersion().has_value() )
-      ( p.getSemver().value_or( "" ), p.getSemver().has_value() )
-      ( p.getLicense().value_or( "" ), p.getLicense().has_value() )
-      ( outputs.dump())(outputsToInstall.dump() )
-      ( p.isBroken().value_or( false ), p.isBroken().has_value() )
-      ( p.isUnfree().value_or( false ), p.isUnfree().has_value() )
-      ( p.hasMetaAttr() )
-      ( p.hasPnameAttr() )
-      ( p.hasVersionAttr() )
-      .exec();
-    rowId = state->db.getLastInsertedRowId();
-    assert( rowId != 0 );
-
-    return rowId;
-  } );
+  Row row;
+  row.subtree          = path[0];
+  row.system           = path[1];
+  row.path             = relPath.dump();
+  row.stability        = stabilityOf( path[0], relPath );
+  row.hasInfo          = true;
+  row.fullName         = p.getFullName();
+  row.pname            = p.getPname();
+  row.version          = p.getVersion();
+  row.semver           = p.getSemver();
+  row.license          = p.getLicense();
+  row.outputs          = nlohmann::json( p.getOutputs() ).dump();
+  row.outputsToInstall = nlohmann::json( p.getOutputsToInstall() ).dump();
+  row.broken           = p.isBroken();
+  row.unfree           = p.isUnfree();
+  row.hasMetaAttr      = p.hasMetaAttr();
+  row.hasPnameAttr     = p.hasPnameAttr();
+  row.hasVersionAttr   = p.hasVersionAttr();
+  row.attrName         = p.getPkgAttrName();
+  this->writeRow( std::move( row ) );
 }
 
 
@@ -705,44 +1212,252 @@ DrvDb::getDrvInfos( std::string_view subtree, std::string_view system )
 
 /* -------------------------------------------------------------------------- */
 
-  nix::SQLiteStmt::Use
-DrvDb::useDrvInfosStability( std::string_view system
-                           , std::string_view stability
-                           )
+  bool
+DrvInfoFilter::empty() const
 {
-  auto state( this->getDbState() );
-  return state->queryDrvInfosStability.use()( system )( stability );
+  return ( ! this->name.has_value() ) && ( ! this->version.has_value() ) &&
+         ( ! this->requireMeta ) && ( ! this->excludeUnfree ) &&
+         ( ! this->excludeBroken ) && ( ! this->licenses.has_value() );
 }
 
 
-/* -------------------------------------------------------------------------- */
-
-  std::list<nlohmann::json>
-DrvDb::getDrvInfosStability( std::string_view system
-                           , std::string_view stability
-                           )
+  DrvInfoFilter
+DrvInfoFilter::operator&&( const DrvInfoFilter & other ) const
 {
-  std::list<nlohmann::json> rsl;
-  this->doSQLite( [&]() {
-    auto state( this->getDbState() );
-    auto query = state->queryDrvInfosStability.use()( system )( stability );
-    while ( query.next() ) { rsl.push_back( infoFromQuery( query ) ); }
-    return 0;
-  } );
+  DrvInfoFilter rsl = * this;
+  if ( ! rsl.name.has_value() )    { rsl.name    = other.name;    }
+  if ( ! rsl.version.has_value() ) { rsl.version = other.version; }
+  rsl.requireMeta   |= other.requireMeta;
+  rsl.excludeUnfree |= other.excludeUnfree;
+  rsl.excludeBroken |= other.excludeBroken;
+  if ( ! rsl.licenses.has_value() )
+    {
+      rsl.licenses = other.licenses;
+    }
+  else if ( other.licenses.has_value() )
+    {
+      std::vector<std::string> both;
+      for ( const std::string & l : rsl.licenses.value() )
+        {
+          if ( std::find( other.licenses.value().begin()
+                        , other.licenses.value().end()
+                        , l
+                        ) != other.licenses.value().end()
+             )
+            {
+              both.push_back( l );
+            }
+        }
+      rsl.licenses = std::move( both );
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Build a query for `DerivationInfos' rows matching @a filter.
+ * Parameters are bound in order by @a bindFilter.
+ */
+  static std::string
+filterToSQL( const DrvInfoFilter & filter )
+{
+  std::string sql =
+    "SELECT * FROM DerivationInfos WHERE ( subtree = ? ) AND ( system = ? )";
+  if ( filter.name.has_value() )
+    {
+      sql += " AND ( ( attrName = ? ) OR ( pname = ? ) OR ( fullName = ? ) )";
+    }
+  if ( filter.version.has_value() ) { sql += " AND ( version = ? )";       }
+  if ( filter.requireMeta )         { sql += " AND ( hasMetaAttr = 1 )";   }
+  if ( filter.excludeUnfree )       { sql += " AND ( unfree IS NOT 1 )";   }
+  if ( filter.excludeBroken )       { sql += " AND ( broken IS NOT 1 )";   }
+  if ( filter.licenses.has_value() )
+    {
+      sql += " AND ( license IN ( ";
+      for ( size_t i = 0; i < filter.licenses.value().size(); ++i )
+        {
+          sql += ( i == 0 ) ? "?" : ", ?";
+        }
+      /* An empty list of licenses must reject every row. */
+      if ( filter.licenses.value().empty() ) { sql += "NULL"; }
+      sql += " ) )";
+    }
+  return sql;
+}
+
+
+  static void
+bindFilter( nix::SQLiteStmt::Use & query, const DrvInfoFilter & filter )
+{
+  if ( filter.name.has_value() )
+    {
+      query( filter.name.value() )
+           ( filter.name.value() )
+           ( filter.name.value() );
+    }
+  if ( filter.version.has_value() ) { query( filter.version.value() ); }
+  if ( filter.licenses.has_value() )
+    {
+      for ( const std::string & l : filter.licenses.value() ) { query( l ); }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::list<nlohmann::json>
+DrvDb::getDrvInfos(       std::string_view   subtree
+                  ,       std::string_view   system
+                  , const DrvInfoFilter    & filter
+                  )
+{
+  if ( filter.empty() ) { return this->getDrvInfos( subtree, system ); }
+  std::list<nlohmann::json> rsl;
+  std::string sql = filterToSQL( filter );
+  this->doSQLite( [&]() {
+    auto state = this->getDbState();
+    auto stmt  = state->queryDrvInfosFiltered.find( sql );
+    if ( stmt == state->queryDrvInfosFiltered.end() )
+      {
+        std::unique_ptr<nix::SQLiteStmt> s =
+          std::make_unique<nix::SQLiteStmt>();
+        s->create( state->db, sql );
+        stmt = state->queryDrvInfosFiltered.emplace( sql, std::move( s ) ).first;
+      }
+    auto query = stmt->second->use()( subtree )( system );
+    bindFilter( query, filter );
+    while ( query.next() ) { rsl.push_back( infoFromQuery( query ) ); }
+    return 0;
+  } );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  nix::SQLiteStmt::Use
+DrvDb::useDrvInfosRanked(       std::string_view                  subtree
+                        ,       std::string_view                  system
+                        ,       std::optional<std::string_view>   stability
+                        , const DrvInfoFilter                   & filter
+                        )
+{
+  std::string sql = filterToSQL( filter ) +
+    " AND ( stability IS ? )"
+    " ORDER BY json_array_length( path ), attrName, path";
+  auto state = this->getDbState();
+  auto stmt  = state->queryDrvInfosFiltered.find( sql );
+  if ( stmt == state->queryDrvInfosFiltered.end() )
+    {
+      std::unique_ptr<nix::SQLiteStmt> s = std::make_unique<nix::SQLiteStmt>();
+      s->create( state->db, sql );
+      stmt = state->queryDrvInfosFiltered.emplace( sql, std::move( s ) ).first;
+    }
+  auto query = stmt->second->use()( subtree )( system );
+  bindFilter( query, filter );
+  query( stability.value_or( "" ), stability.has_value() );
+  return query;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  nix::SQLiteStmt::Use
+DrvDb::useDrvInfosStability( std::string_view system
+                           , std::string_view stability
+                           )
+{
+  auto state( this->getDbState() );
+  return state->queryDrvInfosStability.use()( system )( stability );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  nix::SQLiteStmt::Use
+DrvDb::useAllDrvInfos()
+{
+  auto state( this->getDbState() );
+  return state->queryAllDrvInfos.use();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::list<nlohmann::json>
+DrvDb::getDrvInfosStability( std::string_view system
+                           , std::string_view stability
+                           )
+{
+  std::list<nlohmann::json> rsl;
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    auto query = state->queryDrvInfosStability.use()( system )( stability );
+    while ( query.next() ) { rsl.push_back( infoFromQuery( query ) ); }
+    return 0;
+  } );
   return rsl;
 }
 
 
 /* -------------------------------------------------------------------------- */
 
+/**
+ * Get the status recorded for exactly @a stability, where `""' stands for the
+ * whole subtree/system collection.
+ * @return `std::nullopt' if no status is recorded.
+ */
+  static std::optional<progress_status>
+maybeQueryProgress( nix::Sync<DrvDb::State>::Lock & state
+                  , std::string_view                subtree
+                  , std::string_view                system
+                  , std::string_view                stability
+                  )
+{
+  auto query = state->queryProgress.use()( subtree )( system )( stability );
+  if ( ! query.next() ) { return std::nullopt; }
+  return (progress_status) query.getInt( 0 );
+}
+
+
+  static progress_status
+queryProgress( nix::Sync<DrvDb::State>::Lock & state
+             , std::string_view                subtree
+             , std::string_view                system
+             , std::string_view                stability
+             )
+{
+  return maybeQueryProgress( state, subtree, system, stability )
+           .value_or( DBPS_NONE );
+}
+
+
   progress_status
 DrvDb::getProgress( std::string_view subtree, std::string_view system )
+{
+  return this->getProgress( subtree, system, std::nullopt );
+}
+
+
+  progress_status
+DrvDb::getProgress(       std::string_view                  subtree
+                  ,       std::string_view                  system
+                  , const std::optional<std::string_view> & stability
+                  )
 {
   return (progress_status) this->doSQLite( [&]() {
     auto state( this->getDbState() );
-    auto query = state->queryProgress.use()( subtree )( system );
-    if ( ! query.next() ) { return (uint64_t) DBPS_NONE; }
-    return (uint64_t) query.getInt( 0 );
+    progress_status s = queryProgress( state, subtree, system, "" );
+    if ( stability.has_value() )
+      {
+        s = std::max( s, queryProgress( state, subtree, system
+                                       , stability.value()
+                                       )
+                    );
+      }
+    return (uint64_t) s;
   } );
 }
 
@@ -754,15 +1469,32 @@ DrvDb::setProgress( std::string_view subtree
                   , std::string_view system
                   , progress_status  status
                   )
+{
+  return this->setProgress( subtree, system, std::nullopt, status );
+}
+
+
+  progress_status
+DrvDb::setProgress(       std::string_view                  subtree
+                  ,       std::string_view                  system
+                  , const std::optional<std::string_view> & stability
+                  ,       progress_status                   status
+                  )
 {
   if ( status == DBPS_FORCE ) { return DBPS_FORCE; }
   requireWritable( * this, "setProgress" );
+  /* Make sure queued rows land before their progress is recorded. */
+  this->flush();
   progress_status old = DBPS_NONE;
   this->doSQLite( [&]() {
     auto state( this->getDbState() );
-    auto query = state->queryProgress.use()( subtree )( system );
-    if ( query.next() ) { old = (progress_status) query.getInt( 0 ); }
-    state->insertProgress.use()( subtree )( system )( (int) status ).exec();
+    old = queryProgress( state, subtree, system, stability.value_or( "" ) );
+    state->insertProgress.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ) )
+      ( (int) status )
+      .exec();
     uint64_t rowId = state->db.getLastInsertedRowId();
     assert( rowId != 0 );
     return rowId;
@@ -778,16 +1510,33 @@ DrvDb::promoteProgress( std::string_view subtree
                       , std::string_view system
                       , progress_status  status
                       )
+{
+  return this->promoteProgress( subtree, system, std::nullopt, status );
+}
+
+
+  progress_status
+DrvDb::promoteProgress(       std::string_view                  subtree
+                      ,       std::string_view                  system
+                      , const std::optional<std::string_view> & stability
+                      ,       progress_status                   status
+                      )
 {
   if ( status == DBPS_FORCE ) { return DBPS_FORCE; }
   requireWritable( * this, "setProgress" );
+  /* Make sure queued rows land before their progress is recorded. */
+  this->flush();
   progress_status old = DBPS_NONE;
   this->doSQLite( [&]() {
     auto state( this->getDbState() );
-    auto query = state->queryProgress.use()( subtree )( system );
-    if ( query.next() ) { old = (progress_status) query.getInt( 0 ); }
+    old = queryProgress( state, subtree, system, stability.value_or( "" ) );
     if ( status <= old ) { return (uint64_t) 0; }
-    state->insertProgress.use()( subtree )( system )( (int) status ).exec();
+    state->insertProgress.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ) )
+      ( (int) status )
+      .exec();
     uint64_t rowId = state->db.getLastInsertedRowId();
     assert( rowId != 0 );
     return rowId;
@@ -796,6 +1545,60 @@ DrvDb::promoteProgress( std::string_view subtree
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::recordPrefix(       std::string_view                  subtree
+                   ,       std::string_view                  system
+                   , const std::optional<std::string_view> & stability
+                   ,       bool                              exists
+                   )
+{
+  if ( ! exists )
+    {
+      this->promoteProgress( subtree, system, stability, DBPS_MISSING );
+      return;
+    }
+  requireWritable( * this, "recordPrefix" );
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    state->insertPrefix.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ) )
+      ( (int) DBPS_NONE )
+      .exec();
+    return 0;
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::optional<bool>
+DrvDb::hasPrefix(       std::string_view                  subtree
+                ,       std::string_view                  system
+                , const std::optional<std::string_view> & stability
+                )
+{
+  std::optional<bool> rsl;
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    std::optional<progress_status> s =
+      maybeQueryProgress( state, subtree, system, stability.value_or( "" ) );
+    if ( stability.has_value() &&
+         ( maybeQueryProgress( state, subtree, system, "" ) == DBPS_MISSING )
+       )
+      {
+        s = DBPS_MISSING;
+      }
+    if ( s.has_value() ) { rsl = s.value() != DBPS_MISSING; }
+    return 0;
+  } );
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::unordered_map<std::string
@@ -838,6 +1641,367 @@ DrvDb::getProgresses()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::pushSubtree(       std::string_view           subtree
+                  ,       std::string_view           system
+                  , const std::vector<std::string> & path
+                  )
+{
+  requireWritable( * this, "pushSubtree" );
+  nlohmann::json             relPath   = path;
+  std::optional<std::string> stability = stabilityOf( subtree, relPath );
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    state->insertSubtree.use()
+      ( subtree )
+      ( system )
+      ( relPath.dump() )
+      ( stability.value_or( "" ), stability.has_value() )
+      .exec();
+    return 1;
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Unlike most writes, claims are not wrapped by `doSQLite'.
+ * A worker which fails to claim a task must not mistake it for the end of
+ * the queue, so errors are left to the caller. */
+  std::optional<std::vector<std::string>>
+DrvDb::claimSubtree(       std::string_view                  subtree
+                   ,       std::string_view                  system
+                   , const std::optional<std::string_view> & stability
+                   ,       int64_t                           owner
+                   )
+{
+  requireWritable( * this, "claimSubtree" );
+  auto state( this->getDbState() );
+  std::string path;
+  {
+    auto query = state->claimSubtree.use()
+      ( owner )
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ), stability.has_value() );
+    if ( ! query.next() ) { return std::nullopt; }
+    path = query.getStr( 0 );
+    /* Step to `SQLITE_DONE' so that the update is completed. */
+    while ( query.next() ) {}
+  }
+  return nlohmann::json::parse( path ).get<std::vector<std::string>>();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::finishSubtree(       std::string_view           subtree
+                    ,       std::string_view           system
+                    , const std::vector<std::string> & path
+                    ,       uint64_t                   cost
+                    ,       uint64_t                   skipped
+                    )
+{
+  requireWritable( * this, "finishSubtree" );
+  nlohmann::json relPath = path;
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    state->finishSubtree.use()
+      ( (int64_t) cost )
+      ( (int64_t) skipped )
+      ( subtree )
+      ( system )
+      ( relPath.dump() )
+      .exec();
+    return 1;
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::resetSubtrees(       std::string_view                  subtree
+                    ,       std::string_view                  system
+                    , const std::optional<std::string_view> & stability
+                    )
+{
+  requireWritable( * this, "resetSubtrees" );
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    state->resetSubtrees.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ), stability.has_value() )
+      .exec();
+    return 1;
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::abandonSubtrees( int64_t owner )
+{
+  requireWritable( * this, "abandonSubtrees" );
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    state->abandonSubtrees.use()( owner ).exec();
+    return 1;
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+DrvDb::releaseStaleSubtrees(
+        std::string_view                  subtree
+,       std::string_view                  system
+, const std::optional<std::string_view> & stability
+,       int64_t                           self
+)
+{
+  requireWritable( * this, "releaseStaleSubtrees" );
+  std::vector<int64_t> stale;
+  {
+    auto state( this->getDbState() );
+    auto query = state->queryClaimOwners.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ), stability.has_value() );
+    while ( query.next() )
+      {
+        int64_t owner = query.getInt( 0 );
+        /* A caller which is waiting isn't working on any of its claims, and
+         * `kill' with signal `0' only checks that a process exists. */
+        if ( ( owner == self ) || ( owner <= 0 ) ||
+             ( ( kill( (pid_t) owner, 0 ) != 0 ) && ( errno == ESRCH ) )
+           )
+          {
+            stale.push_back( owner );
+          }
+      }
+  }
+  if ( stale.empty() ) { return 0; }
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    for ( int64_t owner : stale )
+      {
+        state->releaseSubtrees.use()
+          ( subtree )
+          ( system )
+          ( stability.value_or( "" ), stability.has_value() )
+          ( owner )
+          .exec();
+      }
+    return 1;
+  } );
+  return stale.size();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+DrvDb::resumeSubtrees(       std::string_view                  subtree
+                     ,       std::string_view                  system
+                     , const std::optional<std::string_view> & stability
+                     )
+{
+  requireWritable( * this, "resumeSubtrees" );
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    state->resumeSubtrees.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ), stability.has_value() )
+      .exec();
+    return 1;
+  } );
+  return this->countOpenSubtrees( subtree, system, stability );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Checkpoints are queued like rows so that they are never committed before
+ * the rows they cover. */
+  void
+DrvDb::checkpointSubtree(       std::string_view           subtree
+                        ,       std::string_view           system
+                        , const std::vector<std::string> & path
+                        ,       std::string_view           resumeAfter
+                        )
+{
+  requireWritable( * this, "checkpointSubtree" );
+  Row row;
+  row.subtree     = subtree;
+  row.system      = system;
+  row.path        = nlohmann::json( path ).dump();
+  row.resumeAfter = resumeAfter;
+  this->writeRow( std::move( row ) );
+}
+
+
+  std::optional<std::string>
+DrvDb::getSubtreeCheckpoint(       std::string_view           subtree
+                           ,       std::string_view           system
+                           , const std::vector<std::string> & path
+                           )
+{
+  std::optional<std::string> rsl;
+  this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    auto query = state->querySubtreeCheckpoint.use()
+      ( subtree )
+      ( system )
+      ( nlohmann::json( path ).dump() );
+    if ( query.next() ) { rsl = query.getStr( 0 ); }
+    return 0;
+  } );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+DrvDb::countOpenSubtrees(       std::string_view                  subtree
+                        ,       std::string_view                  system
+                        , const std::optional<std::string_view> & stability
+                        )
+{
+  auto state( this->getDbState() );
+  auto query = state->countOpenSubtrees.use()
+    ( subtree )
+    ( system )
+    ( stability.value_or( "" ), stability.has_value() );
+  if ( ! query.next() ) { return 0; }
+  return query.getInt( 0 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+DrvDb::countSkippedSubtrees(
+        std::string_view                  subtree
+,       std::string_view                  system
+, const std::optional<std::string_view> & stability
+)
+{
+  return this->doSQLite( [&]() {
+    auto state( this->getDbState() );
+    auto query = state->countSkippedSubtrees.use()
+      ( subtree )
+      ( system )
+      ( stability.value_or( "" ), stability.has_value() );
+    if ( ! query.next() ) { return (uint64_t) 0; }
+    return (uint64_t) query.getInt( 0 );
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+DrvDb::setFailedDrv(       std::string_view           subtree
+                   ,       std::string_view           system
+                   , const std::vector<std::string> & path
+                   ,       std::string_view           errorClass
+                   )
+{
+  requireWritable( * this, "setFailedDrv" );
+  nlohmann::json relPath = path;
+  Row            row;
+  row.subtree    = subtree;
+  row.system     = system;
+  row.path       = relPath.dump();
+  row.stability  = stabilityOf( subtree, relPath );
+  row.errorClass = errorClass;
+  this->writeRow( std::move( row ) );
+
+  auto loaded = this->_failed.find(
+    { std::string( subtree ), std::string( system ) }
+  );
+  if ( loaded != this->_failed.end() ) { loaded->second.insert( path ); }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+DrvDb::isFailedDrv(       std::string_view           subtree
+                  ,       std::string_view           system
+                  , const std::vector<std::string> & path
+                  )
+{
+  std::pair<std::string, std::string> key( subtree, system );
+  auto loaded = this->_failed.find( key );
+  if ( loaded == this->_failed.end() )
+    {
+      std::set<std::vector<std::string>> paths;
+      this->doSQLite( [&]() {
+        auto state( this->getDbState() );
+        auto query = state->queryFailedDrvs.use()( subtree )( system );
+        while ( query.next() )
+          {
+            paths.insert(
+              nlohmann::json::parse( query.getStr( 0 ) )
+                .get<std::vector<std::string>>()
+            );
+          }
+        return 0;
+      } );
+      loaded = this->_failed.emplace( std::move( key ), std::move( paths ) )
+                 .first;
+    }
+  return loaded->second.find( path ) != loaded->second.end();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+DrvDb::countFailedDrvs( std::string_view subtree, std::string_view system )
+{
+  return this->doSQLite( [&]() {
+    auto state = this->getDbState();
+    auto query = state->countFailedDrvs.use()( subtree )( system );
+    if ( ! query.next() )
+      {
+        throw CacheException( "Failed to query table FailedDerivations." );
+      }
+    return query.getInt( 0 );
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::optional<std::string>
+getEvalErrorClass()
+{
+  try
+    {
+      throw;
+    }
+  catch( const nix::ThrownError & )    { return "throw";      }
+  catch( const nix::AssertionError & ) { return "assert";     }
+  catch( const nix::Abort & )          { return "abort";      }
+  catch( const nix::TypeError & )      { return "type";       }
+  catch( const nix::EvalError & )      { return "eval";       }
+  /* Other errors, such as those from our caches, the store, or fetching,
+   * may not recur. */
+  catch( ... )                         { return std::nullopt; }
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::size_t
@@ -31,13 +31,15 @@ namespace flox {
 
 /* -------------------------------------------------------------------------- */
 
-FloxFlake::FloxFlake(       nix::ref<nix::EvalState>   state
-                    ,       std::string_view           id
-                    , const FloxFlakeRef             & ref
-                    , const Preferences              & prefs
-                    , const std::list<std::string>   & systems
+FloxFlake::FloxFlake(       EvalStateGetter              getState
+                    ,       std::string_view             id
+                    , const FloxFlakeRef               & ref
+                    , const Preferences                & prefs
+                    , const std::list<std::string>     & systems
+                    ,       std::shared_ptr<LockCache>   lockCache
                     )
-  : _state( state )
+  : _getState( std::move( getState ) )
+  , _lockCache( std::move( lockCache ) )
   , _flakeRef( nix::FlakeRef::fromAttrs( ref.toAttrs() ) )
   , _systems( systems )
   , _prefsPrefixes(
@@ -54,6 +56,17 @@ FloxFlake::FloxFlake(       nix::ref<nix::EvalState>   state
 }
 
 
+FloxFlake::FloxFlake(       nix::ref<nix::EvalState>   state
+                    ,       std::string_view           id
+                    , const FloxFlakeRef             & ref
+                    , const Preferences              & prefs
+                    , const std::list<std::string>   & systems
+                    )
+  : FloxFlake( [state]() { return state; }, id, ref, prefs, systems )
+{
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::shared_ptr<nix::flake::LockedFlake>
@@ -61,20 +74,42 @@ FloxFlake::getLockedFlake()
 {
   if ( this->lockedFlake == nullptr )
     {
-      bool oldPurity = nix::evalSettings.pureEval;
-      nix::evalSettings.pureEval = false;
-      this->lockedFlake = std::make_shared<nix::flake::LockedFlake>(
-        nix::flake::lockFlake( * this->_state
-                             , this->_flakeRef
-                             , floxFlakeLockFlags
-                             )
+      /* Stick to the revision we reported if we already looked it up. */
+      this->lockedFlake = lockFlakeCached(
+        * this->getEvalState()
+      , this->lockedInfo.has_value() ? this->lockedInfo->lockedRef
+                                     : this->_flakeRef
+      , this->_lockCache.get()
       );
-      nix::evalSettings.pureEval = oldPurity;
-  }
+      this->lockedInfo = LockedRefInfo {
+        this->lockedFlake->flake.lockedRef
+      , this->lockedFlake->getFingerprint()
+      };
+    }
   return this->lockedFlake;
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  const LockedRefInfo &
+FloxFlake::getLockedInfo()
+{
+  if ( ( ! this->lockedInfo.has_value() ) && ( this->_lockCache != nullptr ) )
+    {
+      try
+        {
+          this->lockedInfo = this->_lockCache->get( this->_flakeRef );
+        }
+      catch( const nix::SQLiteError & )
+        {
+        }
+    }
+  if ( ! this->lockedInfo.has_value() ) { this->getLockedFlake(); }
+  return this->lockedInfo.value();
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::list<std::list<std::string>>
@@ -104,34 +139,15 @@ FloxFlake::getFlakeAttrPathPrefixes() const
 
 /* -------------------------------------------------------------------------- */
 
-   nix::ref<nix::eval_cache::EvalCache>
+  nix::ref<nix::eval_cache::EvalCache>
 FloxFlake::openEvalCache()
 {
-  nix::flake::Fingerprint fingerprint =
-    this->getLockedFlake()->getFingerprint();
-  return nix::make_ref<nix::eval_cache::EvalCache>(
-    ( nix::evalSettings.useEvalCache && nix::evalSettings.pureEval )
-    ? std::optional { std::cref( fingerprint ) }
-    : std::nullopt
-  , * this->_state
-  , [&]()
+  if ( this->evalCache == nullptr )
     {
-      nix::Value * vFlake = this->_state->allocValue();
-      nix::flake::callFlake(
-        * this->_state
-      , * this->getLockedFlake()
-      , * vFlake
-      );
-      this->_state->forceAttrs(
-        * vFlake, nix::noPos, "while parsing cached flake data"
-      );
-      nix::Attr * aOutputs = vFlake->attrs->get(
-        this->_state->symbols.create( "outputs" )
-      );
-      assert( aOutputs != nullptr );
-      return aOutputs->value;
+      this->evalCache = (std::shared_ptr<nix::eval_cache::EvalCache>)
+        getEvalCache( this->getEvalState(), this->getLockedFlake() );
     }
-  );
+  return nix::ref<nix::eval_cache::EvalCache>( this->evalCache );
 }
 
 
@@ -163,19 +179,64 @@ FloxFlake::maybeOpenCursor( const std::vector<nix::Symbol> & path )
 
 /* -------------------------------------------------------------------------- */
 
-  std::list<Cursor>
-FloxFlake::getFlakePrefixCursors()
+  MaybeCursor
+FloxFlake::getPrefixCursor( const std::list<std::string> & prefix )
 {
-  std::list<Cursor>                    rsl;
-  nix::ref<nix::eval_cache::EvalCache> cache = this->openEvalCache();
-  for ( std::list<std::string> & prefix : this->getFlakeAttrPathPrefixes() )
+  auto search = this->prefixCursors.find( prefix );
+  if ( search == this->prefixCursors.end() )
     {
-      MaybeCursor cur = cache->getRoot();
-      for ( std::string & p : prefix )
+      MaybeCursor cur = this->openEvalCache()->getRoot();
+      for ( const std::string & p : prefix )
         {
           cur = cur->maybeGetAttr( p );
           if ( cur == nullptr ) { break; }
         }
+      search = this->prefixCursors.emplace( prefix, cur ).first;
+    }
+  return search->second;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::list<std::list<std::string>>
+FloxFlake::getExistingFlakeAttrPathPrefixes()
+{
+  if ( this->existingPrefixes.has_value() )
+    {
+      return this->existingPrefixes.value();
+    }
+  DrvDb db( this->getFingerprint() );
+  std::list<std::list<std::string>> rsl;
+  for ( std::list<std::string> & prefix : this->getFlakeAttrPathPrefixes() )
+    {
+      std::vector<std::string> p( prefix.begin(), prefix.end() );
+      std::optional<std::string_view> stability;
+      if ( 2 < p.size() ) { stability = p[2]; }
+      std::optional<bool> exists = db.hasPrefix( p[0], p[1], stability );
+      if ( ! exists.has_value() )
+        {
+          exists = this->getPrefixCursor( prefix ) != nullptr;
+          db.recordPrefix( p[0], p[1], stability, exists.value() );
+        }
+      if ( exists.value() ) { rsl.push_back( std::move( prefix ) ); }
+    }
+  this->existingPrefixes = rsl;
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::list<Cursor>
+FloxFlake::getFlakePrefixCursors()
+{
+  std::list<Cursor> rsl;
+  for ( const std::list<std::string> & prefix :
+          this->getExistingFlakeAttrPathPrefixes()
+      )
+    {
+      MaybeCursor cur = this->getPrefixCursor( prefix );
       if ( cur != nullptr ) { rsl.push_back( Cursor( cur ) ); }
     }
   return rsl;
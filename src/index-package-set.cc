@@ -0,0 +1,72 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "flox/index-package-set.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+IndexPackageSet::hasRelPath( const std::list<std::string_view> & path )
+{
+  if ( this->_prefix == PackageIndex::npos ) { return false; }
+  return this->_index->findRelPath( this->_prefix, path ) != PackageIndex::npos;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+IndexPackageSet::size()
+{
+  if ( this->_prefix == PackageIndex::npos ) { return 0; }
+  return this->_index->getPrefixes()[this->_prefix].count;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<Package>
+IndexPackageSet::maybeGetRelPath( const std::list<std::string_view> & path )
+{
+  if ( this->_prefix == PackageIndex::npos ) { return nullptr; }
+  uint32_t id = this->_index->findRelPath( this->_prefix, path );
+  if ( id == PackageIndex::npos ) { return nullptr; }
+  return std::make_shared<IndexedPackage>( this->_index, id );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::vector<IndexedPackage>
+IndexPackageSet::getPname( std::string_view pname ) const
+{
+  std::vector<IndexedPackage> rsl;
+  if ( this->_prefix == PackageIndex::npos ) { return rsl; }
+  for ( uint32_t id : this->_index->findPname( this->_prefix, pname ) )
+    {
+      rsl.emplace_back( this->_index, id );
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
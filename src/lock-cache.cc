@@ -0,0 +1,230 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <nix/fetchers.hh>
+#include <nix/hash.hh>
+#include <nix/util.hh>
+#include "flox/lock-cache.hh"
+#include "flox/util.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+  std::string
+getLockCacheName()
+{
+  return nix::getCacheDir() + "/flox/lock-cache-v1.sqlite";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  uint64_t
+getLockCacheTTL()
+{
+  const char * ttl = std::getenv( "FLOX_LOCK_CACHE_TTL" );
+  if ( ( ttl != nullptr ) && ( ttl[0] != '\0' ) )
+    {
+      try
+        {
+          return std::stoull( ttl );
+        }
+      catch( ... )
+        {
+        }
+    }
+  return FLOX_LOCK_CACHE_TTL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static const char * lockCacheSchema = R"sql(
+CREATE TABLE IF NOT EXISTS LockedRefs (
+  ref          TEXT     PRIMARY KEY
+, isLocked     BOOL     NOT NULL
+, lockedRef    JSON     NOT NULL
+, fingerprint  TEXT     NOT NULL
+, lockedAt     INTEGER  NOT NULL
+);
+)sql";
+
+
+/** Serialize @a ref so that equal references have equal keys. */
+  static std::string
+lockCacheKey( const FloxFlakeRef & ref )
+{
+  return nix::fetchers::attrsToJSON( ref.toAttrs() ).dump();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+LockCache::LockCache( const std::string & path, uint64_t ttl )
+  : _ttl( ttl )
+{
+  std::filesystem::path p( path );
+  if ( ! std::filesystem::exists( p.parent_path() ) )
+    {
+      std::filesystem::create_directories( p.parent_path() );
+    }
+
+  this->_db = sqlite::SQLiteDb( path, true, true, true );
+  nix::retrySQLite<void>( [&]() { this->_db.exec( lockCacheSchema ); } );
+
+  this->_queryLocked.create(
+    this->_db
+  , "SELECT lockedRef, fingerprint FROM LockedRefs "
+    "WHERE ( ref = ? ) AND ( isLocked OR ( ? < lockedAt ) )"
+  );
+  this->_insertLocked.create(
+    this->_db
+  , "INSERT OR REPLACE INTO LockedRefs "
+    "( ref, isLocked, lockedRef, fingerprint, lockedAt ) "
+    "VALUES ( ?, ?, ?, ?, ? )"
+  );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::optional<LockedRefInfo>
+LockCache::get( const FloxFlakeRef & ref )
+{
+  int64_t oldest = ( (int64_t) std::time( nullptr ) ) - this->_ttl;
+  std::optional<std::pair<std::string, std::string>> row;
+  nix::retrySQLite<void>( [&]() {
+    auto query = this->_queryLocked.use()( lockCacheKey( ref ) )( oldest );
+    if ( query.next() ) { row = { query.getStr( 0 ), query.getStr( 1 ) }; }
+  } );
+  if ( ! row.has_value() ) { return std::nullopt; }
+
+  return LockedRefInfo {
+    nix::FlakeRef::fromAttrs(
+      nix::fetchers::jsonToAttrs( nlohmann::json::parse( row->first ) )
+    )
+  , nix::Hash::parseNonSRIUnprefixed( row->second, nix::htSHA256 )
+  };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+LockCache::put( const FloxFlakeRef            & ref
+              , const nix::flake::LockedFlake & locked
+              )
+{
+  std::string lockedRef   = lockCacheKey( locked.flake.lockedRef );
+  std::string fingerprint =
+    locked.getFingerprint().to_string( nix::Base16, false );
+  int64_t     now         = std::time( nullptr );
+  nix::retrySQLite<void>( [&]() {
+    nix::SQLiteTxn txn( this->_db );
+    for ( const FloxFlakeRef & r : { ref, locked.flake.lockedRef } )
+      {
+        this->_insertLocked.use()
+          ( lockCacheKey( r ) )
+          ( (int64_t) r.input.isLocked() )
+          ( lockedRef )
+          ( fingerprint )
+          ( now )
+          .exec();
+      }
+    txn.commit();
+  } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::shared_ptr<nix::flake::LockedFlake>
+lockFlakeCached(       nix::EvalState & state
+               , const FloxFlakeRef   & ref
+               ,       LockCache      * cache
+               )
+{
+  /* The cache only saves time, so we lock as usual if it fails. */
+  std::optional<LockedRefInfo> known;
+  if ( cache != nullptr )
+    {
+      try
+        {
+          known = cache->get( ref );
+        }
+      catch( const nix::SQLiteError & )
+        {
+        }
+    }
+
+  /* Locking the recorded revision doesn't need to look up the latest. */
+  bool oldPurity = nix::evalSettings.pureEval;
+  nix::evalSettings.pureEval = false;
+  std::shared_ptr<nix::flake::LockedFlake> locked;
+  try
+    {
+      locked = std::make_shared<nix::flake::LockedFlake>(
+        nix::flake::lockFlake( state
+                             , known.has_value() ? known->lockedRef : ref
+                             , floxFlakeLockFlags
+                             )
+      );
+    }
+  catch( ... )
+    {
+      nix::evalSettings.pureEval = oldPurity;
+      throw;
+    }
+  nix::evalSettings.pureEval = oldPurity;
+
+  if ( ( cache != nullptr ) && ( ! known.has_value() ) )
+    {
+      try
+        {
+          cache->put( ref, * locked );
+        }
+      catch( const nix::SQLiteError & )
+        {
+        }
+    }
+  return locked;
+}
+
+
+  std::shared_ptr<nix::flake::LockedFlake>
+lockFlakeCached( nix::EvalState & state, const FloxFlakeRef & ref )
+{
+  std::unique_ptr<LockCache> cache;
+  try
+    {
+      cache = std::make_unique<LockCache>();
+    }
+  catch( ... )
+    {
+    }
+  return lockFlakeCached( state, ref, cache.get() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -16,6 +16,7 @@
 #include <nlohmann/json.hpp>
 #include "resolve.hh"
 #include "flox/util.hh"
+#include "flox/lock-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -99,14 +100,11 @@ class CmdInputsLock : virtual nix::EvalCommand, public virtual nix::Args
 
       for ( auto & id : this->_inputs->getInputNames() )
         {
-          nix::flake::LockedFlake lockedFlake =
-            nix::flake::lockFlake( * state
-                                 , this->_inputs->get( id )
-                                 , floxFlakeLockFlags
-                                 );
+          std::shared_ptr<nix::flake::LockedFlake> lockedFlake =
+            lockFlakeCached( * state, this->_inputs->get( id ) );
           rsl.emplace(
             id
-          , nix::fetchers::attrsToJSON( lockedFlake.flake.lockedRef.toAttrs() )
+          , nix::fetchers::attrsToJSON( lockedFlake->flake.lockedRef.toAttrs() )
           );
         }
       nix::logger->cout( "%s", rsl.dump() );
@@ -4,10 +4,13 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
 #include <filesystem>
 #include <stddef.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <string>
 #include <nlohmann/json.hpp>
 #include <nix/shared.hh>
@@ -16,6 +19,7 @@
 #include <nix/flake/flake.hh>
 #include <nix/store-api.hh>
 #include "resolve.hh"
+#include "flox/resolverd.hh"
 #include <argparse/argparse.hpp>
 
 
@@ -52,6 +56,133 @@ readOrParseJSON( const std::string & i )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Read descriptors for `--batch' as a JSON list, or as NDJSON with one
+ * descriptor per line.
+ * @param ndjson Set to `true' if descriptors were read as NDJSON.
+ */
+  static nlohmann::json
+readDescriptors( const std::string & arg, bool & ndjson )
+{
+  std::string text;
+  if ( arg == "-" )
+    {
+      text.assign( std::istreambuf_iterator<char>( std::cin )
+                 , std::istreambuf_iterator<char>()
+                 );
+    }
+  else if ( std::filesystem::exists( arg ) )
+    {
+      std::ifstream f( arg );
+      text.assign( std::istreambuf_iterator<char>( f )
+                 , std::istreambuf_iterator<char>()
+                 );
+    }
+  else
+    {
+      text = arg;
+    }
+
+  ndjson = false;
+  if ( nlohmann::json::accept( text ) )
+    {
+      nlohmann::json j = nlohmann::json::parse( text );
+      if ( j.is_array() ) { return j; }
+    }
+
+  ndjson = true;
+  nlohmann::json     descs = nlohmann::json::array();
+  std::istringstream lines( text );
+  std::string        line;
+  while ( std::getline( lines, line ) )
+    {
+      if ( line.find_first_not_of( " \t\r" ) == std::string::npos )
+        {
+          continue;
+        }
+      descs.push_back( nlohmann::json::parse( line ) );
+    }
+  return descs;
+}
+
+
+/**
+ * Convert batch results to JSON, with each element in the same form that
+ * would be printed for a single descriptor.
+ */
+  static nlohmann::json
+batchToJSON( const std::vector<std::list<Resolved>> & results, bool one )
+{
+  nlohmann::json rsl = nlohmann::json::array();
+  for ( const std::list<Resolved> & r : results )
+    {
+      if ( ! one )           { rsl.push_back( r );                  }
+      else if ( r.empty() )  { rsl.push_back( nlohmann::json() );   }
+      else                   { rsl.push_back( r.front().toJSON() ); }
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Resolve a descriptor in the single input given by `--inputs', printing a
+ * JSON list of results.
+ * This is run in worker processes started by `resolve_V2'.
+ */
+  static int
+resolveWorker( const argparse::ArgumentParser & prog, bool one )
+{
+  try
+    {
+      nlohmann::json inputsJSON =
+        nlohmann::json::parse( prog.get<std::string>( "-i" ) );
+      if ( ( ! inputsJSON.is_object() ) || ( inputsJSON.size() != 1 ) ||
+           ( ! prog.is_used( "-d" ) ) || ( ! prog.is_used( "--systems" ) )
+         )
+        {
+          std::cerr << "resolver: `--worker' requires a single input, "
+                       "`--descriptor', and `--systems'" << std::endl;
+          return EXIT_FAILURE;
+        }
+      std::string id = inputsJSON.begin().key();
+
+      nix::verbosity = nix::lvlError;
+      ResolverState rs(
+        Inputs( inputsJSON )
+      , Preferences(
+          nlohmann::json::parse( prog.get<std::string>( "-p" ) )
+        )
+      , nlohmann::json::parse( prog.get<std::string>( "--systems" ) )
+          .get<std::list<std::string>>()
+      );
+      Descriptor desc(
+        nlohmann::json::parse( prog.get<std::string>( "-d" ) )
+      );
+
+      std::list<Resolved> rsl;
+      if ( ! one )
+        {
+          rsl = rs.resolveInInput( id, desc );
+        }
+      else if ( std::optional<Resolved> r = rs.resolveOneInInput( id, desc ) )
+        {
+          rsl.push_back( r.value() );
+        }
+      std::cout << nlohmann::json( rsl ).dump() << std::endl;
+      return std::cout.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  catch( const std::exception & err )
+    {
+      std::cerr << "resolver: " << err.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   int
@@ -81,10 +212,48 @@ main( int argc, char * argv[] )
     .metavar( "PREFERENCES" );
 
   prog.add_argument( "-d", "--descriptor" )
-    .required()
     .help( "inline JSON or path to JSON file containing a package descriptor" )
     .metavar( "DESCRIPTOR" );
 
+  prog.add_argument( "-b", "--batch" )
+    .help( "inline JSON list, path to a JSON list or NDJSON file, or `-' "
+           "for NDJSON on stdin, containing package descriptors"
+         )
+    .metavar( "DESCRIPTORS" );
+
+  prog.add_argument( "-S", "--socket" )
+    .help( "resolve using a running `resolverd' listening on SOCKET" )
+    .metavar( "SOCKET" );
+
+  prog.add_argument( "--no-result-cache" )
+    .default_value( false )
+    .implicit_value( true )
+    .help( "don't read or write the persistent cache of results" );
+
+  prog.add_argument( "-j", "--jobs" )
+    .default_value( 0 )
+    .scan<'i', int>()
+    .help( "number of inputs to resolve in parallel, `0' for one per CPU" )
+    .metavar( "JOBS" );
+
+  prog.add_argument( "--lock-ttl" )
+    .default_value( (int) getLockCacheTTL() )
+    .scan<'i', int>()
+    .help( "seconds for which inputs reuse the revision they were last "
+           "locked to" )
+    .metavar( "SECONDS" );
+
+  /* Used internally to run workers. */
+  prog.add_argument( "--worker" )
+    .default_value( false )
+    .implicit_value( true )
+    .help( "resolve DESCRIPTOR in the single input of INPUTS, printing a "
+           "JSON list of results" );
+
+  prog.add_argument( "--systems" )
+    .help( "inline JSON list of systems to resolve in, used by `--worker'" )
+    .metavar( "SYSTEMS" );
+
   try
     {
       prog.parse_args( argc, argv );
@@ -98,15 +267,133 @@ main( int argc, char * argv[] )
   bool one   = prog.get<bool>( "-o" );
   bool quiet = prog.get<bool>( "-q" );
 
-  Inputs      inputs( readOrParseJSON( prog.get<std::string>( "-i" ) ) );
-  Preferences prefs(  readOrParseJSON( prog.get<std::string>( "-p" ) ) );
-  Descriptor  desc(   readOrParseJSON( prog.get<std::string>( "-d" ) ) );
+  if ( prog.get<bool>( "--worker" ) )
+    {
+      return resolveWorker( prog, one );
+    }
+
+  /* Workers are fresh executions of this program. */
+  const char * self = std::filesystem::exists( "/proc/self/exe" )
+                      ? "/proc/self/exe"
+                      : argv[0];
+
+  if ( prog.is_used( "-d" ) == prog.is_used( "-b" ) )
+    {
+      std::cerr << "resolver: exactly one of `--descriptor' or `--batch' "
+                   "must be given" << std::endl << prog;
+      return EXIT_FAILURE;
+    }
+
+  /* A daemon resolves with its own settings, so we refuse to ignore ours. */
+  if ( prog.is_used( "-S" ) &&
+       ( prog.is_used( "--no-result-cache" ) || prog.is_used( "-j" ) ||
+         prog.is_used( "--lock-ttl" )
+       )
+     )
+    {
+      std::cerr << "resolver: `--no-result-cache', `--jobs', and `--lock-ttl' "
+                   "can't be used with `--socket'" << std::endl << prog;
+      return EXIT_FAILURE;
+    }
+
+  nlohmann::json inputsJSON = readOrParseJSON( prog.get<std::string>( "-i" ) );
+  nlohmann::json prefsJSON  = readOrParseJSON( prog.get<std::string>( "-p" ) );
+
+  if ( std::optional<std::string> batch = prog.present( "-b" ) )
+    {
+      bool           ndjson = false;
+      nlohmann::json descs  = readDescriptors( * batch, ndjson );
+      nlohmann::json rsl;
+      if ( std::optional<std::string> socket = prog.present( "-S" ) )
+        {
+          try
+            {
+              rsl = resolverdRequest( * socket
+                                    , { { "inputs",      inputsJSON }
+                                      , { "preferences", prefsJSON  }
+                                      , { "descriptors", descs      }
+                                      , { "one",         one        }
+                                      }
+                                    );
+            }
+          catch( const std::exception & err )
+            {
+              std::cerr << "resolver: " << err.what() << std::endl;
+              return EXIT_FAILURE;
+            }
+        }
+      else
+        {
+          nix::verbosity = nix::lvlError;
+          ResolverState rs( Inputs( inputsJSON ), Preferences( prefsJSON ) );
+          rs.setJobs( std::max( 0, prog.get<int>( "-j" ) ) );
+          rs.setWorkerProgram( self );
+          rs.setLockCacheTTL( std::max( 0, prog.get<int>( "--lock-ttl" ) ) );
+          rs.setUseResultCache( ! prog.get<bool>( "--no-result-cache" ) );
+          rsl = batchToJSON(
+            resolveBatch_V2( rs, descs.get<std::vector<Descriptor>>(), one )
+          , one
+          );
+        }
+
+      bool found = true;
+      for ( const nlohmann::json & r : rsl )
+        {
+          found &= one ? ( ! r.is_null() ) : ( ! r.empty() );
+        }
+      if ( ndjson )
+        {
+          for ( const nlohmann::json & r : rsl )
+            {
+              std::cout << r.dump() << std::endl;
+            }
+        }
+      else
+        {
+          std::cout << rsl.dump() << std::endl;
+        }
+      return ( quiet || found ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+  nlohmann::json descJSON = readOrParseJSON( prog.get<std::string>( "-d" ) );
+
+  /* Hand the request off to a warm daemon. */
+  if ( std::optional<std::string> socket = prog.present( "-S" ) )
+    {
+      nlohmann::json rsl;
+      try
+        {
+          rsl = resolverdRequest( * socket
+                                , { { "inputs",      inputsJSON }
+                                  , { "preferences", prefsJSON  }
+                                  , { "descriptor",  descJSON   }
+                                  , { "one",         one        }
+                                  }
+                                );
+        }
+      catch( const std::exception & err )
+        {
+          std::cerr << "resolver: " << err.what() << std::endl;
+          return EXIT_FAILURE;
+        }
+      std::cout << rsl.dump() << std::endl;
+      bool found = one ? ( ! rsl.is_null() ) : ( ! rsl.empty() );
+      return ( quiet || found ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+  Inputs      inputs( inputsJSON );
+  Preferences prefs( prefsJSON );
+  Descriptor  desc( descJSON );
 
 
   /* TODO: make an option */
   nix::verbosity = nix::lvlError;
 
   ResolverState rs( inputs, prefs );
+  rs.setJobs( std::max( 0, prog.get<int>( "-j" ) ) );
+  rs.setWorkerProgram( self );
+  rs.setLockCacheTTL( std::max( 0, prog.get<int>( "--lock-ttl" ) ) );
+  rs.setUseResultCache( ! prog.get<bool>( "--no-result-cache" ) );
 
   if ( one )
     {
@@ -0,0 +1,428 @@
+/* ========================================================================== *
+ *
+ * A long running resolver which serves requests over a Unix domain socket.
+ *
+ * Most of the time spent by a single `resolver' run goes to initializing
+ * `nix', locking inputs, and opening caches, even when the answer is cached.
+ * `resolverd' keeps `ResolverState' instances for recently used pairs of
+ * inputs and preferences so that later requests skip that work.
+ *
+ * `nix' evaluation is single threaded, so requests are handled one at a time
+ * in the order their lines are read, with `poll' multiplexing clients.
+ * See `flox/resolverd.hh' for the protocol.
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include <nix/shared.hh>
+#include <nix/eval.hh>
+#include "resolve.hh"
+#include "flox/resolverd.hh"
+#include <argparse/argparse.hpp>
+
+
+/* -------------------------------------------------------------------------- */
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL  0
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+using namespace flox::resolve;
+
+
+/* -------------------------------------------------------------------------- */
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+  static void
+onStopSignal( int )
+{
+  stopRequested = 1;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Warm `ResolverState' instances keyed by their inputs and preferences.
+ *
+ * Inputs are locked when a state is created, so states are dropped after
+ * @a ttl to pick up new revisions of unlocked references.
+ * At most @a capacity states are kept, evicting the least recently used.
+ */
+class StateCache {
+
+  private:
+    struct Entry {
+      std::unique_ptr<ResolverState>        state;
+      std::chrono::steady_clock::time_point created;
+      std::chrono::steady_clock::time_point used;
+    };
+
+    std::map<std::string, Entry> _entries;
+    std::size_t                  _capacity;
+    std::chrono::seconds         _ttl;
+    std::optional<std::string>   _workerProgram;
+
+  public:
+    /**
+     * @param workerProgram The `resolver' executable used to resolve inputs
+     *                      in parallel, or `std::nullopt' to resolve every
+     *                      input in this process.
+     */
+    StateCache( std::size_t                capacity
+              , std::chrono::seconds       ttl
+              , std::optional<std::string> workerProgram = std::nullopt
+              )
+      : _capacity( std::max( (std::size_t) 1, capacity ) )
+      , _ttl( ttl )
+      , _workerProgram( std::move( workerProgram ) )
+    {}
+
+      ResolverState &
+    get( const nlohmann::json & inputs, const nlohmann::json & prefs )
+    {
+      auto        now = std::chrono::steady_clock::now();
+      std::string key = inputs.dump() + "\n" + prefs.dump();
+
+      auto search = this->_entries.find( key );
+      if ( ( search != this->_entries.end() ) &&
+           ( ( now - search->second.created ) < this->_ttl )
+         )
+        {
+          search->second.used = now;
+          return * search->second.state;
+        }
+      if ( search != this->_entries.end() ) { this->_entries.erase( search ); }
+
+      while ( this->_capacity <= this->_entries.size() )
+        {
+          auto oldest = this->_entries.begin();
+          for ( auto it = this->_entries.begin(); it != this->_entries.end();
+                ++it
+              )
+            {
+              if ( it->second.used < oldest->second.used ) { oldest = it; }
+            }
+          this->_entries.erase( oldest );
+        }
+
+      Entry e {
+        std::make_unique<ResolverState>( Inputs( inputs )
+                                       , Preferences( prefs )
+                                       )
+      , now
+      , now
+      };
+      if ( this->_workerProgram.has_value() )
+        {
+          e.state->setWorkerProgram( this->_workerProgram.value() );
+        }
+      /* Otherwise a fresh state could reuse a lock older than `ttl'. */
+      e.state->setLockCacheTTL( this->_ttl.count() );
+      return * this->_entries.emplace( key, std::move( e ) )
+                 .first->second.state;
+    }
+
+};  /* End class `StateCache' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Handle a single request line, returning the response object. */
+  static nlohmann::json
+handleRequest( StateCache & states, const std::string & line )
+{
+  try
+    {
+      nlohmann::json request = nlohmann::json::parse( line );
+      nlohmann::json prefs   = request.value( "preferences"
+                                            , nlohmann::json::object()
+                                            );
+      ResolverState & rs  = states.get( request.at( "inputs" ), prefs );
+      bool            one = request.value( "one", false );
+
+      if ( request.contains( "descriptors" ) )
+        {
+          nlohmann::json rsl = nlohmann::json::array();
+          for ( const std::list<Resolved> & r :
+                  resolveBatch_V2(
+                    rs
+                  , request["descriptors"].get<std::vector<Descriptor>>()
+                  , one
+                  )
+              )
+            {
+              if ( ! one )          { rsl.push_back( r );                  }
+              else if ( r.empty() ) { rsl.push_back( nlohmann::json() );   }
+              else                  { rsl.push_back( r.front().toJSON() ); }
+            }
+          return { { "result", rsl } };
+        }
+
+      Descriptor desc( request.at( "descriptor" ) );
+      if ( one )
+        {
+          std::optional<Resolved> rsl = resolveOne_V2( rs, desc );
+          return { { "result", rsl.has_value() ? rsl.value().toJSON()
+                                               : nlohmann::json()
+                   }
+                 };
+        }
+      return { { "result", nlohmann::json( resolve_V2( rs, desc ) ) } };
+    }
+  catch( const std::exception & err )
+    {
+      return { { "error", err.what() } };
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static bool
+writeAll( int fd, const std::string & msg )
+{
+  for ( std::size_t sent = 0; sent < msg.size(); )
+    {
+      ssize_t n =
+        send( fd, msg.data() + sent, msg.size() - sent, MSG_NOSIGNAL );
+      if ( ( n < 0 ) && ( errno == EINTR ) ) { continue; }
+      if ( n <= 0 ) { return false; }
+      sent += n;
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static int
+openSocket( const std::string & path )
+{
+  struct sockaddr_un addr;
+  std::memset( & addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if ( sizeof( addr.sun_path ) <= path.size() )
+    {
+      std::cerr << "resolverd: socket path is too long: " << path << std::endl;
+      return -1;
+    }
+  std::memcpy( addr.sun_path, path.c_str(), path.size() );
+
+  std::filesystem::path parent = std::filesystem::path( path ).parent_path();
+  if ( ( ! parent.empty() ) && ( ! std::filesystem::exists( parent ) ) )
+    {
+      std::filesystem::create_directories( parent );
+    }
+  int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( fd < 0 )
+    {
+      std::cerr << "resolverd: socket: " << std::strerror( errno ) << std::endl;
+      return -1;
+    }
+  fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+  /* Refuse to replace the socket of a daemon which is still running, and
+   * otherwise remove a socket left behind by a previous run. */
+  if ( connect( fd, (struct sockaddr *) & addr, sizeof( addr ) ) == 0 )
+    {
+      std::cerr << "resolverd: already listening on " << path << std::endl;
+      close( fd );
+      return -1;
+    }
+  if ( errno == ECONNREFUSED ) { unlink( path.c_str() ); }
+  close( fd );
+
+  fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( 0 <= fd ) { fcntl( fd, F_SETFD, FD_CLOEXEC ); }
+
+  /* The socket is created with restrictive permissions, so that it is never
+   * reachable by other users, even briefly. */
+  mode_t oldMask = umask( 0077 );
+  bool   bound   = ( 0 <= fd ) &&
+                   ( bind( fd, (struct sockaddr *) & addr, sizeof( addr ) )
+                     == 0
+                   );
+  int    err     = errno;
+  umask( oldMask );
+  if ( ( ! bound ) || ( listen( fd, 64 ) != 0 ) )
+    {
+      if ( bound ) { err = errno; }
+      std::cerr << "resolverd: " << path << ": " << std::strerror( err )
+                << std::endl;
+      if ( 0 <= fd ) { close( fd ); }
+      return -1;
+    }
+  return fd;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[] )
+{
+  argparse::ArgumentParser prog( "resolverd", FLOX_RESOLVER_VERSION );
+  prog.add_description(
+    "Serve resolver requests over a Unix domain socket"
+  );
+
+  prog.add_argument( "-S", "--socket" )
+    .default_value( getResolverdSocketName() )
+    .help( "path of the socket to listen on" )
+    .metavar( "SOCKET" );
+
+  prog.add_argument( "--max-states" )
+    .default_value( 4 )
+    .scan<'i', int>()
+    .help( "maximum number of input/preference pairs to keep warm" )
+    .metavar( "COUNT" );
+
+  prog.add_argument( "--ttl" )
+    .default_value( 600 )
+    .scan<'i', int>()
+    .help( "seconds before inputs are locked again, which also limits "
+           "how long locks are reused from the lock cache" )
+    .metavar( "SECONDS" );
+
+  try
+    {
+      prog.parse_args( argc, argv );
+    }
+  catch( const std::runtime_error & err )
+    {
+      std::cerr << err.what() << std::endl << prog;
+      return EXIT_FAILURE;
+    }
+
+  nix::verbosity = nix::lvlError;
+
+  std::string path = prog.get<std::string>( "-S" );
+  int         lfd  = openSocket( path );
+  if ( lfd < 0 ) { return EXIT_FAILURE; }
+
+  std::signal( SIGPIPE, SIG_IGN );
+  std::signal( SIGINT,  onStopSignal );
+  std::signal( SIGTERM, onStopSignal );
+
+  /* Workers are executions of the `resolver' installed alongside us. */
+  std::optional<std::string> workerProgram;
+  {
+    std::filesystem::path self = std::filesystem::exists( "/proc/self/exe" )
+                                 ? std::filesystem::read_symlink(
+                                     "/proc/self/exe"
+                                   )
+                                 : std::filesystem::path( argv[0] );
+    std::filesystem::path resolver = self.parent_path() / "resolver";
+    if ( std::filesystem::exists( resolver ) )
+      {
+        workerProgram = resolver.string();
+      }
+  }
+
+  StateCache states( std::max( 1, prog.get<int>( "--max-states" ) )
+                   , std::chrono::seconds( prog.get<int>( "--ttl" ) )
+                   , workerProgram
+                   );
+
+  /* Partial lines read from each client, indexed alongside `fds'. */
+  std::vector<struct pollfd> fds     = { { lfd, POLLIN, 0 } };
+  std::vector<std::string>   buffers = { "" };
+
+  while ( stopRequested == 0 )
+    {
+      if ( poll( fds.data(), fds.size(), -1 ) < 0 )
+        {
+          if ( errno == EINTR ) { continue; }
+          std::cerr << "resolverd: poll: " << std::strerror( errno )
+                    << std::endl;
+          break;
+        }
+
+      if ( ( fds[0].revents & POLLIN ) != 0 )
+        {
+          int cfd = accept( lfd, nullptr, nullptr );
+          if ( 0 <= cfd )
+            {
+              fcntl( cfd, F_SETFD, FD_CLOEXEC );
+              fds.push_back( { cfd, POLLIN, 0 } );
+              buffers.emplace_back();
+            }
+        }
+
+      for ( std::size_t i = 1; i < fds.size(); )
+        {
+          bool closed = false;
+          if ( ( fds[i].revents & ( POLLIN | POLLHUP | POLLERR ) ) != 0 )
+            {
+              char    buf[4096];
+              ssize_t n = read( fds[i].fd, buf, sizeof( buf ) );
+              if ( n <= 0 )
+                {
+                  closed = ( n == 0 ) || ( errno != EINTR );
+                }
+              else
+                {
+                  buffers[i].append( buf, n );
+                  std::size_t nl;
+                  while ( ( ! closed ) &&
+                          ( ( nl = buffers[i].find( '\n' ) ) !=
+                            std::string::npos
+                          )
+                        )
+                    {
+                      std::string line = buffers[i].substr( 0, nl );
+                      buffers[i].erase( 0, nl + 1 );
+                      if ( line.empty() ) { continue; }
+                      closed = ! writeAll(
+                        fds[i].fd
+                      , handleRequest( states, line ).dump() + "\n"
+                      );
+                    }
+                }
+            }
+          if ( closed )
+            {
+              close( fds[i].fd );
+              fds.erase( fds.begin() + i );
+              buffers.erase( buffers.begin() + i );
+            }
+          else
+            {
+              ++i;
+            }
+        }
+    }
+
+  for ( std::size_t i = 1; i < fds.size(); ++i ) { close( fds[i].fd ); }
+  close( lfd );
+  unlink( path.c_str() );
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
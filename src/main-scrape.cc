@@ -0,0 +1,552 @@
+/* ========================================================================== *
+ *
+ * Populate `DrvDb' caches for a set of inputs.
+ *
+ * The `nix' evaluator is single threaded, so rather than evaluating every
+ * attribute path prefix of a flake in sequence we run one worker process per
+ * `( subtree, system[, stability] )' prefix, each with its own `EvalState'.
+ * Workers are fresh executions of this program which write to the shared
+ * `DrvDb' for their input, coordinating through its `Progress' table.
+ *
+ * Within a prefix, nested sets such as `haskellPackages' become tasks in the
+ * `DrvDb' `Subtrees' table.
+ * When there are more job slots than prefixes, extra workers are started for
+ * the prefixes with the most unclaimed sets and share their work.
+ *
+ * Workers checkpoint their progress through each set as rows are committed,
+ * so a run which is interrupted is resumed by the next one rather than
+ * starting over.
+ *
+ * With `--paths-only' workers only record which attributes are derivations,
+ * which is enough to resolve attribute paths.
+ * A later run without it fills in package info for those paths rather than
+ * traversing the prefix again.
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stddef.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <nlohmann/json.hpp>
+#include <nix/shared.hh>
+#include <nix/eval.hh>
+#include <nix/eval-inline.hh>
+#include <nix/fetchers.hh>
+#include <nix/flake/flake.hh>
+#include <nix/store-api.hh>
+#include "resolve.hh"
+#include "flox/drv-cache.hh"
+#include "flox/flake-package-set.hh"
+#include "flox/cached-package-set.hh"
+#include "flox/package-index.hh"
+#include <argparse/argparse.hpp>
+
+
+/* -------------------------------------------------------------------------- */
+
+using namespace flox::resolve;
+
+
+/* -------------------------------------------------------------------------- */
+
+/* We don't use a raw string here because it is used in the `--help' message. */
+const std::string defaultInputs = "{"
+  "\"nixpkgs\":"      "\"github:NixOS/nixpkgs\","
+  "\"nixpkgs-flox\":" "\"github:flox/nixpkgs-flox\","
+  "\"floxpkgs\":"     "\"github:flox/floxpkgs\""
+"}";
+
+
+/* -------------------------------------------------------------------------- */
+
+  static inline nlohmann::json
+readOrParseJSON( const std::string & i )
+{
+  nlohmann::json j;
+  if ( std::filesystem::exists( i ) )
+    {
+      j = nlohmann::json::parse( std::ifstream( i ) );
+    }
+  else
+    {
+      j = nlohmann::json::parse( i );
+    }
+  return j;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A prefix of a single input to be scraped by one or more worker processes.
+ * Workers on the same shard share its sets through the `Subtrees' table.
+ */
+struct Shard {
+  std::string              id;
+  nlohmann::json           lockedRef;
+  std::vector<std::string> prefix;
+  std::shared_ptr<DrvDb>   db;
+  std::size_t              workers = 0;
+  bool                     failed  = false;
+  /** Whether paths are known, and only info needs to be filled. */
+  bool                     fill    = false;
+
+  std::string_view subtree() const { return this->prefix[0]; }
+  std::string_view system()  const { return this->prefix[1]; }
+
+    std::optional<std::string_view>
+  stability() const
+  {
+    if ( this->prefix.size() < 3 ) { return std::nullopt; }
+    return this->prefix[2];
+  }
+
+  std::string key() const { return nlohmann::json( this->prefix ).dump(); }
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Scrape a single prefix of a locked input into its `DrvDb'.
+ * This is run in worker processes.
+ * @param pathsOnly Only record the paths of derivations.
+ */
+  static int
+scrapeShard( const nlohmann::json & inputs
+           , const nlohmann::json & prefix
+           ,       bool             pathsOnly
+           )
+{
+  std::vector<std::string> p = prefix;
+  if ( ( p.size() < 2 ) || ( 3 < p.size() ) )
+    {
+      std::cerr << "scrape: invalid prefix: " << prefix.dump() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  ResolverState rs( Inputs( inputs ), Preferences(), { p[1] } );
+  for ( const auto & [id, flake] : rs.getInputs() )
+    {
+      std::optional<std::string_view> stability;
+      if ( p.size() == 3 ) { stability = p[2]; }
+      FlakePackageSet fps( rs.getEvalState()
+                         , flake->getLockedFlake()
+                         , parseSubtreeType( p[0] )
+                         , p[1]
+                         , stability
+                         );
+      DrvDb           db( flake->getFingerprint() );
+      progress_status s = db.getProgress( p[0], p[1], stability );
+      if ( pathsOnly )
+        {
+          cacheSubtrees( db, fps, FLOX_DRVDB_BATCH_SIZE, true );
+        }
+      else if ( s == DBPS_PATHS_DONE )
+        {
+          fillDrvInfos( db, fps );
+        }
+      else
+        {
+          cacheSubtrees( db, fps );
+        }
+    }
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Start a worker process for @a shard, returning its `pid'. */
+  static pid_t
+spawnShard( const char * self, const Shard & shard, bool pathsOnly )
+{
+  std::string inputs = nlohmann::json { { shard.id, shard.lockedRef } }.dump();
+  std::string prefix = nlohmann::json( shard.prefix ).dump();
+  pid_t pid = fork();
+  if ( pid == 0 )
+    {
+      execl( self, self, "--worker", "--prefix", prefix.c_str()
+           , "--inputs", inputs.c_str()
+           , pathsOnly ? "--paths-only" : (char *) nullptr
+           , (char *) nullptr
+           );
+      /* Only async-signal-safe calls are allowed here, so our parent reports
+       * the failure. */
+      _exit( 127 );
+    }
+  return pid;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[] )
+{
+  argparse::ArgumentParser prog( "scrape", FLOX_RESOLVER_VERSION );
+  prog.add_description(
+    "Populate package caches for flakes using one process per prefix"
+  );
+
+  prog.add_argument( "-i", "--inputs" )
+    .default_value( defaultInputs )
+    .help( "inline JSON or path to JSON file containing flake references" )
+    .metavar( "INPUTS" );
+
+  prog.add_argument( "-p", "--preferences" )
+    .default_value( std::string( "{}" ) )
+    .help( "inline JSON or path to JSON file containing resolver preferences" )
+    .metavar( "PREFERENCES" );
+
+  prog.add_argument( "-s", "--systems" )
+    .help( "inline JSON list of systems to scrape" )
+    .metavar( "SYSTEMS" );
+
+  prog.add_argument( "-j", "--jobs" )
+    .default_value( (int) std::max( 1u, std::thread::hardware_concurrency() ) )
+    .scan<'i', int>()
+    .help( "maximum number of worker processes to run at once" )
+    .metavar( "JOBS" );
+
+  prog.add_argument( "--paths-only" )
+    .default_value( false )
+    .implicit_value( true )
+    .help( "only record attribute paths of packages, leaving their info to "
+           "be filled by a later run"
+         );
+
+  /* Used internally to run workers. */
+  prog.add_argument( "--worker" )
+    .default_value( false )
+    .implicit_value( true )
+    .help( "scrape a single prefix of a single input ( internal )" );
+
+  prog.add_argument( "--prefix" )
+    .help( "inline JSON list holding the prefix scraped by `--worker'" )
+    .metavar( "PREFIX" );
+
+  try
+    {
+      prog.parse_args( argc, argv );
+    }
+  catch( const std::runtime_error & err )
+    {
+      std::cerr << err.what() << std::endl << prog;
+      return EXIT_FAILURE;
+    }
+
+  nix::verbosity = nix::lvlError;
+
+  nlohmann::json inputsJSON = readOrParseJSON( prog.get<std::string>( "-i" ) );
+  bool           pathsOnly  = prog.get<bool>( "--paths-only" );
+
+  if ( prog.get<bool>( "--worker" ) )
+    {
+      std::optional<std::string> prefix = prog.present( "--prefix" );
+      if ( ! prefix.has_value() )
+        {
+          std::cerr << "scrape: `--worker' requires `--prefix'" << std::endl;
+          return EXIT_FAILURE;
+        }
+      try
+        {
+          return scrapeShard( inputsJSON
+                            , nlohmann::json::parse( * prefix )
+                            , pathsOnly
+                            );
+        }
+      catch( const std::exception & err )
+        {
+          std::cerr << "scrape: " << * prefix << ": " << err.what()
+                    << std::endl;
+          return EXIT_FAILURE;
+        }
+    }
+
+  Inputs      inputs( inputsJSON );
+  Preferences prefs( readOrParseJSON( prog.get<std::string>( "-p" ) ) );
+
+  std::list<std::string> systems = defaultSystems;
+  if ( std::optional<std::string> s = prog.present( "-s" ) )
+    {
+      systems = readOrParseJSON( * s ).get<std::list<std::string>>();
+    }
+
+  /* Lock inputs once so that every worker scrapes the same revision, and
+   * create each `DrvDb' up front so workers don't race to initialize it.
+   * Prefixes which are already cached are skipped. */
+  std::list<Shard>                              shards;
+  std::unordered_map<pid_t, Shard *>            running;
+  std::map<std::string, std::shared_ptr<DrvDb>> dbs;
+  nlohmann::json                                rsl = nlohmann::json::object();
+  {
+    ResolverState rs( inputs, prefs, systems );
+    for ( const auto & [id, flake] : rs.getInputs() )
+      {
+        nlohmann::json lockedRef =
+          nix::fetchers::attrsToJSON( flake->getLockedFlakeRef().toAttrs() );
+        rsl[id] = nlohmann::json::object();
+        std::shared_ptr<DrvDb> db =
+          std::make_shared<DrvDb>( flake->getFingerprint() );
+        dbs.emplace( id, db );
+        for ( const std::list<std::string> & prefix :
+                flake->getFlakeAttrPathPrefixes()
+            )
+          {
+            Shard shard { id
+                        , lockedRef
+                        , { prefix.begin(), prefix.end() }
+                        , db
+                        };
+            /* Prefixes which were probed and found missing are skipped. */
+            if ( db->hasPrefix( shard.subtree()
+                              , shard.system()
+                              , shard.stability()
+                              ) == false
+               )
+              {
+                rsl[id][shard.key()] = "missing";
+                continue;
+              }
+            progress_status s = db->getProgress( shard.subtree()
+                                               , shard.system()
+                                               , shard.stability()
+                                               );
+            if ( ( DBPS_INFO_DONE <= s ) ||
+                 ( pathsOnly && ( s == DBPS_PATHS_DONE ) )
+               )
+              {
+                rsl[id][shard.key()] = "cached";
+                continue;
+              }
+            shard.fill = s == DBPS_PATHS_DONE;
+            shards.push_back( std::move( shard ) );
+          }
+      }
+  }
+
+  const char * self = std::filesystem::exists( "/proc/self/exe" )
+                      ? "/proc/self/exe"
+                      : argv[0];
+  std::size_t jobs = (std::size_t) std::max( 1, prog.get<int>( "-j" ) );
+  int         ec   = EXIT_SUCCESS;
+
+  /* Record the result of a shard once its last worker exits. */
+  auto finish = [&]( Shard & shard )
+  {
+    if ( 0 < shard.workers ) { return; }
+    /* Workers record prefixes which turned out not to exist. */
+    if ( ( ! shard.failed ) &&
+         ( shard.db->hasPrefix( shard.subtree()
+                              , shard.system()
+                              , shard.stability()
+                              ) == false
+         )
+       )
+      {
+        rsl[shard.id][shard.key()] = "missing";
+        return;
+      }
+    rsl[shard.id][shard.key()] = shard.failed ? "failed" : "done";
+    std::size_t skipped = shard.db->countSkippedSubtrees( shard.subtree()
+                                                        , shard.system()
+                                                        , shard.stability()
+                                                        );
+    if ( 0 < skipped )
+      {
+        std::cerr << "scrape: " << shard.id << ": " << shard.key()
+                  << ": skipped " << skipped
+                  << " attributes which previously failed to evaluate"
+                  << std::endl;
+      }
+    if ( shard.failed )
+      {
+        /* Other workers may have marked the prefix as done without the sets
+         * that were abandoned.
+         * Filling info never traverses sets, so its paths are still known. */
+        if ( ! shard.fill )
+          {
+            shard.db->setProgress( shard.subtree()
+                                 , shard.system()
+                                 , shard.stability()
+                                 , DBPS_PARTIAL
+                                 );
+          }
+        ec = EXIT_FAILURE;
+      }
+  };
+
+  auto reap = [&]( bool block )
+  {
+    int   status = 0;
+    pid_t pid    = waitpid( -1, & status, block ? 0 : WNOHANG );
+    if ( pid == 0 ) { return; }
+    if ( ( pid < 0 ) && ( errno == EINTR ) ) { return; }
+    if ( pid < 0 )
+      {
+        /* We've lost track of our workers, so count them as failures. */
+        for ( auto & [_, shard] : running )
+          {
+            shard->workers = 0;
+            shard->failed  = true;
+            finish( * shard );
+          }
+        running.clear();
+        return;
+      }
+    auto it = running.find( pid );
+    if ( it == running.end() ) { return; }
+    Shard & shard = * it->second;
+    running.erase( it );
+    if ( ! ( WIFEXITED( status ) && ( WEXITSTATUS( status ) == 0 ) ) )
+      {
+        if ( WIFEXITED( status ) && ( WEXITSTATUS( status ) == 127 ) )
+          {
+            std::cerr << "scrape: " << shard.id << ": " << shard.key()
+                      << ": failed to execute worker: " << self << std::endl;
+          }
+        shard.db->abandonSubtrees( pid );
+        shard.failed = true;
+      }
+    --shard.workers;
+    finish( shard );
+  };
+
+  auto spawn = [&]( Shard & shard )
+  {
+    pid_t pid = spawnShard( self, shard, pathsOnly );
+    if ( pid < 0 )
+      {
+        std::cerr << "scrape: fork: " << std::strerror( errno ) << std::endl;
+        shard.failed = true;
+        finish( shard );
+        return false;
+      }
+    ++shard.workers;
+    running.emplace( pid, & shard );
+    return true;
+  };
+
+  /* Once every shard has a worker, spare slots go to the shard with the most
+   * unclaimed sets, letting its workers share a large prefix. */
+  auto pickHelper = [&]() -> Shard *
+  {
+    Shard       * best          = nullptr;
+    std::size_t   bestUnclaimed = 0;
+    for ( Shard & shard : shards )
+      {
+        if ( shard.workers == 0 ) { continue; }
+        std::size_t open = shard.db->countOpenSubtrees( shard.subtree()
+                                                      , shard.system()
+                                                      , shard.stability()
+                                                      );
+        if ( open <= shard.workers ) { continue; }
+        if ( bestUnclaimed < ( open - shard.workers ) )
+          {
+            best          = & shard;
+            bestUnclaimed = open - shard.workers;
+          }
+      }
+    return best;
+  };
+
+  auto next = shards.begin();
+  while ( ( next != shards.end() ) || ( ! running.empty() ) )
+    {
+      while ( running.size() < jobs )
+        {
+          Shard * shard = nullptr;
+          if ( next != shards.end() )
+            {
+              shard = & ( * next++ );
+              /* Filling info doesn't use sets, so we leave them done to keep
+               * helpers from being started.
+               * Sets left by an interrupted run are resumed from their last
+               * checkpoint, otherwise we start over. */
+              if ( ( ! shard->fill ) &&
+                   ( shard->db->resumeSubtrees( shard->subtree()
+                                              , shard->system()
+                                              , shard->stability()
+                                              ) == 0 )
+                 )
+                {
+                  shard->db->resetSubtrees( shard->subtree()
+                                          , shard->system()
+                                          , shard->stability()
+                                          );
+                }
+            }
+          else
+            {
+              shard = pickHelper();
+            }
+          if ( ( shard == nullptr ) || ( ! spawn( * shard ) ) ) { break; }
+        }
+      if ( running.empty() ) { continue; }
+      /* With spare slots we poll, so that helpers can be started as workers
+       * discover new sets. */
+      if ( running.size() < jobs )
+        {
+          reap( false );
+          std::this_thread::sleep_for( std::chrono::milliseconds( 250 ) );
+        }
+      else
+        {
+          reap( true );
+        }
+    }
+
+  /* Snapshot each fully scraped input into a package index for readers.
+   * Inputs with failed prefixes are left for a later run to complete, as are
+   * those whose info hasn't been filled. */
+  for ( const auto & [id, db] : dbs )
+    {
+      if ( pathsOnly ) { break; }
+      bool complete = true;
+      bool changed  = false;
+      for ( const auto & [_, status] : rsl[id].items() )
+        {
+          if ( status == "failed" ) { complete = false; }
+          if ( status == "done" )   { changed  = true;  }
+        }
+      std::string path = getPackageIndexName( db->fingerprint );
+      if ( ( ! complete ) ||
+           ( ( ! changed ) && std::filesystem::exists( path ) )
+         )
+        {
+          continue;
+        }
+      try
+        {
+          writePackageIndex( * db, path );
+        }
+      catch( const std::exception & e )
+        {
+          std::cerr << "scrape: failed to write package index for '" << id
+                    << "': " << e.what() << std::endl;
+          ec = EXIT_FAILURE;
+        }
+    }
+
+  std::cout << rsl.dump() << std::endl;
+  return ec;
+}
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -0,0 +1,720 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "flox/exceptions.hh"
+#include "flox/drv-cache.hh"
+#include "flox/package-index.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+static const char pkgIndexMagic[8] = { 'F', 'L', 'O', 'X', 'F', 'P', 'I', 0 };
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::string
+getPackageIndexName( const nix::flake::Fingerprint & fingerprint )
+{
+  nix::Path cacheDir = nix::getCacheDir() + "/flox/drv-cache-v0";
+  std::string fpStr  = fingerprint.to_string( nix::Base16, false );
+  return cacheDir + "/" + fpStr + ".fpi";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Hashing used for the index's hash tables.
+ * These must never change without bumping `FLOX_PKGINDEX_VERSION'. */
+
+static constexpr uint64_t fnvOffset = 14695981039346656037ULL;
+static constexpr uint64_t fnvPrime  = 1099511628211ULL;
+
+  static inline uint64_t
+fnv1a( uint64_t h, const void * data, std::size_t size )
+{
+  const unsigned char * p = static_cast<const unsigned char *>( data );
+  for ( std::size_t i = 0; i < size; ++i )
+    {
+      h ^= p[i];
+      h *= fnvPrime;
+    }
+  return h;
+}
+
+/* The `splitmix64' finalizer. */
+  static inline uint64_t
+mix64( uint64_t x )
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+  static inline uint32_t
+bucketOf( uint64_t hash, uint32_t nBuckets )
+{
+  return mix64( hash ) % nBuckets;
+}
+
+  static inline uint32_t
+slotOf( uint64_t hash, uint32_t seed, uint32_t nSlots )
+{
+  return mix64( hash ^ ( seed * 0x9e3779b97f4a7c15ULL ) ) % nSlots;
+}
+
+/* Path components are terminated by a byte which can't appear in UTF-8. */
+template<typename Strings>
+  static inline uint64_t
+hashPath( uint32_t prefix, const Strings & path )
+{
+  uint64_t h = fnv1a( fnvOffset, & prefix, sizeof( prefix ) );
+  for ( const auto & p : path )
+    {
+      std::string_view s( p );
+      h = fnv1a( h, s.data(), s.size() );
+      h = fnv1a( h, "\xff", 1 );
+    }
+  return h;
+}
+
+  static inline uint64_t
+hashPname( uint32_t prefix, std::string_view pname )
+{
+  uint64_t h = fnv1a( fnvOffset, & prefix, sizeof( prefix ) );
+  return fnv1a( h, pname.data(), pname.size() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+PackageIndex::PackageIndex( const std::string & path )
+{
+  int fd = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+  if ( fd < 0 )
+    {
+      throw CacheException( "PackageIndex(): Failed to open '" + path + "'" );
+    }
+
+  struct stat st;
+  if ( ( fstat( fd, & st ) != 0 ) ||
+       ( (std::size_t) st.st_size < sizeof( Header ) )
+     )
+    {
+      close( fd );
+      throw CacheException( "PackageIndex(): Truncated index '" + path + "'" );
+    }
+
+  void * data = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+  if ( data == MAP_FAILED )
+    {
+      throw CacheException( "PackageIndex(): Failed to map '" + path + "'" );
+    }
+  this->_data   = static_cast<const char *>( data );
+  this->_size   = st.st_size;
+  this->_header = reinterpret_cast<const Header *>( this->_data );
+
+  const Header & h = * this->_header;
+  auto fits = [&]( uint64_t offset, uint64_t count, std::size_t size )
+  {
+    return ( offset <= this->_size ) &&
+           ( count <= ( ( this->_size - offset ) / size ) );
+  };
+  bool ok =
+    ( std::memcmp( h.magic, pkgIndexMagic, sizeof( pkgIndexMagic ) ) == 0 ) &&
+    ( h.version  == FLOX_PKGINDEX_VERSION ) &&
+    ( h.fileSize == this->_size ) &&
+    ( 0 < h.nPathBuckets ) && ( 0 < h.nPathSlots ) &&
+    ( 0 < h.nPnameBuckets ) && ( 0 < h.nPnameSlots ) &&
+    fits( h.prefixesOffset,   h.nPrefixes,     sizeof( Prefix ) ) &&
+    fits( h.recordsOffset,    h.nRecords,      sizeof( Record ) ) &&
+    fits( h.pathSeedsOffset,  h.nPathBuckets,  sizeof( uint32_t ) ) &&
+    fits( h.pathSlotsOffset,  h.nPathSlots,    sizeof( uint32_t ) ) &&
+    fits( h.pnameSeedsOffset, h.nPnameBuckets, sizeof( uint32_t ) ) &&
+    fits( h.pnameSlotsOffset, h.nPnameSlots,   sizeof( PnameSlot ) ) &&
+    ( h.strListsOffset <= this->_size ) &&
+    ( h.idsOffset      <= this->_size ) &&
+    ( h.stringsOffset  <= this->_size );
+  if ( ! ok )
+    {
+      munmap( data, this->_size );
+      throw CacheException(
+        "PackageIndex(): Invalid or outdated index '" + path + "'"
+      );
+    }
+}
+
+
+PackageIndex::~PackageIndex()
+{
+  if ( this->_data != nullptr )
+    {
+      munmap( const_cast<char *>( this->_data ), this->_size );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  uint32_t
+PackageIndex::findPrefix(       std::string_view                  subtree
+                        ,       std::string_view                  system
+                        , const std::optional<std::string_view> & stability
+                        ) const
+{
+  std::span<const Prefix> prefixes = this->getPrefixes();
+  for ( uint32_t i = 0; i < prefixes.size(); ++i )
+    {
+      const Prefix & p = prefixes[i];
+      if ( ( this->getString( p.subtree ) == subtree ) &&
+           ( this->getString( p.system ) == system ) &&
+           ( ( p.hasStability != 0 ) == stability.has_value() ) &&
+           ( ( ! stability.has_value() ) ||
+             ( this->getString( p.stability ) == stability.value() )
+           )
+         )
+        {
+          return i;
+        }
+    }
+  return npos;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  uint32_t
+PackageIndex::findRelPath(       uint32_t                      prefix
+                         , const std::list<std::string_view> & relPath
+                         ) const
+{
+  const Header & h    = * this->_header;
+  uint64_t       hash = hashPath( prefix, relPath );
+  uint32_t       seed = this->region<uint32_t>(
+    h.pathSeedsOffset, h.nPathBuckets
+  )[bucketOf( hash, h.nPathBuckets )];
+  uint32_t id = this->region<uint32_t>(
+    h.pathSlotsOffset, h.nPathSlots
+  )[slotOf( hash, seed, h.nPathSlots )];
+  if ( id == npos ) { return npos; }
+
+  /* Absent keys may land on any slot, so check the record's path. */
+  const Record & r = this->getRecord( id );
+  if ( ( r.prefix != prefix ) || ( r.path.size != relPath.size() ) )
+    {
+      return npos;
+    }
+  auto it = relPath.begin();
+  for ( const StrRef & s : this->getStrings( r.path ) )
+    {
+      if ( this->getString( s ) != * it ) { return npos; }
+      ++it;
+    }
+  return id;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::span<const uint32_t>
+PackageIndex::findPname( uint32_t prefix, std::string_view pname ) const
+{
+  const Header & h    = * this->_header;
+  uint64_t       hash = hashPname( prefix, pname );
+  uint32_t       seed = this->region<uint32_t>(
+    h.pnameSeedsOffset, h.nPnameBuckets
+  )[bucketOf( hash, h.nPnameBuckets )];
+  const PnameSlot & slot = this->region<PnameSlot>(
+    h.pnameSlotsOffset, h.nPnameSlots
+  )[slotOf( hash, seed, h.nPnameSlots )];
+  if ( ( slot.prefix != prefix ) || ( this->getString( slot.pname ) != pname ) )
+    {
+      return {};
+    }
+  return this->region<uint32_t>(
+    h.idsOffset + ( slot.ids.offset * sizeof( uint32_t ) )
+  , slot.ids.size
+  );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::vector<std::string>
+IndexedPackage::getStrings( PackageIndex::ListRef l ) const
+{
+  std::vector<std::string> rsl;
+  rsl.reserve( l.size );
+  for ( const PackageIndex::StrRef & s : this->_index->getStrings( l ) )
+    {
+      rsl.emplace_back( this->_index->getString( s ) );
+    }
+  return rsl;
+}
+
+
+  std::vector<std::string>
+IndexedPackage::getPathStrs() const
+{
+  const PackageIndex::Prefix & p =
+    this->_index->getPrefixes()[this->_record->prefix];
+  std::vector<std::string> rsl;
+  rsl.reserve( 3 + this->_record->path.size );
+  rsl.emplace_back( this->_index->getString( p.subtree ) );
+  rsl.emplace_back( this->_index->getString( p.system ) );
+  if ( p.hasStability != 0 )
+    {
+      rsl.emplace_back( this->_index->getString( p.stability ) );
+    }
+  for ( const PackageIndex::StrRef & s :
+          this->_index->getStrings( this->_record->path )
+      )
+    {
+      rsl.emplace_back( this->_index->getString( s ) );
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Assign each key a distinct slot using "hash and displace".
+ * Keys are grouped into buckets, and starting with the largest bucket we
+ * search for a seed which places all of a bucket's keys in free slots.
+ * @return `false` if some bucket could not be placed, in which case the
+ *         caller should retry with more slots.
+ */
+  static bool
+buildPerfectHash( const std::vector<uint64_t> & hashes
+                ,       uint32_t                nBuckets
+                ,       uint32_t                nSlots
+                ,       std::vector<uint32_t> & seeds
+                ,       std::vector<uint32_t> & slots
+                )
+{
+  std::vector<std::vector<uint32_t>> buckets( nBuckets );
+  for ( uint32_t i = 0; i < hashes.size(); ++i )
+    {
+      buckets[bucketOf( hashes[i], nBuckets )].push_back( i );
+    }
+
+  std::vector<uint32_t> order( nBuckets );
+  std::iota( order.begin(), order.end(), 0 );
+  std::stable_sort( order.begin(), order.end()
+                  , [&]( uint32_t a, uint32_t b )
+                    {
+                      return buckets[b].size() < buckets[a].size();
+                    }
+                  );
+
+  seeds.assign( nBuckets, 0 );
+  slots.assign( nSlots, PackageIndex::npos );
+  std::vector<uint32_t> placed;
+  for ( uint32_t b : order )
+    {
+      if ( buckets[b].empty() ) { break; }
+      bool ok = false;
+      for ( uint32_t seed = 1; ( ! ok ) && ( seed < ( 1 << 16 ) ); ++seed )
+        {
+          placed.clear();
+          ok = true;
+          for ( uint32_t k : buckets[b] )
+            {
+              uint32_t s = slotOf( hashes[k], seed, nSlots );
+              if ( ( slots[s] != PackageIndex::npos ) ||
+                   ( std::find( placed.begin(), placed.end(), s ) !=
+                     placed.end()
+                   )
+                 )
+                {
+                  ok = false;
+                  break;
+                }
+              placed.push_back( s );
+            }
+          if ( ok )
+            {
+              for ( std::size_t j = 0; j < placed.size(); ++j )
+                {
+                  slots[placed[j]] = buckets[b][j];
+                }
+              seeds[b] = seed;
+            }
+        }
+      if ( ! ok ) { return false; }
+    }
+  return true;
+}
+
+
+/**
+ * Build a perfect hash table, growing it until every key can be placed.
+ * @return The number of slots used.
+ */
+  static uint32_t
+buildPerfectHash( const std::vector<uint64_t> & hashes
+                ,       std::vector<uint32_t> & seeds
+                ,       std::vector<uint32_t> & slots
+                )
+{
+  uint32_t n        = hashes.size();
+  uint32_t nBuckets = std::max( 1u, ( n + 3 ) / 4 );
+  uint32_t nSlots   = std::max( 1u, n + ( n / 4 ) );
+  for ( int attempt = 0; attempt < 8; ++attempt )
+    {
+      if ( buildPerfectHash( hashes, nBuckets, nSlots, seeds, slots ) )
+        {
+          return nSlots;
+        }
+      nSlots += std::max( 1u, nSlots / 2 );
+    }
+  throw CacheException( "writePackageIndex(): Failed to build hash table" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Accumulates the contents of an index before it is written. */
+struct PackageIndexBuilder {
+  std::string                                       strings;
+  std::unordered_map<std::string, PackageIndex::StrRef> interned;
+  std::vector<PackageIndex::StrRef>                 strLists;
+  std::vector<uint32_t>                             ids;
+  std::vector<PackageIndex::Prefix>                 prefixes;
+  std::vector<PackageIndex::Record>                 records;
+
+    PackageIndex::StrRef
+  intern( std::string_view s )
+  {
+    auto [it, inserted] = this->interned.try_emplace(
+      std::string( s )
+    , PackageIndex::StrRef { (uint32_t) this->strings.size()
+                           , (uint32_t) s.size()
+                           }
+    );
+    if ( inserted ) { this->strings.append( s ); }
+    return it->second;
+  }
+
+  template<typename Strings>
+    PackageIndex::ListRef
+  internList( const Strings & ss )
+  {
+    PackageIndex::ListRef l { (uint32_t) this->strLists.size(), 0 };
+    for ( const auto & s : ss )
+      {
+        this->strLists.push_back( this->intern( s ) );
+        ++l.size;
+      }
+    return l;
+  }
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+template<typename T>
+  static void
+writeRegion( std::ofstream & out, const std::vector<T> & v )
+{
+  out.write( reinterpret_cast<const char *>( v.data() )
+           , v.size() * sizeof( T )
+           );
+  /* Keep every region 8 byte aligned. */
+  static const char pad[8] = {};
+  std::size_t       rem    = ( v.size() * sizeof( T ) ) % 8;
+  if ( rem != 0 ) { out.write( pad, 8 - rem ); }
+}
+
+template<typename T>
+  static uint64_t
+regionSize( const std::vector<T> & v )
+{
+  uint64_t size = v.size() * sizeof( T );
+  return size + ( ( 8 - ( size % 8 ) ) % 8 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+writePackageIndex( DrvDb & db, const std::string & path )
+{
+  PackageIndexBuilder b;
+
+  /* Rows are ordered by prefix, so each prefix's records are contiguous.
+   * Only complete prefixes are indexed, so readers may trust any prefix
+   * they find. */
+  {
+    nix::SQLiteStmt::Use query = db.useAllDrvInfos();
+    std::optional<std::string> subtree;
+    std::optional<std::string> system;
+    std::optional<std::string> stability;
+    bool                       complete = false;
+    while ( query.next() )
+      {
+        std::optional<std::string> stab;
+        if ( ! query.isNull( ADI_STABILITY ) )
+          {
+            stab = query.getStr( ADI_STABILITY );
+          }
+        if ( ( ! subtree.has_value() ) ||
+             ( query.getStr( ADI_SUBTREE ) != subtree.value() ) ||
+             ( query.getStr( ADI_SYSTEM ) != system.value() ) ||
+             ( stab != stability )
+           )
+          {
+            subtree   = query.getStr( ADI_SUBTREE );
+            system    = query.getStr( ADI_SYSTEM );
+            stability = std::move( stab );
+            complete  =
+              DBPS_INFO_DONE <= db.getProgress( subtree.value()
+                                              , system.value()
+                                              , stability
+                                              );
+            if ( complete )
+              {
+                b.prefixes.push_back( PackageIndex::Prefix {
+                  b.intern( subtree.value() )
+                , b.intern( system.value() )
+                , b.intern( stability.value_or( "" ) )
+                , stability.has_value() ? 1u : 0u
+                , (uint32_t) b.records.size()
+                , 0
+                } );
+              }
+          }
+        if ( ! complete ) { continue; }
+
+        std::vector<std::string> relPath =
+          nlohmann::json::parse( query.getStr( ADI_PATH ) );
+        /* Catalog paths begin with their stability, which is held by
+         * the prefix. */
+        if ( stability.has_value() && ( ! relPath.empty() ) )
+          {
+            relPath.erase( relPath.begin() );
+          }
+
+        uint32_t flags = 0;
+        auto optStr = [&]( int col, uint32_t flag )
+        {
+          if ( query.isNull( col ) ) { return PackageIndex::StrRef { 0, 0 }; }
+          flags |= flag;
+          return b.intern( query.getStr( col ) );
+        };
+        auto optBool = [&]( int col, uint32_t hasFlag, uint32_t flag )
+        {
+          if ( query.isNull( col ) ) { return; }
+          flags |= hasFlag;
+          if ( query.getInt( col ) != 0 ) { flags |= flag; }
+        };
+
+        PackageIndex::Record r;
+        r.prefix   = b.prefixes.size() - 1;
+        r.path     = b.internList( relPath );
+        r.fullName = b.intern( query.getStr( ADI_FULL_NAME ) );
+        r.pname    = b.intern( query.getStr( ADI_PNAME ) );
+        r.version  = optStr( ADI_VERSION, PackageIndex::PF_VERSION );
+        r.semver   = optStr( ADI_SEMVER,  PackageIndex::PF_SEMVER );
+        r.license  = optStr( ADI_LICENSE, PackageIndex::PF_LICENSE );
+        r.outputs  = b.internList(
+          nlohmann::json::parse( query.getStr( ADI_OUTPUTS ) )
+            .get<std::vector<std::string>>()
+        );
+        r.outputsToInstall = b.internList(
+          nlohmann::json::parse( query.getStr( ADI_OUTPUTS_TO_INSTALL ) )
+            .get<std::vector<std::string>>()
+        );
+        optBool( ADI_BROKEN
+               , PackageIndex::PF_HAS_BROKEN
+               , PackageIndex::PF_BROKEN
+               );
+        optBool( ADI_UNFREE
+               , PackageIndex::PF_HAS_UNFREE
+               , PackageIndex::PF_UNFREE
+               );
+        if ( query.getInt( ADI_HAS_META_ATTR ) != 0 )
+          {
+            flags |= PackageIndex::PF_META_ATTR;
+          }
+        if ( query.getInt( ADI_HAS_PNAME_ATTR ) != 0 )
+          {
+            flags |= PackageIndex::PF_PNAME_ATTR;
+          }
+        if ( query.getInt( ADI_HAS_VERSION_ATTR ) != 0 )
+          {
+            flags |= PackageIndex::PF_VERSION_ATTR;
+          }
+        r.flags = flags;
+
+        b.records.push_back( r );
+        ++b.prefixes.back().count;
+      }
+  }
+
+  /* Attribute path table. */
+  std::vector<uint64_t> pathHashes;
+  pathHashes.reserve( b.records.size() );
+  for ( const PackageIndex::Record & r : b.records )
+    {
+      std::vector<std::string_view> relPath;
+      for ( uint32_t i = 0; i < r.path.size; ++i )
+        {
+          PackageIndex::StrRef s = b.strLists[r.path.offset + i];
+          relPath.emplace_back( b.strings.data() + s.offset, s.size );
+        }
+      pathHashes.push_back( hashPath( r.prefix, relPath ) );
+    }
+  std::vector<uint32_t> pathSeeds;
+  std::vector<uint32_t> pathSlots;
+  buildPerfectHash( pathHashes, pathSeeds, pathSlots );
+
+  /* `pname' table, holding lists of record ids. */
+  std::vector<PackageIndex::PnameSlot>   pnames;
+  std::unordered_map<uint64_t, uint32_t> pnameIdx;
+  std::vector<std::vector<uint32_t>>     pnameIds;
+  std::vector<uint64_t>                  pnameHashes;
+  for ( uint32_t id = 0; id < b.records.size(); ++id )
+    {
+      const PackageIndex::Record & r = b.records[id];
+      /* Interned strings share offsets, so they identify a `pname'. */
+      uint64_t key = ( (uint64_t) r.prefix << 32 ) | r.pname.offset;
+      auto [it, inserted] = pnameIdx.try_emplace( key, pnames.size() );
+      if ( inserted )
+        {
+          pnames.push_back( PackageIndex::PnameSlot { r.prefix, r.pname, {} } );
+          pnameIds.emplace_back();
+          pnameHashes.push_back( hashPname(
+            r.prefix
+          , std::string_view( b.strings.data() + r.pname.offset, r.pname.size )
+          ) );
+        }
+      pnameIds[it->second].push_back( id );
+    }
+  for ( std::size_t i = 0; i < pnames.size(); ++i )
+    {
+      pnames[i].ids = PackageIndex::ListRef { (uint32_t) b.ids.size()
+                                            , (uint32_t) pnameIds[i].size()
+                                            };
+      b.ids.insert( b.ids.end(), pnameIds[i].begin(), pnameIds[i].end() );
+    }
+  std::vector<uint32_t> pnameSeeds;
+  std::vector<uint32_t> pnameSlotIdx;
+  buildPerfectHash( pnameHashes, pnameSeeds, pnameSlotIdx );
+  std::vector<PackageIndex::PnameSlot> pnameSlots;
+  pnameSlots.reserve( pnameSlotIdx.size() );
+  for ( uint32_t i : pnameSlotIdx )
+    {
+      if ( i == PackageIndex::npos )
+        {
+          pnameSlots.push_back(
+            PackageIndex::PnameSlot { PackageIndex::npos, { 0, 0 }, { 0, 0 } }
+          );
+        }
+      else
+        {
+          pnameSlots.push_back( pnames[i] );
+        }
+    }
+
+  /* Lay out regions after the header. */
+  PackageIndex::Header h;
+  std::memset( & h, 0, sizeof( h ) );
+  std::memcpy( h.magic, pkgIndexMagic, sizeof( pkgIndexMagic ) );
+  h.version       = FLOX_PKGINDEX_VERSION;
+  h.nPrefixes     = b.prefixes.size();
+  h.nRecords      = b.records.size();
+  h.nPathBuckets  = pathSeeds.size();
+  h.nPathSlots    = pathSlots.size();
+  h.nPnameBuckets = pnameSeeds.size();
+  h.nPnameSlots   = pnameSlots.size();
+
+  uint64_t offset = sizeof( PackageIndex::Header );
+  offset += ( 8 - ( offset % 8 ) ) % 8;
+  h.prefixesOffset   = offset; offset += regionSize( b.prefixes );
+  h.recordsOffset    = offset; offset += regionSize( b.records );
+  h.strListsOffset   = offset; offset += regionSize( b.strLists );
+  h.idsOffset        = offset; offset += regionSize( b.ids );
+  h.pathSeedsOffset  = offset; offset += regionSize( pathSeeds );
+  h.pathSlotsOffset  = offset; offset += regionSize( pathSlots );
+  h.pnameSeedsOffset = offset; offset += regionSize( pnameSeeds );
+  h.pnameSlotsOffset = offset; offset += regionSize( pnameSlots );
+  h.stringsOffset    = offset; offset += b.strings.size();
+  h.fileSize         = offset;
+
+  std::filesystem::path p( path );
+  if ( ! std::filesystem::exists( p.parent_path() ) )
+    {
+      std::filesystem::create_directories( p.parent_path() );
+    }
+  std::string tmp = path + ".tmp." + std::to_string( getpid() );
+  {
+    std::ofstream out( tmp, std::ios::binary | std::ios::trunc );
+    out.write( reinterpret_cast<const char *>( & h ), sizeof( h ) );
+    static const char pad[8] = {};
+    out.write( pad, h.prefixesOffset - sizeof( h ) );
+    writeRegion( out, b.prefixes );
+    writeRegion( out, b.records );
+    writeRegion( out, b.strLists );
+    writeRegion( out, b.ids );
+    writeRegion( out, pathSeeds );
+    writeRegion( out, pathSlots );
+    writeRegion( out, pnameSeeds );
+    writeRegion( out, pnameSlots );
+    out.write( b.strings.data(), b.strings.size() );
+    if ( ! out )
+      {
+        std::filesystem::remove( tmp );
+        throw CacheException(
+          "writePackageIndex(): Failed to write '" + tmp + "'"
+        );
+      }
+  }
+  std::filesystem::rename( tmp, p );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+writePackageIndex( DrvDb & db )
+{
+  writePackageIndex( db, getPackageIndexName( db.fingerprint ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
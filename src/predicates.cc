@@ -7,6 +7,7 @@
 #include <string>
 #include <functional>
 #include <vector>
+#include <memory>
 #include "flox/predicates.hh"
 #include "flox/package.hh"
 #include "semver.hh"
@@ -85,12 +86,25 @@ hasVersion( const std::string & version )
   PkgPred
 satisfiesSemver( const std::string & range )
 {
-  return (PkgPred::pred_fn) [range]( const Package & p )
+  /* Compile the range once rather than for every package. */
+  std::optional<versions::SemverRange> compiled =
+    versions::SemverRange::parse( range, true, true );
+  if ( ! compiled.has_value() )
+    {
+      return (PkgPred::pred_fn) []( const Package & ) { return false; };
+    }
+  std::shared_ptr<const versions::SemverRange> r =
+    std::make_shared<const versions::SemverRange>(
+      std::move( compiled.value() )
+    );
+  return (PkgPred::pred_fn) [r]( const Package & p )
   {
-    if ( ! p.getSemver().has_value() ) { return false; }
-    std::list<std::string> vs;
-    vs.push_back( p.getSemver().value() );
-    return ! versions::semverSat( range, vs ).empty();
+    std::optional<std::string> version = p.getSemver();
+    if ( ! version.has_value() ) { return false; }
+    /* Matches `semverSat', which only considers strictly valid versions. */
+    std::optional<versions::Semver> sv =
+      versions::parseSemver( version.value(), false );
+    return sv.has_value() && r->test( sv.value() );
   };
 }
 
@@ -10,6 +10,7 @@
 #include <optional>
 #include <nlohmann/json.hpp>
 #include "resolve.hh"
+#include "flox/drv-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -184,6 +185,33 @@ Preferences::pred_V2() const
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  DrvInfoFilter
+Preferences::filter_V2() const
+{
+  DrvInfoFilter rsl;
+  if ( this->allowUnfree &&
+       this->allowBroken &&
+       ( ! this->allowedLicenses.has_value() )
+     )
+    {
+      return rsl;
+    }
+  rsl.requireMeta   = true;
+  rsl.excludeUnfree = ! this->allowUnfree;
+  rsl.excludeBroken = ! this->allowBroken;
+  if ( this->allowedLicenses.has_value() )
+    {
+      rsl.licenses = std::vector<std::string>(
+        this->allowedLicenses.value().begin()
+      , this->allowedLicenses.value().end()
+      );
+    }
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   void
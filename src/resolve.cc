@@ -4,7 +4,17 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <nix/fetchers.hh>
 #include "resolve.hh"
+#include "flox/result-cache.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -14,18 +24,324 @@ namespace flox {
 
 /* -------------------------------------------------------------------------- */
 
-  std::list<Resolved>
-resolve_V2( ResolverState & rs, const Descriptor & desc, bool one )
+/**
+ * Input names ordered by `Preferences::compareInputs', being their rank in
+ * `Preferences::inputs' with unlisted inputs following.
+ */
+  static std::vector<std::string>
+rankInputs( const ResolverState & rs )
+{
+  Preferences                                       prefs =
+    rs.getPreferences();
+  std::vector<std::pair<std::string, FloxFlakeRef>> ids;
+  for ( const std::string_view & id : rs.getInputNames() )
+    {
+      ids.emplace_back( id, rs.getInput( id ).value()->getLockedFlakeRef() );
+    }
+  std::stable_sort( ids.begin(), ids.end()
+                  , [&]( const auto & a, const auto & b )
+                    {
+                      return prefs.compareInputs( a.first, a.second
+                                                , b.first, b.second
+                                                ) < 0;
+                    }
+                  );
+  std::vector<std::string> rsl;
+  for ( auto & [id, _] : ids ) { rsl.push_back( std::move( id ) ); }
+  return rsl;
+}
+
+
+/**
+ * Resolve @a desc in a single input.
+ * With @a one only the best result is searched for.
+ */
+  static std::list<Resolved>
+resolveIn(       ResolverState    & rs
+         ,       std::string_view   id
+         , const Descriptor       & desc
+         ,       bool               one
+         )
+{
+  if ( ! one ) { return rs.resolveInInput( id, desc ); }
+  std::optional<Resolved> rsl = rs.resolveOneInInput( id, desc );
+  if ( ! rsl.has_value() ) { return {}; }
+  return { rsl.value() };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** A child process resolving a descriptor in a single input. */
+struct ResolveWorker {
+  pid_t                              pid = -1;
+  int                                fd  = -1;
+  std::string                        out;
+  /** Set once the input is resolved, by the worker or as a fallback. */
+  std::optional<std::list<Resolved>> results;
+};
+
+
+/**
+ * Start a worker to resolve @a desc in input @a id.
+ *
+ * `nix' evaluators can't be shared between threads, and store connections,
+ * caches, and the garbage collector can't be shared across `fork', so the
+ * worker executes `ResolverState::getWorkerProgram' afresh with our locked
+ * reference for the input.
+ * Results are written to a pipe as JSON.
+ * @return `false' if the worker could not be started.
+ */
+  static bool
+spawnResolveWorker(       ResolverState & rs
+                  , const std::string   & id
+                  , const Descriptor    & desc
+                  ,       bool            one
+                  ,       ResolveWorker & w
+                  )
+{
+  if ( ! rs.getWorkerProgram().has_value() ) { return false; }
+  const std::string & program = rs.getWorkerProgram().value();
+
+  /* Everything the child needs is prepared before `fork', since it may only
+   * make async-signal-safe calls before `exec'. */
+  nix::ref<FloxFlake> flake  = rs.getInput( id ).value();
+  std::string         inputs = nlohmann::json { {
+    id, nix::fetchers::attrsToJSON( flake->getLockedFlakeRef().toAttrs() )
+  } }.dump();
+  std::string prefs   = rs.getPreferences().toJSON().dump();
+  std::string systems = nlohmann::json( flake->getSystems() ).dump();
+  std::string descStr = desc.toJSON().dump();
+
+  int fds[2];
+  if ( pipe( fds ) != 0 ) { return false; }
+  pid_t pid = fork();
+  if ( pid < 0 )
+    {
+      close( fds[0] );
+      close( fds[1] );
+      return false;
+    }
+
+  if ( pid == 0 )
+    {
+      close( fds[0] );
+      if ( dup2( fds[1], STDOUT_FILENO ) < 0 ) { _exit( 127 ); }
+      close( fds[1] );
+      execl( program.c_str(), program.c_str(), "--worker"
+           , "--inputs", inputs.c_str()
+           , "--preferences", prefs.c_str()
+           , "--systems", systems.c_str()
+           , "--descriptor", descStr.c_str()
+           , one ? "--one" : (char *) nullptr
+           , (char *) nullptr
+           );
+      _exit( 127 );
+    }
+
+  close( fds[1] );
+  w.pid = pid;
+  w.fd  = fds[0];
+  return true;
+}
+
+
+/**
+ * Collect the output of a worker whose pipe has closed.
+ * @return `false' if the worker failed.
+ */
+  static bool
+finishResolveWorker( ResolveWorker & w )
+{
+  close( w.fd );
+  w.fd = -1;
+  int status = 0;
+  while ( ( waitpid( w.pid, & status, 0 ) < 0 ) && ( errno == EINTR ) ) {}
+  w.pid = -1;
+  if ( ! ( WIFEXITED( status ) && ( WEXITSTATUS( status ) == 0 ) ) )
+    {
+      return false;
+    }
+  try
+    {
+      std::list<Resolved> results;
+      for ( const nlohmann::json & r : nlohmann::json::parse( w.out ) )
+        {
+          results.emplace_back( r );
+        }
+      w.results = std::move( results );
+      return true;
+    }
+  catch( ... )
+    {
+      return false;
+    }
+}
+
+
+/** Kill and reap a worker if it is still running. */
+  static void
+cancelResolveWorker( ResolveWorker & w )
+{
+  if ( w.pid < 0 ) { return; }
+  kill( w.pid, SIGKILL );
+  close( w.fd );
+  w.fd = -1;
+  while ( ( waitpid( w.pid, nullptr, 0 ) < 0 ) && ( errno == EINTR ) ) {}
+  w.pid = -1;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Get the locked inputs and systems which results depend on. */
+  static nlohmann::json
+lockedInputsJSON( const ResolverState & rs )
+{
+  nlohmann::json inputs = nlohmann::json::object();
+  for ( auto & [id, flake] : rs.getInputs() )
+    {
+      inputs.emplace( id, nlohmann::json {
+        { "locked"
+        , nix::fetchers::attrsToJSON( flake->getLockedFlakeRef().toAttrs() )
+        }
+      , { "systems", flake->getSystems() }
+      } );
+    }
+  return inputs;
+}
+
+
+/**
+ * Get the result cache key for resolving @a desc.
+ * @param inputs Locked inputs, as returned by `lockedInputsJSON'.
+ * @param mode Distinguishes ways of resolving which may produce different
+ *             results for the same descriptor.
+ */
+  static std::string
+resultCacheKey( const ResolverState    & rs
+              , const nlohmann::json   & inputs
+              , const Descriptor       & desc
+              ,       std::string_view   mode
+              )
+{
+  return getResultCacheKey( {
+    { "version",     FLOX_RESOLVER_VERSION         }
+  , { "mode",        mode                          }
+  , { "descriptor",  desc.toJSON()                 }
+  , { "inputs",      inputs                        }
+  , { "preferences", rs.getPreferences().toJSON()  }
+  } );
+}
+
+
+/** Parse results held in the result cache. */
+  static std::list<Resolved>
+resultsFromJSON( const nlohmann::json & j )
+{
+  std::list<Resolved> results;
+  for ( const nlohmann::json & r : j ) { results.emplace_back( r ); }
+  return results;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static std::list<Resolved>
+resolveUncached( ResolverState & rs, const Descriptor & desc, bool one )
 {
   /* See if we can take shortcuts with this descriptor. */
   if ( desc.inputId.has_value() )
     {
-      return rs.resolveInInput( desc.inputId.value(), desc );
+      return resolveIn( rs, desc.inputId.value(), desc, one );
     }
+
+  std::vector<std::string>   ids  = rankInputs( rs );
+  std::size_t                jobs = std::min( rs.getJobs(), ids.size() );
+  std::vector<ResolveWorker> workers( ids.size() );
+
+  /* With `one' the best input with a result wins, which is decided once it
+   * and every input ranked above it have finished. */
+  auto decided = [&]()
+  {
+    for ( const ResolveWorker & w : workers )
+      {
+        if ( ! w.results.has_value() ) { return false; }
+        if ( ! w.results.value().empty() ) { return true; }
+      }
+    return true;
+  };
+
+  std::size_t next    = 0;
+  std::size_t running = 0;
+  while ( ! ( one ? decided() : ( ( next == ids.size() ) && ( running == 0 ) )
+            )
+        )
+    {
+      /* Start workers, resolving inputs in this process if we can't. */
+      while ( ( running < jobs ) && ( next < ids.size() ) )
+        {
+          if ( ( 1 < jobs ) &&
+               spawnResolveWorker( rs, ids[next], desc, one, workers[next] )
+             )
+            {
+              ++running;
+            }
+          else
+            {
+              workers[next].results =
+                resolveIn( rs, ids[next], desc, one );
+            }
+          ++next;
+          if ( one && decided() ) { break; }
+        }
+      if ( running == 0 ) { continue; }
+
+      std::vector<struct pollfd> fds;
+      std::vector<std::size_t>   idxs;
+      for ( std::size_t i = 0; i < workers.size(); ++i )
+        {
+          if ( workers[i].fd < 0 ) { continue; }
+          fds.push_back( { workers[i].fd, POLLIN, 0 } );
+          idxs.push_back( i );
+        }
+      if ( poll( fds.data(), fds.size(), -1 ) < 0 )
+        {
+          if ( errno == EINTR ) { continue; }
+          std::string err = std::strerror( errno );
+          for ( ResolveWorker & w : workers ) { cancelResolveWorker( w ); }
+          throw ResolverException( "resolve: poll: " + err );
+        }
+
+      for ( std::size_t j = 0; j < fds.size(); ++j )
+        {
+          if ( fds[j].revents == 0 ) { continue; }
+          ResolveWorker & w = workers[idxs[j]];
+          char            buf[4096];
+          ssize_t         n = read( w.fd, buf, sizeof( buf ) );
+          if ( ( n < 0 ) && ( errno == EINTR ) ) { continue; }
+          if ( 0 < n )
+            {
+              w.out.append( buf, n );
+              continue;
+            }
+          --running;
+          if ( ! finishResolveWorker( w ) )
+            {
+              w.results = resolveIn( rs, ids[idxs[j]], desc, one );
+            }
+        }
+    }
+
+  /* Cancel workers whose results can no longer be used. */
+  for ( ResolveWorker & w : workers ) { cancelResolveWorker( w ); }
+
+  /* Merge in order of preference. */
   std::list<Resolved> results;
-  for ( const std::string_view & id : rs.getInputNames() )
+  for ( ResolveWorker & w : workers )
     {
-      results.splice( results.end(), rs.resolveInInput( id, desc ) );
+      if ( ! w.results.has_value() ) { break; }
+      results.splice( results.end(), w.results.value() );
       if ( one && ( ! results.empty() ) )
         {
           results.erase( ++results.begin(), results.end() );
@@ -36,6 +352,26 @@ resolve_V2( ResolverState & rs, const Descriptor & desc, bool one )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  std::list<Resolved>
+resolve_V2( ResolverState & rs, const Descriptor & desc, bool one )
+{
+  ResultCache * cache = rs.getResultCache();
+  if ( cache == nullptr ) { return resolveUncached( rs, desc, one ); }
+
+  std::string key =
+    resultCacheKey( rs, lockedInputsJSON( rs ), desc, one ? "one" : "all" );
+  if ( std::optional<nlohmann::json> hit = cache->get( key ) )
+    {
+      return resultsFromJSON( hit.value() );
+    }
+  std::list<Resolved> results = resolveUncached( rs, desc, one );
+  cache->put( key, results );
+  return results;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::optional<Resolved>
@@ -47,6 +383,97 @@ resolveOne_V2( ResolverState & rs, const Descriptor & desc )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  std::vector<std::list<Resolved>>
+resolveBatch_V2(       ResolverState           & rs
+               , const std::vector<Descriptor> & descs
+               ,       bool                      one
+               )
+{
+  std::vector<std::list<Resolved>> results( descs.size() );
+
+  /* Take what we can from the result cache. */
+  ResultCache *            cache = rs.getResultCache();
+  std::vector<std::string> keys( descs.size() );
+  std::vector<bool>        cached( descs.size(), false );
+  if ( cache != nullptr )
+    {
+      nlohmann::json inputs = lockedInputsJSON( rs );
+      for ( std::size_t i = 0; i < descs.size(); ++i )
+        {
+          /* With `one' batches find the same results as `resolve_V2'. */
+          keys[i] = resultCacheKey( rs, inputs, descs[i]
+                                  , one ? "one" : "all"
+                                  );
+          if ( std::optional<nlohmann::json> hit = cache->get( keys[i] ) )
+            {
+              results[i] = resultsFromJSON( hit.value() );
+              cached[i]  = true;
+            }
+        }
+    }
+
+  for ( const std::string & id : rankInputs( rs ) )
+    {
+      /* With `one' we only search for descriptors without a result. */
+      std::vector<Descriptor>  pending;
+      std::vector<std::size_t> idxs;
+      for ( std::size_t i = 0; i < descs.size(); ++i )
+        {
+          if ( cached[i] ) { continue; }
+          if ( one && ( ! results[i].empty() ) ) { continue; }
+          if ( descs[i].inputId.has_value() &&
+               ( descs[i].inputId.value() != id )
+             )
+            {
+              continue;
+            }
+          pending.push_back( descs[i] );
+          idxs.push_back( i );
+        }
+      if ( pending.empty() ) { continue; }
+
+      /* The best result must be found by the same ranked search as
+       * `resolveOne_V2', which the merged results of a batch walk don't
+       * preserve. */
+      std::vector<std::list<Resolved>> rsl;
+      if ( one )
+        {
+          for ( const Descriptor & desc : pending )
+            {
+              rsl.push_back( resolveIn( rs, id, desc, true ) );
+            }
+        }
+      else
+        {
+          rsl = rs.resolveBatchInInput( id, pending );
+        }
+      for ( std::size_t j = 0; j < idxs.size(); ++j )
+        {
+          results[idxs[j]].splice( results[idxs[j]].end(), rsl[j] );
+        }
+    }
+
+  if ( one )
+    {
+      for ( std::list<Resolved> & rsl : results )
+        {
+          if ( ! rsl.empty() ) { rsl.erase( ++rsl.begin(), rsl.end() ); }
+        }
+    }
+
+  if ( cache != nullptr )
+    {
+      for ( std::size_t i = 0; i < descs.size(); ++i )
+        {
+          if ( ! cached[i] ) { cache->put( keys[i], results[i] ); }
+        }
+    }
+  return results;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   void
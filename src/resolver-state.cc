@@ -19,7 +19,10 @@
 #include <map>
 #include "flox/predicates.hh"
 #include <queue>
+#include <algorithm>
+#include <thread>
 #include "flox/drv-cache.hh"
+#include "flox/index-package-set.hh"
 #include "flox/flake-package.hh"
 
 
@@ -30,13 +33,16 @@ namespace flox {
 
 /* -------------------------------------------------------------------------- */
 
-ResolverState::ResolverState(
-  const Inputs                 & inputs
-, const Preferences            & prefs
-, const std::list<std::string> & systems
-)
-: _prefs( prefs )
+/**
+ * Initialize `nix' the first time that a store or evaluator is needed.
+ * Resolutions answered by caches never need either, and skip this cost.
+ */
+  static void
+initNixOnce()
 {
+  static bool initialized = false;
+  if ( initialized ) { return; }
+  initialized = true;
   /* Increase the default stack size. This aligns with `nix' new CLI usage. */
   nix::setStackSize( 64 * 1024 * 1024 );
   nix::initNix();
@@ -45,25 +51,48 @@ ResolverState::ResolverState(
   nix::evalSettings.enableImportFromDerivation.setDefault( false );
   nix::evalSettings.pureEval.setDefault( true );
   nix::evalSettings.useEvalCache.setDefault( true );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+ResolverState::ResolverState(
+  const Inputs                 & inputs
+, const Preferences            & prefs
+, const std::list<std::string> & systems
+)
+: _prefs( prefs )
+{
+  /* The lock cache only saves time, so we carry on without it. */
+  try
+    {
+      this->_lockCache = std::make_shared<LockCache>();
+    }
+  catch( ... )
+    {
+    }
 
+  EvalStateGetter getState = [this]() { return this->getEvalState(); };
   for ( auto & id : inputs.getInputNames() )
     {
 #if HAVE_BOEHMGC
       this->_inputs.emplace( id, std::allocate_shared<FloxFlake>(
         traceable_allocator<FloxFlake>()
-      , this->getEvalState()
+      , getState
       , id
       , inputs.get( id )
       , this->_prefs
       , systems
+      , this->_lockCache
       ) );
 #else
       this->_inputs.emplace( id, std::make_shared<FloxFlake>(
-        this->getEvalState()
+        getState
       , id
-      , ref
+      , inputs.get( id )
       , this->_prefs
       , systems
+      , this->_lockCache
       ) );
 #endif
     }
@@ -75,7 +104,11 @@ ResolverState::ResolverState(
   nix::ref<nix::Store>
 ResolverState::getStore()
 {
-  if ( this->_store == nullptr ) { this->_store = nix::openStore(); }
+  if ( this->_store == nullptr )
+    {
+      initNixOnce();
+      this->_store = nix::openStore();
+    }
   return nix::ref<nix::Store>( this->_store );
 }
 
@@ -97,6 +130,7 @@ ResolverState::getEvalState()
 {
   if ( this->evalState == nullptr )
     {
+      initNixOnce();
 #if HAVE_BOEHMGC
       this->evalState = std::allocate_shared<nix::EvalState>(
         traceable_allocator<nix::EvalState>()
@@ -127,6 +161,46 @@ ResolverState::getSymbolTable()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  std::size_t
+ResolverState::getJobs() const
+{
+  if ( 0 < this->_jobs ) { return this->_jobs; }
+  return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+ResolverState::setLockCacheTTL( uint64_t ttl )
+{
+  if ( this->_lockCache != nullptr ) { this->_lockCache->setTTL( ttl ); }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  ResultCache *
+ResolverState::getResultCache()
+{
+  if ( ( this->_resultCache == nullptr ) && this->_useResultCache )
+    {
+      try
+        {
+          this->_resultCache = std::make_unique<ResultCache>();
+        }
+      catch( ... )
+        {
+          /* Resolution works without a cache, so don't try again. */
+          this->_useResultCache = false;
+        }
+    }
+  return this->_resultCache.get();
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::list<std::string_view>
@@ -165,24 +239,116 @@ ResolverState::getInput( std::string_view id ) const
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  std::optional<nix::ref<CachedInput>>
+ResolverState::getCachedInput( std::string_view id )
+{
+  std::string _id( id );
+  auto search = this->_cachedInputs.find( _id );
+  if ( search == this->_cachedInputs.end() )
+    {
+      std::optional<nix::ref<FloxFlake>> flake = this->getInput( id );
+      if ( ! flake.has_value() ) { return std::nullopt; }
+      search = this->_cachedInputs.emplace(
+        _id
+      , std::make_shared<CachedInput>( flake.value() )
+      ).first;
+    }
+  return nix::ref<CachedInput>( search->second );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Merge results which differ only by system, then order them so that the
+ * shortest attribute paths come first.
+ */
+  static void
+mergeAndSortResults( std::list<Resolved> & results )
+{
+  mergeResolvedByAttrPathGlob( results );
+
+  /* TODO: Sort by version. This is tricky because of systems. */
+  auto sortResults = []( const Resolved & a, const Resolved & b )
+  {
+    if ( a.path.size() != b.path.size() )
+      {
+        return a.path.size() <= b.path.size();
+      }
+    /* Break ties lexicographically. */
+    for ( size_t i = 0; i < a.path.size(); ++i )
+      {
+        if ( i == 1 ) { continue; }  /* Skip system. */
+        if ( a.path.path[i] != b.path.path[i] )
+          {
+            return std::get<std::string>( a.path.path[a.path.size() - 1] ) <=
+                   std::get<std::string>( b.path.path[b.path.size() - 1] );
+          }
+      }
+    return true;
+  };
+
+  results.sort( sortResults );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Whether @a desc searches @a prefix, being a `<SUBTREE>.<SYSTEM>' prefix
+ * optionally followed by a catalog stability.
+ */
+  static bool
+searchesPrefix( const Descriptor               & desc
+              , const std::vector<std::string> & prefix
+              )
+{
+  if ( prefix[0] == "catalog" )
+    {
+      return desc.searchCatalogs &&
+             ( ( ! desc.catalogStability.has_value() ) ||
+               ( ( 2 < prefix.size() ) &&
+                 ( desc.catalogStability.value() == prefix[2] )
+               )
+             );
+    }
+  return desc.searchFlakes;
+}
+
+
+/**
+ * Get the catalog stability of a `<SUBTREE>.<SYSTEM>[.<STABILITY>]' prefix,
+ * which is what its progress is recorded under.
+ */
+  static std::optional<std::string_view>
+stabilityOfPrefix( const std::vector<std::string> & prefix )
+{
+  if ( ( prefix[0] != "catalog" ) || ( prefix.size() < 3 ) )
+    {
+      return std::nullopt;
+    }
+  return prefix[2];
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   std::list<Resolved>
 ResolverState::resolveInInput( std::string_view id, const Descriptor & desc )
 {
-  std::string                           _id( id );
-  std::list<Resolved>                   results;
-  std::queue<Cursor, std::list<Cursor>> todos;
+  std::string         _id( id );
+  std::list<Resolved> results;
 
   /**
    * 1. Handling of `id' should have already been handled elsewhere.
-   * 2. If we have an `absAttrPath' with no glob we can avoid traversal or
-   *    iteration over subtrees and systems.
-   * 3. If we have a `relAttrPath' we can avoid a full traversal and just
-   *    iterate over subtrees and systesm.
-   * 4. Otherwise we have to do a full traversal.
-   *    The `packages' output can be optimized slightly by avoiding recursive
-   *    descent into `recurseForDerivations' attrs.
+   * 2. If we have an `absAttrPath' or `relAttrPath' we look up each path
+   *    directly, see `resolvePathInInput'.
+   * 3. Prefixes in the input's `PackageIndex' are read from it.
+   * 4. Other cached prefixes are read from our `DrvDb', and the rest are
+   *    populated through the package sets of our `CachedInput'.
+   *    None of these need an evaluator unless a prefix must be populated.
    */
 
   /* Bail early if `id' isn't a match.
@@ -195,227 +361,485 @@ ResolverState::resolveInInput( std::string_view id, const Descriptor & desc )
 
   std::shared_ptr<FloxFlake> flake = this->_inputs.at( _id );
 
-  /* Handle `absAttrPath' */
-  // TODO: use caches here
+  /* Attribute paths are looked up directly, so no walking. */
+  if ( desc.absAttrPath.has_value() || desc.relAttrPath.has_value() )
+    {
+      return this->resolvePathInInput( id, desc );
+    }
+
+  predicates::PkgPred pred = this->_prefs.pred_V2() && desc.pred( true );
+  /* Conditions which can be checked by `DrvDb' queries. */
+  DrvInfoFilter filter = this->_prefs.filter_V2() && desc.filter();
+
+  /* Our input is only locked once a package set must be evaluated. */
+  nix::ref<CachedInput> input = this->getCachedInput( id ).value();
+  DrvDb               & cache = * input->getDrvDb();
+  std::shared_ptr<const PackageIndex> index = input->getPackageIndex();
+
+  /* Read or populate each package set of our `CachedInput'. */
+  auto collect = [&]( const Package & pkg )
+  {
+    if ( ! pred( pkg ) ) { return; }
+    results.push_back( Resolved(
+      id
+    , flake->getLockedFlakeRef()
+    , AttrPathGlob::fromStrings( pkg.getPathStrs() )
+    , pkg.getInfo()
+    ) );
+  };
+
+  for ( const std::vector<std::string> & prefix : input->getPrefixes() )
+    {
+      if ( ! searchesPrefix( desc, prefix ) ) { continue; }
+      std::optional<std::string_view> stability = stabilityOfPrefix( prefix );
+
+      /* Indexed prefixes are complete, and are read in place. */
+      if ( ( index != nullptr ) &&
+           ( index->findPrefix( prefix[0], prefix[1], stability ) !=
+             PackageIndex::npos
+           )
+         )
+        {
+          IndexPackageSet ips( index
+                             , flake->getLockedFlakeRef()
+                             , parseSubtreeType( prefix[0] )
+                             , prefix[1]
+                             , stability
+                             );
+          for ( const IndexedPackage & pkg : ips ) { collect( pkg ); }
+          continue;
+        }
+
+      /* Only rows which pass `filter' are loaded, but we still need to check
+       * the remaining conditions in `pred'. */
+      if ( DBPS_INFO_DONE <=
+           cache.getProgress( prefix[0], prefix[1], stability )
+         )
+        {
+          nix::SQLiteStmt::Use query =
+            cache.useDrvInfosRanked( prefix[0], prefix[1], stability, filter );
+          while ( query.next() )
+            {
+              collect( CachedPackage( infoFromQuery( query ) ) );
+            }
+          continue;
+        }
+
+      /* Packages which weren't stored by earlier runs are evaluated, and
+       * those which fail to evaluate are recorded and skipped. */
+      std::shared_ptr<CachedPackageSet> ps =
+        input->getCachedPackageSet( prefix );
+      ps->populate();
+      for ( const RawPackage & pkg : * ps ) { collect( pkg ); }
+    }
+
+  mergeAndSortResults( results );
+
+  return results;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::list<Resolved>
+ResolverState::resolvePathInInput(       std::string_view   id
+                                 , const Descriptor       & desc
+                                 )
+{
+  if ( desc.inputId.has_value() && ( id != desc.inputId.value() ) )
+    {
+      return {};
+    }
+
+  std::shared_ptr<FloxFlake> flake = this->_inputs.at( std::string( id ) );
+
+  /* Collect the `<SUBTREE>.<SYSTEM>' prefixes and relative paths to try.
+   * As in `DrvDb', catalog paths begin with their stability. */
+  struct Lookup {
+    std::string              subtree;
+    std::string              system;
+    std::vector<std::string> relPath;
+  };
+  std::vector<Lookup> lookups;
   if ( desc.absAttrPath.has_value() )
     {
-      if ( desc.absAttrPath.value().hasGlob() )
+      const AttrPathGlob & glob = desc.absAttrPath.value();
+      if ( glob.size() < 3 ) { return {}; }
+      std::vector<std::string> relPath;
+      for ( size_t i = 2; i < glob.size(); ++i )
+        {
+          relPath.push_back( std::get<std::string>( glob.path[i] ) );
+        }
+      std::string subtree = std::get<std::string>( glob.path[0] );
+      if ( glob.hasGlob() )
         {
-          std::vector<nix::Symbol> subtree = {
-            this->getSymbolTable()->create(
-              std::get<std::string>( desc.absAttrPath.value().path[0] )
-            )
-          };
-          Cursor c = flake->openCursor( subtree );
           for ( const std::string & system : flake->getSystems() )
             {
-              MaybeCursor s = c->maybeGetAttr( system );
-              for ( size_t i = 2;
-                    i < desc.absAttrPath.value().path.size();
-                    ++i
-                  )
-                {
-                  if ( s == nullptr ) { break; }
-                  s = s->maybeGetAttr(
-                    std::get<std::string>( desc.absAttrPath.value().path[i] )
-                  );
-                }
-              if ( s != nullptr ) { todos.push( (Cursor) s ); }
+              lookups.push_back( Lookup { subtree, system, relPath } );
             }
         }
       else
         {
-          std::vector<nix::Symbol> path;
-          for ( size_t i = 0; i < desc.absAttrPath.value().path.size(); ++i )
-            {
-              this->getSymbolTable()->create(
-                std::get<std::string>( desc.absAttrPath.value().path[i] )
-              );
-            }
-          MaybeCursor c = flake->maybeOpenCursor( path );
-          if ( c != nullptr ) { todos.push( (Cursor) c ); }
+          lookups.push_back( Lookup {
+            subtree, std::get<std::string>( glob.path[1] ), relPath
+          } );
         }
     }
   else if ( desc.relAttrPath.has_value() )
     {
-      for ( Cursor c : flake->getFlakePrefixCursors() )
+      for ( const std::list<std::string> & prefix :
+              flake->getFlakeAttrPathPrefixes()
+          )
         {
-          MaybeCursor m = c;
-          for ( const std::string & p : desc.relAttrPath.value() )
-            {
-              if ( m == nullptr ) { break; }
-              m = m->getAttr( p );
-            }
-          if ( m != nullptr ) { todos.push( (Cursor) m ); }
+          auto                     it      = prefix.begin();
+          std::string              subtree = * it++;
+          std::string              system  = * it++;
+          std::vector<std::string> relPath( it, prefix.end() );
+          relPath.insert( relPath.end()
+                        , desc.relAttrPath.value().begin()
+                        , desc.relAttrPath.value().end()
+                        );
+          lookups.push_back( Lookup { subtree, system, std::move( relPath ) } );
         }
     }
 
-  predicates::PkgPred pred = this->_prefs.pred_V2();
-  pred = pred && desc.pred( todos.empty() );
-
-  std::queue<Package *, std::list<Package *>> goods;
-
-  /* Walk the flake's outputs checking each package. */
-  if ( todos.empty() )
+  /* The path has already been matched, so only check other conditions. */
+  predicates::PkgPred   pred  = this->_prefs.pred_V2() && desc.pred( false );
+  nix::ref<CachedInput> input = this->getCachedInput( id ).value();
+  DrvDb               & cache = * input->getDrvDb();
+  std::list<Resolved>   results;
+  for ( const Lookup & l : lookups )
     {
-      DrvDb cache( flake->getLockedFlake()->getFingerprint() );
-      std::list<std::vector<std::string>> tops;
-
-      /* Drop any prefixes that are disabled by our descriptor. */
-      for ( Cursor prefix : flake->getFlakePrefixCursors() )
+      std::unique_ptr<Package> pkg;
+      if ( std::optional<nlohmann::json> info =
+             cache.getDrvInfo( l.subtree, l.system, l.relPath )
+         )
+        {
+          pkg = std::make_unique<CachedPackage>( info.value() );
+        }
+      /* Evaluate unless our cache knows that there's no derivation here. */
+      else if ( ( cache.hasDrv( l.subtree, l.system, l.relPath ) != false ) &&
+                ( ! cache.isFailedDrv( l.subtree, l.system, l.relPath ) )
+              )
         {
-          std::vector<nix::SymbolStr> ppath =
-            this->getSymbolTable()->resolve( prefix->getAttrPath() );
-          if ( ( ! desc.searchCatalogs ) && ( ppath[0] == "catalog" ) )
+          std::vector<nix::Symbol> path = {
+            this->getSymbolTable()->create( l.subtree )
+          , this->getSymbolTable()->create( l.system )
+          };
+          for ( const std::string & p : l.relPath )
             {
-              continue;
+              path.push_back( this->getSymbolTable()->create( p ) );
             }
-          else if ( desc.catalogStability.has_value() &&
-                    ( desc.catalogStability.value() != ppath[2] )
-                  )
+          try
             {
-              continue;
+              MaybeCursor c = flake->maybeOpenCursor( path );
+              if ( ( c != nullptr ) && c->isDerivation() )
+                {
+                  pkg = std::make_unique<FlakePackage>(
+                    (Cursor) c, this->getSymbolTable(), false
+                  );
+                  cache.setDrvInfo( * pkg );
+                }
             }
-          if ( ( ! desc.searchFlakes ) &&
-               ( ( ppath[0] == "legacyPackages" ) ||
-                 ( ppath[0] == "packages" )
-               )
-             )
+          catch( ... )
             {
-              continue;
+              /* Only evaluation errors are a property of the package, so
+               * anything else must not become an empty result. */
+              std::optional<std::string> err = getEvalErrorClass();
+              if ( ! err.has_value() ) { throw; }
+              cache.setFailedDrv( l.subtree, l.system, l.relPath, * err );
+              pkg.reset();
             }
-          todos.push( prefix );
-          std::vector<std::string> strs;
-          for ( auto & sp : ppath ) { strs.push_back( sp ); }
-          tops.push_back( std::move( strs ) );
         }
+      if ( ( pkg == nullptr ) || ( ! pred( * pkg ) ) ) { continue; }
+      results.push_back( Resolved(
+        id
+      , flake->getLockedFlakeRef()
+      , AttrPathGlob::fromStrings( pkg->getPathStrs() )
+      , pkg->getInfo()
+      ) );
+    }
+
+  mergeAndSortResults( results );
+  return results;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get the `attrName' column of a cached info, which is the name of a
+ * catalog package rather than its version, as in `Package::getPkgAttrName'.
+ */
+  static const nlohmann::json &
+rankedAttrName( const nlohmann::json & info )
+{
+  const nlohmann::json & path = info["path"];
+  if ( ( info["subtree"] == "catalog" ) && ( 1 < path.size() ) )
+    {
+      return path[path.size() - 2];
+    }
+  return path.back();
+}
+
+
+/**
+ * Order cached infos by attribute path length, then attribute name.
+ * This matches the order of `DrvDb::useDrvInfosRanked'.
+ */
+  static bool
+rankedBefore( const nlohmann::json & a, const nlohmann::json & b )
+{
+  const nlohmann::json & pa = a["path"];
+  const nlohmann::json & pb = b["path"];
+  if ( pa.size() != pb.size() ) { return pa.size() < pb.size(); }
+  const nlohmann::json & na = rankedAttrName( a );
+  const nlohmann::json & nb = rankedAttrName( b );
+  if ( na != nb ) { return na < nb; }
+  return pa.dump() < pb.dump();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::optional<Resolved>
+ResolverState::resolveOneInInput(       std::string_view   id
+                                , const Descriptor       & desc
+                                )
+{
+  if ( desc.inputId.has_value() && ( id != desc.inputId.value() ) )
+    {
+      return std::nullopt;
+    }
+
+  /* Attribute paths are looked up directly so there is nothing to skip. */
+  if ( desc.absAttrPath.has_value() || desc.relAttrPath.has_value() )
+    {
+      std::list<Resolved> results = this->resolveInInput( id, desc );
+      if ( results.empty() ) { return std::nullopt; }
+      return results.front();
+    }
 
-      // TODO: Use `CachedPackageSet'.
-      while ( ! todos.empty() )
+  std::shared_ptr<FloxFlake> flake = this->_inputs.at( std::string( id ) );
+  predicates::PkgPred pred   = this->_prefs.pred_V2() && desc.pred( true );
+  DrvInfoFilter       filter = this->_prefs.filter_V2() && desc.filter();
+
+  nix::ref<CachedInput> input = this->getCachedInput( id ).value();
+  DrvDb               & cache = * input->getDrvDb();
+
+  /* Group prefixes by subtree and catalog stability, in order of
+   * preference, dropping any that are disabled by our descriptor. */
+  struct Group {
+    std::string                           subtree;
+    std::optional<std::string>            stability;
+    std::vector<std::vector<std::string>> prefixes;
+  };
+  std::vector<Group> groups;
+  for ( const std::vector<std::string> & prefix : input->getPrefixes() )
+    {
+      if ( ! searchesPrefix( desc, prefix ) ) { continue; }
+      std::optional<std::string> stability;
+      if ( 2 < prefix.size() ) { stability = prefix[2]; }
+
+      auto g = std::find_if( groups.begin(), groups.end()
+                           , [&]( const Group & g )
+                             {
+                               return ( g.subtree == prefix[0] ) &&
+                                      ( g.stability == stability );
+                             }
+                           );
+      if ( g == groups.end() )
         {
-          std::vector<nix::Symbol> path = todos.front()->getAttrPath();
+          groups.push_back( Group { prefix[0], stability, { prefix } } );
+        }
+      else
+        {
+          g->prefixes.push_back( prefix );
+        }
+    }
 
-          std::string subtree  = ( * this->getSymbolTable() )[path[0]];
-          std::string system   = ( * this->getSymbolTable() )[path[1]];
-          progress_status dbps = cache.getProgress( subtree, system );
+  /* Any match in a preferred group beats every match in later groups, so we
+   * stop at the first group with a match.
+   * Within a group the best match is the first accepted row from each
+   * system's ranked query. */
+  for ( const Group & g : groups )
+    {
+      std::optional<std::string_view> stability;
+      if ( g.stability.has_value() ) { stability = g.stability.value(); }
 
-          /* If our cached database is incomplete we evaluate. */
-          if ( dbps < DBPS_INFO_DONE )
+      std::optional<nlohmann::json> best;
+      for ( const std::vector<std::string> & prefix : g.prefixes )
+        {
+          /* Prefixes which earlier runs didn't finish are populated first. */
+          if ( cache.getProgress( g.subtree, prefix[1], stability ) <
+               DBPS_INFO_DONE
+             )
             {
-              /* Mark this prefix as being "in progress". */
-              cache.startCommit();
-              cache.promoteProgress( subtree, system, DBPS_PARTIAL );
-
-              for ( const nix::Symbol s : todos.front()->getAttrs() )
-                {
-                  FlakePackage * fp = nullptr;
-                  try
-                    {
-                      Cursor c = todos.front()->getAttr( s );
-                      if ( c->isDerivation() )
-                        {
-                          fp = new FlakePackage(
-                            c, this->getSymbolTable(), false
-                          );
-
-                          /* Cache the evaluated result. */
-                          cache.setDrvInfo( * fp );
-
-                          if ( pred( * fp ) ) { goods.push( fp ); }
-                          else                { delete fp;        }
-                        }
-                      else if ( subtree != "packages" )
-                        {
-                          MaybeCursor m =
-                            c->maybeGetAttr( "recurseForDerivations" );
-                          if ( ( m != nullptr ) && m->getBool() )
-                            {
-                              todos.push( (Cursor) c );
-                            }
-                        }
-                    }
-                  catch( ... )
-                    {
-                      if ( fp != nullptr ) { delete fp; }
-                      // TODO: Catch errors in `packages'.
-                    }
-                }
-              cache.endCommit();
+              input->getCachedPackageSet( prefix )->populate();
             }
-          else  /* If progress is past `DBPS_INFO_DONE' use cached info. */
+          nix::SQLiteStmt::Use query =
+            cache.useDrvInfosRanked( g.subtree, prefix[1], stability, filter );
+          while ( query.next() )
             {
-              std::list<nlohmann::json> infos =
-                cache.getDrvInfos( subtree, system );
-              for ( const nlohmann::json & info : infos )
+              nlohmann::json info = infoFromQuery( query );
+              if ( ! pred( CachedPackage( info ) ) ) { continue; }
+              if ( ( ! best.has_value() ) ||
+                   rankedBefore( info, best.value() )
+                 )
                 {
-                  CachedPackage * cp = new CachedPackage( info );
-                  if ( pred( * cp ) ) { goods.push( cp ); }
-                  else                { delete cp;        }
+                  best = std::move( info );
                 }
+              /* Later rows can only rank lower. */
+              break;
             }
-          /* Move on to the next one. */
-          todos.pop();
         }
-      /* Mark prefixes as complete in our cache. */
-      for ( const std::vector<std::string> & absPath : tops )
+      if ( ! best.has_value() ) { continue; }
+
+      /* Collect the winner from every system so that it may be merged. */
+      std::vector<std::string> relPath = best.value()["path"];
+      std::list<Resolved>      results;
+      for ( const std::vector<std::string> & prefix : g.prefixes )
         {
-          cache.setProgress( absPath[0], absPath[1], DBPS_INFO_DONE );
+          std::optional<nlohmann::json> info =
+            cache.getDrvInfo( g.subtree, prefix[1], relPath );
+          if ( ! info.has_value() ) { continue; }
+          CachedPackage cp( info.value() );
+          if ( ! pred( cp ) ) { continue; }
+          results.push_back( Resolved(
+            id
+          , flake->getLockedFlakeRef()
+          , AttrPathGlob::fromStrings( cp.getPathStrs() )
+          , cp.getInfo()
+          ) );
         }
+      mergeResolvedByAttrPathGlob( results );
+      return results.front();
     }
-  else  /* Handle case where we have relative/absolute path, so no walking. */
+
+  return std::nullopt;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::vector<std::list<Resolved>>
+ResolverState::resolveBatchInInput(       std::string_view          id
+                                  , const std::vector<Descriptor> & descs
+                                  )
+{
+  std::vector<std::list<Resolved>> results( descs.size() );
+  std::shared_ptr<FloxFlake>       flake =
+    this->_inputs.at( std::string( id ) );
+
+  /* Descriptors with attribute paths are looked up directly, and the rest
+   * share a single pass over the input's prefixes. */
+  std::vector<std::size_t>         walkers;
+  std::vector<predicates::PkgPred> preds( descs.size() );
+  for ( std::size_t i = 0; i < descs.size(); ++i )
     {
-      /* Run our predicate filters and collect satisfactory packages. */
-      while( ! todos.empty() )
+      const Descriptor & desc = descs[i];
+      if ( desc.inputId.has_value() && ( id != desc.inputId.value() ) )
         {
-          if ( todos.front()->isDerivation() )
-            {
-              FlakePackage * p = new FlakePackage( todos.front()
-                                               , this->getSymbolTable()
-                                               , false
-                                               );
-              if ( pred( * p ) ) { goods.push( p ); }
-              else               { delete p;        }
-            }
-          todos.pop();
+          continue;
+        }
+      if ( desc.absAttrPath.has_value() || desc.relAttrPath.has_value() )
+        {
+          results[i] = this->resolveInInput( id, desc );
+          continue;
         }
+      preds[i] = this->_prefs.pred_V2() && desc.pred( true );
+      walkers.push_back( i );
     }
+  if ( walkers.empty() ) { return results; }
 
-  /* Convert `Package' to `Resolved'. */
-  while ( ! goods.empty() )
+  /* Index descriptors by the names they require so that each package is
+   * only checked against descriptors it could satisfy. */
+  std::unordered_map<std::string, std::vector<std::size_t>> byName;
+  std::vector<std::size_t>                                  anyName;
+  for ( std::size_t i : walkers )
     {
-      results.push_back( Resolved(
-        id
-      , flake->getLockedFlakeRef()
-      , AttrPathGlob::fromStrings( goods.front()->getPathStrs() )
-      , goods.front()->getInfo()
-      ) );
-      delete goods.front();
-      goods.pop();
+      if ( descs[i].name.has_value() )
+        {
+          byName[descs[i].name.value()].push_back( i );
+        }
+      else
+        {
+          anyName.push_back( i );
+        }
     }
 
-  mergeResolvedByAttrPathGlob( results );
-
-  /* TODO: Sort by version. This is tricky because of systems. */
-  auto sortResults = []( const Resolved & a, const Resolved & b )
+  std::vector<std::size_t> candidates;
+  auto route = [&]( const Package & p )
   {
-    if ( a.path.size() != b.path.size() )
+    candidates = anyName;
+    for ( const std::string & key : { p.getPkgAttrName()
+                                    , p.getPname()
+                                    , p.getFullName()
+                                    }
+        )
       {
-        return a.path.size() <= b.path.size();
+        auto search = byName.find( key );
+        if ( search == byName.end() ) { continue; }
+        candidates.insert( candidates.end()
+                         , search->second.begin()
+                         , search->second.end()
+                         );
       }
-    /* Break ties lexicographically. */
-    for ( size_t i = 0; i < a.path.size(); ++i )
+    std::sort( candidates.begin(), candidates.end() );
+    candidates.erase( std::unique( candidates.begin(), candidates.end() )
+                    , candidates.end()
+                    );
+    for ( std::size_t i : candidates )
       {
-        if ( i == 1 ) { continue; }  /* Skip system. */
-        if ( a.path.path[i] != b.path.path[i] )
-          {
-            return std::get<std::string>( a.path.path[a.path.size() - 1] ) <=
-                   std::get<std::string>( b.path.path[b.path.size() - 1] );
-          }
+        if ( ! preds[i]( p ) ) { continue; }
+        results[i].push_back( Resolved(
+          id
+        , flake->getLockedFlakeRef()
+        , AttrPathGlob::fromStrings( p.getPathStrs() )
+        , p.getInfo()
+        ) );
       }
-    return true;
   };
 
-  results.sort( sortResults );
+  /* Drop prefixes which no descriptor searches. */
+  auto wanted = [&]( const std::vector<std::string> & ppath )
+  {
+    for ( std::size_t i : walkers )
+      {
+        if ( searchesPrefix( descs[i], ppath ) ) { return true; }
+      }
+    return false;
+  };
+
+  /* Preferences apply to every descriptor, so their conditions are always
+   * pushed down to our queries, along with those of a lone descriptor. */
+  DrvInfoFilter filter = this->_prefs.filter_V2();
+  if ( walkers.size() == 1 ) { filter = filter && descs[walkers[0]].filter(); }
+
+  nix::ref<CachedInput> input = this->getCachedInput( id ).value();
+  DrvDb               & cache = * input->getDrvDb();
+
+  /* Each prefix is read separately so that catalog stabilities are kept
+   * apart, and only those which earlier runs didn't finish are evaluated. */
+  for ( const std::vector<std::string> & prefix : input->getPrefixes() )
+    {
+      if ( ! wanted( prefix ) ) { continue; }
+      std::optional<std::string_view> stability = stabilityOfPrefix( prefix );
+      if ( cache.getProgress( prefix[0], prefix[1], stability ) <
+           DBPS_INFO_DONE
+         )
+        {
+          input->getCachedPackageSet( prefix )->populate();
+        }
+      nix::SQLiteStmt::Use query =
+        cache.useDrvInfosRanked( prefix[0], prefix[1], stability, filter );
+      while ( query.next() )
+        {
+          route( CachedPackage( infoFromQuery( query ) ) );
+        }
+    }
+
+  for ( std::size_t i : walkers ) { mergeAndSortResults( results[i] ); }
 
   return results;
 }
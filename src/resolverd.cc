@@ -0,0 +1,134 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nix/util.hh>
+#include "flox/exceptions.hh"
+#include "flox/resolverd.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Not available on Darwin, where `SIGPIPE' must be ignored instead. */
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL  0
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+  std::string
+getResolverdSocketName()
+{
+  const char * runtimeDir = std::getenv( "XDG_RUNTIME_DIR" );
+  if ( ( runtimeDir != nullptr ) && ( runtimeDir[0] != '\0' ) )
+    {
+      return std::string( runtimeDir ) + "/flox/resolverd.sock";
+    }
+  return nix::getCacheDir() + "/flox/resolverd.sock";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  nlohmann::json
+resolverdRequest( const std::string    & socketPath
+                , const nlohmann::json & request
+                )
+{
+  struct sockaddr_un addr;
+  std::memset( & addr, 0, sizeof( addr ) );
+  addr.sun_family = AF_UNIX;
+  if ( sizeof( addr.sun_path ) <= socketPath.size() )
+    {
+      throw ResolverException(
+        "resolverdRequest(): Socket path is too long: " + socketPath
+      );
+    }
+  std::memcpy( addr.sun_path, socketPath.c_str(), socketPath.size() );
+
+  int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( 0 <= fd ) { fcntl( fd, F_SETFD, FD_CLOEXEC ); }
+  if ( fd < 0 )
+    {
+      throw ResolverException(
+        std::string( "resolverdRequest(): socket: " ) + std::strerror( errno )
+      );
+    }
+  if ( connect( fd, (struct sockaddr *) & addr, sizeof( addr ) ) != 0 )
+    {
+      int err = errno;
+      close( fd );
+      throw ResolverException( "resolverdRequest(): Failed to connect to '" +
+                               socketPath + "': " + std::strerror( err )
+                             );
+    }
+
+  std::string msg = request.dump() + "\n";
+  for ( std::size_t sent = 0; sent < msg.size(); )
+    {
+      ssize_t n =
+        send( fd, msg.data() + sent, msg.size() - sent, MSG_NOSIGNAL );
+      if ( ( n < 0 ) && ( errno == EINTR ) ) { continue; }
+      if ( n <= 0 )
+        {
+          close( fd );
+          throw ResolverException(
+            "resolverdRequest(): Failed to send request"
+          );
+        }
+      sent += n;
+    }
+
+  std::string line;
+  char        buf[4096];
+  while ( line.find( '\n' ) == std::string::npos )
+    {
+      ssize_t n = read( fd, buf, sizeof( buf ) );
+      if ( ( n < 0 ) && ( errno == EINTR ) ) { continue; }
+      if ( n <= 0 )
+        {
+          close( fd );
+          throw ResolverException(
+            "resolverdRequest(): Connection closed before a response was read"
+          );
+        }
+      line.append( buf, n );
+    }
+  close( fd );
+
+  nlohmann::json response =
+    nlohmann::json::parse( line.substr( 0, line.find( '\n' ) ) );
+  if ( response.contains( "error" ) )
+    {
+      throw ResolverException( response["error"].get<std::string>() );
+    }
+  return response.at( "result" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -0,0 +1,206 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <nix/hash.hh>
+#include <nix/util.hh>
+#include "flox/result-cache.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox {
+  namespace resolve {
+
+/* -------------------------------------------------------------------------- */
+
+  std::string
+getResultCacheName()
+{
+  return nix::getCacheDir() + "/flox/result-cache-v0.sqlite";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::string
+getResultCacheKey( const nlohmann::json & query )
+{
+  /* `nlohmann::json' objects are ordered, so equal queries dump equally. */
+  return nix::hashString( nix::htSHA256, query.dump() )
+           .to_string( nix::Base16, false );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static const char * resultCacheSchema = R"sql(
+CREATE TABLE IF NOT EXISTS Results (
+  key       TEXT     PRIMARY KEY
+, results   JSON     NOT NULL
+, size      INTEGER  NOT NULL
+, lastUsed  INTEGER  NOT NULL
+);
+
+CREATE INDEX IF NOT EXISTS idx_Results_lastUsed ON Results ( lastUsed );
+
+-- A running total of `Results', so that checking for eviction doesn't scan
+-- every row on each insert.
+CREATE TABLE IF NOT EXISTS Totals (
+  id     INTEGER  PRIMARY KEY CHECK ( id = 0 )
+, size   INTEGER  NOT NULL
+, count  INTEGER  NOT NULL
+);
+
+INSERT OR IGNORE INTO Totals ( id, size, count )
+  SELECT 0, COALESCE( SUM( size ), 0 ), COUNT( * ) FROM Results;
+
+CREATE TRIGGER IF NOT EXISTS trg_Results_insert AFTER INSERT ON Results
+BEGIN
+  UPDATE Totals SET size = size + NEW.size, count = count + 1;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_Results_update AFTER UPDATE OF size ON Results
+BEGIN
+  UPDATE Totals SET size = size + NEW.size - OLD.size;
+END;
+
+CREATE TRIGGER IF NOT EXISTS trg_Results_delete AFTER DELETE ON Results
+BEGIN
+  UPDATE Totals SET size = size - OLD.size, count = count - 1;
+END;
+)sql";
+
+
+/* -------------------------------------------------------------------------- */
+
+ResultCache::ResultCache( const std::string & path, std::size_t maxSize )
+  : _maxSize( maxSize )
+{
+  std::filesystem::path p( path );
+  if ( ! std::filesystem::exists( p.parent_path() ) )
+    {
+      std::filesystem::create_directories( p.parent_path() );
+    }
+
+  this->_db = sqlite::SQLiteDb( path, true, true, true );
+  nix::retrySQLite<void>( [&]() { this->_db.exec( resultCacheSchema ); } );
+
+  this->_queryResult.create(
+    this->_db
+  , "SELECT results FROM Results WHERE ( key = ? )"
+  );
+  this->_touchResult.create(
+    this->_db
+  , "UPDATE Results SET lastUsed = ? WHERE ( key = ? )"
+  );
+  /* An upsert rather than `REPLACE', whose implicit delete wouldn't fire
+   * our triggers. */
+  this->_insertResult.create(
+    this->_db
+  , "INSERT INTO Results ( key, results, size, lastUsed ) "
+    "VALUES ( ?, ?, ?, ? ) ON CONFLICT ( key ) DO UPDATE SET "
+    "results = excluded.results, size = excluded.size, "
+    "lastUsed = excluded.lastUsed"
+  );
+  this->_querySize.create(
+    this->_db
+  , "SELECT size, count FROM Totals WHERE ( id = 0 )"
+  );
+  this->_evictResults.create(
+    this->_db
+  , "DELETE FROM Results WHERE key IN ( "
+    "  SELECT key FROM Results ORDER BY lastUsed ASC LIMIT ? "
+    ")"
+  );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::optional<nlohmann::json>
+ResultCache::get( const std::string & key )
+{
+  std::optional<std::string> results;
+  nix::retrySQLite<void>( [&]() {
+    auto query = this->_queryResult.use()( key );
+    if ( query.next() ) { results = query.getStr( 0 ); }
+  } );
+  if ( ! results.has_value() ) { return std::nullopt; }
+
+  /* Recording use is best effort, a busy database shouldn't fail a hit. */
+  try
+    {
+      this->_touchResult.use()( (int64_t) std::time( nullptr ) )( key ).exec();
+    }
+  catch( const nix::SQLiteError & )
+    {
+    }
+
+  return nlohmann::json::parse( results.value() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+ResultCache::put( const std::string & key, const nlohmann::json & results )
+{
+  std::string str = results.dump();
+  nix::retrySQLite<void>( [&]() {
+    this->_insertResult.use()
+      ( key )
+      ( str )
+      ( (int64_t) str.size() )
+      ( (int64_t) std::time( nullptr ) )
+      .exec();
+  } );
+  this->evict();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+ResultCache::evict()
+{
+  while ( true )
+    {
+      uint64_t size  = 0;
+      uint64_t count = 0;
+      nix::retrySQLite<void>( [&]() {
+        auto query = this->_querySize.use();
+        if ( query.next() )
+          {
+            size  = query.getInt( 0 );
+            count = query.getInt( 1 );
+          }
+      } );
+      if ( ( size <= this->_maxSize ) || ( count == 0 ) ) { return; }
+
+      /* Drop a quarter of the results at a time so that eviction doesn't
+       * happen on every insert once we are full. */
+      int64_t n = std::max( (uint64_t) 1, count / 4 );
+      nix::retrySQLite<void>( [&]() {
+        this->_evictResults.use()( n ).exec();
+      } );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  }  /* End Namespace `flox::resolve' */
+}  /* End Namespace `flox' */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
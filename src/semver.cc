@@ -7,6 +7,7 @@
 #include <string>
 #include <regex>
 #include <optional>
+#include <algorithm>
 
 
 /* -------------------------------------------------------------------------- */
@@ -150,6 +151,783 @@ coerceSemver( std::string_view version )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Largest integer `node-semver' will accept in a version component. */
+static const uint64_t semverMaxSafeInt   = 9007199254740991ULL;
+static const size_t   semverMaxLength    = 256;
+
+  static inline bool
+isSpaceChar( char c )
+{
+  return ( c == ' ' ) || ( c == '\t' ) || ( c == '\n' ) || ( c == '\r' ) ||
+         ( c == '\f' ) || ( c == '\v' );
+}
+
+  static inline bool
+isDigitChar( char c )
+{
+  return ( '0' <= c ) && ( c <= '9' );
+}
+
+  static inline bool
+isIdentChar( char c )
+{
+  return isDigitChar( c ) || ( ( 'a' <= c ) && ( c <= 'z' ) ) ||
+         ( ( 'A' <= c ) && ( c <= 'Z' ) ) || ( c == '-' );
+}
+
+  static inline bool
+isNumericIdent( std::string_view id )
+{
+  if ( id.empty() ) { return false; }
+  for ( char c : id ) { if ( ! isDigitChar( c ) ) { return false; } }
+  return true;
+}
+
+  static inline std::string_view
+trimSpace( std::string_view s )
+{
+  while ( ( ! s.empty() ) && isSpaceChar( s.front() ) ) { s.remove_prefix( 1 ); }
+  while ( ( ! s.empty() ) && isSpaceChar( s.back() ) )  { s.remove_suffix( 1 ); }
+  return s;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Compare two prerelease identifiers.
+ * Numeric identifiers always have lower precedence than alphanumeric ones.
+ */
+  static int
+compareIdentifiers( const std::string & a, const std::string & b )
+{
+  bool anum = isNumericIdent( a );
+  bool bnum = isNumericIdent( b );
+  if ( anum && bnum )
+    {
+      size_t ia = a.find_first_not_of( '0' );
+      size_t ib = b.find_first_not_of( '0' );
+      std::string_view na =
+        ( ia == std::string::npos ) ? "" : std::string_view( a ).substr( ia );
+      std::string_view nb =
+        ( ib == std::string::npos ) ? "" : std::string_view( b ).substr( ib );
+      if ( na.size() != nb.size() ) { return ( na.size() < nb.size() ) ? -1 : 1; }
+      int c = na.compare( nb );
+      return ( c < 0 ) ? -1 : ( 0 < c ) ? 1 : 0;
+    }
+  if ( anum ) { return -1; }
+  if ( bnum ) { return 1; }
+  int c = a.compare( b );
+  return ( c < 0 ) ? -1 : ( 0 < c ) ? 1 : 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+Semver::compare( const Semver & other ) const
+{
+  if ( this->major != other.major ) { return ( this->major < other.major ) ? -1 : 1; }
+  if ( this->minor != other.minor ) { return ( this->minor < other.minor ) ? -1 : 1; }
+  if ( this->patch != other.patch ) { return ( this->patch < other.patch ) ? -1 : 1; }
+
+  /* Not having a prerelease is greater than having one. */
+  if ( this->prerelease.empty() ) { return other.prerelease.empty() ? 0 : 1; }
+  if ( other.prerelease.empty() ) { return -1; }
+
+  for ( size_t i = 0; ; ++i )
+    {
+      bool aEnd = this->prerelease.size() <= i;
+      bool bEnd = other.prerelease.size() <= i;
+      if ( aEnd && bEnd ) { return 0;  }
+      if ( bEnd )         { return 1;  }
+      if ( aEnd )         { return -1; }
+      int c = compareIdentifiers( this->prerelease[i], other.prerelease[i] );
+      if ( c != 0 ) { return c; }
+    }
+}
+
+  bool
+Semver::operator==( const Semver & other ) const
+{
+  return this->compare( other ) == 0;
+}
+
+  bool
+Semver::operator<( const Semver & other ) const
+{
+  return this->compare( other ) < 0;
+}
+
+  std::string
+Semver::toString() const
+{
+  std::string rsl = std::to_string( this->major ) + "." +
+                    std::to_string( this->minor ) + "." +
+                    std::to_string( this->patch );
+  for ( size_t i = 0; i < this->prerelease.size(); ++i )
+    {
+      rsl += ( i == 0 ) ? '-' : '.';
+      rsl += this->prerelease[i];
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Parse a main version component at @a pos.
+ * In strict mode leading zeroes are forbidden, so `03` only consumes `0`.
+ */
+  static bool
+parseSemverNumber( std::string_view   s
+                 , size_t           & pos
+                 , bool               loose
+                 , uint64_t         & out
+                 )
+{
+  size_t start = pos;
+  if ( ( s.size() <= pos ) || ( ! isDigitChar( s[pos] ) ) ) { return false; }
+  if ( ( ! loose ) && ( s[pos] == '0' ) )
+    {
+      ++pos;
+      out = 0;
+      return true;
+    }
+  while ( ( pos < s.size() ) && isDigitChar( s[pos] ) ) { ++pos; }
+  std::string_view digits = s.substr( start, pos - start );
+  size_t nz = digits.find_first_not_of( '0' );
+  if ( nz == std::string_view::npos ) { out = 0; return true; }
+  digits.remove_prefix( nz );
+  if ( 16 < digits.size() ) { return false; }
+  out = std::stoull( std::string( digits ) );
+  return out <= semverMaxSafeInt;
+}
+
+
+/**
+ * Parse dot separated identifiers starting at @a pos through the end of @a s
+ * or the first `+`.
+ * @return `false` if any identifier is empty or contains invalid characters.
+ */
+  static bool
+parseSemverIdents( std::string_view           s
+                 , size_t                   & pos
+                 , bool                       prerelease
+                 , bool                       loose
+                 , std::vector<std::string> & out
+                 )
+{
+  out.clear();
+  while ( true )
+    {
+      size_t start = pos;
+      while ( ( pos < s.size() ) && isIdentChar( s[pos] ) ) { ++pos; }
+      std::string_view id = s.substr( start, pos - start );
+      if ( id.empty() ) { return false; }
+      if ( prerelease && isNumericIdent( id ) )
+        {
+          /* Strict numeric identifiers may not have leading zeroes. */
+          if ( ( ! loose ) && ( 1 < id.size() ) && ( id[0] == '0' ) )
+            {
+              return false;
+            }
+          size_t nz = id.find_first_not_of( '0' );
+          std::string_view n =
+            ( nz == std::string_view::npos ) ? "0" : id.substr( nz );
+          /* Canonicalize "safe" numbers, `node-semver' leaves others alone. */
+          if ( ( n.size() <= 16 ) &&
+               ( std::stoull( std::string( n ) ) < semverMaxSafeInt )
+             )
+            {
+              out.emplace_back( n );
+            }
+          else
+            {
+              out.emplace_back( id );
+            }
+        }
+      else
+        {
+          out.emplace_back( id );
+        }
+      if ( ( pos < s.size() ) && ( s[pos] == '.' ) ) { ++pos; continue; }
+      return true;
+    }
+}
+
+
+/**
+ * Parse an optional prerelease and build metadata section which must extend
+ * through the end of @a s.
+ */
+  static bool
+parseSemverTail( std::string_view           s
+               , size_t                     pos
+               , bool                       loose
+               , std::vector<std::string> & prerelease
+               )
+{
+  if ( ( pos < s.size() ) && ( s[pos] != '+' ) )
+    {
+      if ( ! parseSemverIdents( s, pos, true, loose, prerelease ) )
+        {
+          return false;
+        }
+    }
+  if ( ( pos < s.size() ) && ( s[pos] == '+' ) )
+    {
+      std::vector<std::string> build;
+      ++pos;
+      if ( ! parseSemverIdents( s, pos, false, loose, build ) ) { return false; }
+    }
+  return pos == s.size();
+}
+
+
+  std::optional<Semver>
+parseSemver( std::string_view version, bool loose )
+{
+  if ( semverMaxLength < version.size() ) { return std::nullopt; }
+  std::string_view s = trimSpace( version );
+  size_t pos = 0;
+
+  if ( loose )
+    {
+      while ( ( pos < s.size() ) &&
+              ( ( s[pos] == 'v' ) || ( s[pos] == '=' ) || isSpaceChar( s[pos] ) )
+            )
+        {
+          ++pos;
+        }
+    }
+  else if ( ( pos < s.size() ) && ( s[pos] == 'v' ) )
+    {
+      ++pos;
+    }
+
+  Semver rsl;
+  if ( ! parseSemverNumber( s, pos, loose, rsl.major ) ) { return std::nullopt; }
+  if ( ( s.size() <= pos ) || ( s[pos] != '.' ) )        { return std::nullopt; }
+  ++pos;
+  if ( ! parseSemverNumber( s, pos, loose, rsl.minor ) ) { return std::nullopt; }
+  if ( ( s.size() <= pos ) || ( s[pos] != '.' ) )        { return std::nullopt; }
+  ++pos;
+  if ( ! parseSemverNumber( s, pos, loose, rsl.patch ) ) { return std::nullopt; }
+
+  if ( s.size() <= pos ) { return rsl; }
+
+  if ( s[pos] == '+' )
+    {
+      if ( parseSemverTail( s, pos, loose, rsl.prerelease ) ) { return rsl; }
+      return std::nullopt;
+    }
+
+  /* A `-' separator is mandatory in strict mode, and optional in loose mode.
+   * In loose mode a leading `-' may also begin an identifier, so we fall back
+   * to treating it as part of the prerelease. */
+  if ( ( s[pos] == '-' ) && ( ( pos + 1 ) < s.size() ) &&
+       ( s[pos + 1] != '+' ) &&
+       parseSemverTail( s, pos + 1, loose, rsl.prerelease )
+     )
+    {
+      return rsl;
+    }
+  if ( loose && parseSemverTail( s, pos, loose, rsl.prerelease ) )
+    {
+      return rsl;
+    }
+  return std::nullopt;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Patterns used to desugar ranges, ported from `node-semver'. */
+#define _re_num_strict  "0|[1-9]\\d*"
+#define _re_num_loose   "\\d+"
+#define _re_nonnum      "\\d*[a-zA-Z-][a-zA-Z0-9-]*"
+#define _re_pre_id      "(?:" _re_nonnum "|" _re_num_strict ")"
+#define _re_pre_id_l    "(?:" _re_nonnum "|" _re_num_loose ")"
+#define _re_pre         "(?:-(" _re_pre_id "(?:\\." _re_pre_id ")*))"
+#define _re_pre_l       "(?:-?(" _re_pre_id_l "(?:\\." _re_pre_id_l ")*))"
+#define _re_build       "(?:\\+([a-zA-Z0-9-]+(?:\\.[a-zA-Z0-9-]+)*))"
+#define _re_full_plain                                                     \
+  "v?(" _re_num_strict ")\\.(" _re_num_strict ")\\.(" _re_num_strict ")"   \
+  _re_pre "?" _re_build "?"
+#define _re_loose_plain                                                    \
+  "[v=\\s]*(" _re_num_loose ")\\.(" _re_num_loose ")\\.(" _re_num_loose ")" \
+  _re_pre_l "?" _re_build "?"
+#define _re_gtlt        "((?:<|>)?=?)"
+#define _re_xid         _re_num_strict "|x|X|\\*"
+#define _re_xid_l       _re_num_loose "|x|X|\\*"
+#define _re_xrange_plain                                                   \
+  "[v=\\s]*(" _re_xid ")(?:\\.(" _re_xid ")(?:\\.(" _re_xid ")"           \
+  "(?:" _re_pre ")?" _re_build "?)?)?"
+#define _re_xrange_plain_l                                                 \
+  "[v=\\s]*(" _re_xid_l ")(?:\\.(" _re_xid_l ")(?:\\.(" _re_xid_l ")"     \
+  "(?:" _re_pre_l ")?" _re_build "?)?)?"
+
+struct SemverRangeREs {
+  std::regex hyphen;
+  std::regex tilde;
+  std::regex caret;
+  std::regex xrange;
+  std::regex comparator;
+};
+
+static const SemverRangeREs semverRangeStrictREs = {
+  std::regex( "^\\s*(" _re_xrange_plain ")\\s+-\\s+(" _re_xrange_plain
+              ")\\s*$" )
+, std::regex( "^(?:~>?)" _re_xrange_plain "$" )
+, std::regex( "^(?:\\^)" _re_xrange_plain "$" )
+, std::regex( "^" _re_gtlt "\\s*" _re_xrange_plain "$" )
+, std::regex( "^" _re_gtlt "\\s*(" _re_full_plain ")$|^$" )
+};
+
+static const SemverRangeREs semverRangeLooseREs = {
+  std::regex( "^\\s*(" _re_xrange_plain_l ")\\s+-\\s+(" _re_xrange_plain_l
+              ")\\s*$" )
+, std::regex( "^(?:~>?)" _re_xrange_plain_l "$" )
+, std::regex( "^(?:\\^)" _re_xrange_plain_l "$" )
+, std::regex( "^" _re_gtlt "\\s*" _re_xrange_plain_l "$" )
+, std::regex( "^" _re_gtlt "\\s*(" _re_loose_plain ")$|^$" )
+};
+
+static const std::regex semverComparatorTrimRE(
+  "(\\s*)" _re_gtlt "\\s*(" _re_loose_plain "|" _re_xrange_plain ")"
+);
+static const std::regex semverTildeTrimRE( "(\\s*)(?:~>?)\\s+" );
+static const std::regex semverCaretTrimRE( "(\\s*)(?:\\^)\\s+" );
+static const std::regex semverStarRE( "(<|>)?=?\\s*\\*" );
+static const std::regex semverGTE0RE( "^\\s*>=\\s*0\\.0\\.0\\s*$" );
+static const std::regex semverGTE0PreRE( "^\\s*>=\\s*0\\.0\\.0-0\\s*$" );
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Split on runs of whitespace, preserving leading/trailing empty strings. */
+  static std::vector<std::string>
+splitSpaces( const std::string & s )
+{
+  std::vector<std::string> rsl;
+  std::string curr;
+  for ( size_t i = 0; i < s.size(); )
+    {
+      if ( isSpaceChar( s[i] ) )
+        {
+          rsl.push_back( std::move( curr ) );
+          curr.clear();
+          while ( ( i < s.size() ) && isSpaceChar( s[i] ) ) { ++i; }
+        }
+      else
+        {
+          curr += s[i];
+          ++i;
+        }
+    }
+  rsl.push_back( std::move( curr ) );
+  return rsl;
+}
+
+  static std::string
+joinSpaces( const std::vector<std::string> & parts )
+{
+  std::string rsl;
+  for ( size_t i = 0; i < parts.size(); ++i )
+    {
+      if ( i != 0 ) { rsl += ' '; }
+      rsl += parts[i];
+    }
+  return rsl;
+}
+
+  static inline bool
+isX( const std::string & id )
+{
+  return id.empty() || ( id == "x" ) || ( id == "X" ) || ( id == "*" );
+}
+
+/* Increment a numeric version component held as a string. */
+  static inline std::string
+incr( const std::string & n )
+{
+  return std::to_string( std::stoull( n ) + 1 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static std::string
+replaceHyphen( const std::string     & range
+             , const SemverRangeREs  & res
+             , bool                    incPr
+             )
+{
+  std::smatch m;
+  if ( ! std::regex_match( range, m, res.hyphen ) ) { return range; }
+  std::string from = m[1].str(), fM = m[2].str(), fm = m[3].str()
+            , fp   = m[4].str(), fpr = m[5].str();
+  std::string to = m[7].str(), tM = m[8].str(), tm = m[9].str()
+            , tp = m[10].str(), tpr = m[11].str();
+  std::string z = incPr ? "-0" : "";
+
+  if ( isX( fM ) )       { from = ""; }
+  else if ( isX( fm ) )  { from = ">=" + fM + ".0.0" + z; }
+  else if ( isX( fp ) )  { from = ">=" + fM + "." + fm + ".0" + z; }
+  else if ( ! fpr.empty() ) { from = ">=" + from; }
+  else                   { from = ">=" + from + z; }
+
+  if ( isX( tM ) )       { to = ""; }
+  else if ( isX( tm ) )  { to = "<" + incr( tM ) + ".0.0-0"; }
+  else if ( isX( tp ) )  { to = "<" + tM + "." + incr( tm ) + ".0-0"; }
+  else if ( ! tpr.empty() ) { to = "<=" + tM + "." + tm + "." + tp + "-" + tpr; }
+  else if ( incPr )      { to = "<" + tM + "." + tm + "." + incr( tp ) + "-0"; }
+  else                   { to = "<=" + to; }
+
+  return std::string( trimSpace( from + " " + to ) );
+}
+
+
+  static std::string
+replaceTilde( const std::string & comp, const SemverRangeREs & res )
+{
+  std::smatch m;
+  if ( ! std::regex_match( comp, m, res.tilde ) ) { return comp; }
+  std::string M = m[1].str(), mi = m[2].str(), p = m[3].str()
+            , pr = m[4].str();
+  if ( isX( M ) )  { return ""; }
+  if ( isX( mi ) ) { return ">=" + M + ".0.0 <" + incr( M ) + ".0.0-0"; }
+  if ( isX( p ) )
+    {
+      return ">=" + M + "." + mi + ".0 <" + M + "." + incr( mi ) + ".0-0";
+    }
+  if ( ! pr.empty() )
+    {
+      return ">=" + M + "." + mi + "." + p + "-" + pr + " <" + M + "." +
+             incr( mi ) + ".0-0";
+    }
+  return ">=" + M + "." + mi + "." + p + " <" + M + "." + incr( mi ) + ".0-0";
+}
+
+
+  static std::string
+replaceCaret( const std::string    & comp
+            , const SemverRangeREs & res
+            , bool                   incPr
+            )
+{
+  std::smatch m;
+  if ( ! std::regex_match( comp, m, res.caret ) ) { return comp; }
+  std::string M = m[1].str(), mi = m[2].str(), p = m[3].str()
+            , pr = m[4].str();
+  std::string z = incPr ? "-0" : "";
+  if ( isX( M ) )  { return ""; }
+  if ( isX( mi ) ) { return ">=" + M + ".0.0" + z + " <" + incr( M ) + ".0.0-0"; }
+  if ( isX( p ) )
+    {
+      if ( M == "0" )
+        {
+          return ">=" + M + "." + mi + ".0" + z + " <" + M + "." + incr( mi ) +
+                 ".0-0";
+        }
+      return ">=" + M + "." + mi + ".0" + z + " <" + incr( M ) + ".0.0-0";
+    }
+  std::string lower = ">=" + M + "." + mi + "." + p;
+  lower += pr.empty() ? z : ( "-" + pr );
+  if ( M == "0" )
+    {
+      if ( mi == "0" )
+        {
+          return lower + " <" + M + "." + mi + "." + incr( p ) + "-0";
+        }
+      return lower + " <" + M + "." + incr( mi ) + ".0-0";
+    }
+  /* Note that `node-semver' omits `-0' here for non-prerelease bounds. */
+  if ( pr.empty() ) { lower = ">=" + M + "." + mi + "." + p; }
+  return lower + " <" + incr( M ) + ".0.0-0";
+}
+
+
+  static std::string
+replaceXRange( const std::string    & _comp
+             , const SemverRangeREs & res
+             , bool                   incPr
+             )
+{
+  std::string comp( trimSpace( _comp ) );
+  std::smatch m;
+  if ( ! std::regex_match( comp, m, res.xrange ) ) { return comp; }
+  std::string gtlt = m[1].str(), M = m[2].str(), mi = m[3].str()
+            , p = m[4].str();
+  bool xM   = isX( M );
+  bool xm   = xM || isX( mi );
+  bool xp   = xm || isX( p );
+  bool anyX = xp;
+
+  if ( ( gtlt == "=" ) && anyX ) { gtlt = ""; }
+
+  std::string pr = incPr ? "-0" : "";
+
+  if ( xM )
+    {
+      if ( ( gtlt == ">" ) || ( gtlt == "<" ) ) { return "<0.0.0-0"; }
+      return "*";
+    }
+  if ( ( ! gtlt.empty() ) && anyX )
+    {
+      if ( xm ) { mi = "0"; }
+      p = "0";
+      if ( gtlt == ">" )
+        {
+          gtlt = ">=";
+          if ( xm ) { M = incr( M ); mi = "0"; }
+          else      { mi = incr( mi );         }
+        }
+      else if ( gtlt == "<=" )
+        {
+          gtlt = "<";
+          if ( xm ) { M = incr( M );   }
+          else      { mi = incr( mi ); }
+        }
+      if ( gtlt == "<" ) { pr = "-0"; }
+      return gtlt + M + "." + mi + "." + p + pr;
+    }
+  if ( xm ) { return ">=" + M + ".0.0" + pr + " <" + incr( M ) + ".0.0-0"; }
+  if ( xp )
+    {
+      return ">=" + M + "." + mi + ".0" + pr + " <" + M + "." + incr( mi ) +
+             ".0-0";
+    }
+  return comp;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Desugar a single `||' separated member of a range into primitive
+ * comparators, appending them to @a out.
+ * @return `false` if the range is invalid.
+ */
+  static bool
+parseRangeSet( const std::string                         & range
+             ,       bool                                  loose
+             ,       bool                                  incPr
+             ,       std::vector<SemverRange::Comparator>  & out
+             )
+{
+  const SemverRangeREs & res = loose ? semverRangeLooseREs
+                                     : semverRangeStrictREs;
+  std::string r = replaceHyphen( range, res, incPr );
+  r = std::regex_replace( r, semverComparatorTrimRE, "$1$2$3" );
+  r = std::regex_replace( r, semverTildeTrimRE, "$1~" );
+  r = std::regex_replace( r, semverCaretTrimRE, "$1^" );
+
+  std::vector<std::string> comps;
+  for ( const std::string & comp : splitSpaces( r ) )
+    {
+      std::vector<std::string> parts;
+      for ( const std::string & c : splitSpaces( std::string( trimSpace( comp ) ) ) )
+        {
+          parts.push_back( replaceCaret( c, res, incPr ) );
+        }
+      std::string c = joinSpaces( parts );
+      parts.clear();
+      for ( const std::string & t : splitSpaces( std::string( trimSpace( c ) ) ) )
+        {
+          parts.push_back( replaceTilde( t, res ) );
+        }
+      c = joinSpaces( parts );
+      parts.clear();
+      for ( const std::string & t : splitSpaces( c ) )
+        {
+          parts.push_back( replaceXRange( t, res, incPr ) );
+        }
+      c = std::regex_replace( std::string( trimSpace( joinSpaces( parts ) ) )
+                            , semverStarRE
+                            , ""
+                            , std::regex_constants::format_first_only
+                            );
+      comps.push_back( std::move( c ) );
+    }
+
+  for ( std::string & comp : splitSpaces( joinSpaces( comps ) ) )
+    {
+      comp = std::string( trimSpace( comp ) );
+      if ( std::regex_match( comp, incPr ? semverGTE0PreRE : semverGTE0RE ) )
+        {
+          comp = "";
+        }
+      std::smatch m;
+      if ( ! std::regex_match( comp, m, res.comparator ) )
+        {
+          /* Loose mode silently drops invalid comparators. */
+          if ( loose ) { continue; }
+          return false;
+        }
+      SemverRange::Comparator c;
+      if ( m[2].length() == 0 )
+        {
+          c.op = SemverRange::OP_ANY;
+        }
+      else
+        {
+          std::optional<Semver> v = parseSemver( m[2].str(), loose );
+          if ( ! v.has_value() ) { return false; }
+          c.version = std::move( v.value() );
+          std::string op = m[1].str();
+          if ( ( op == "" ) || ( op == "=" ) ) { c.op = SemverRange::OP_EQ; }
+          else if ( op == "<" )                { c.op = SemverRange::OP_LT; }
+          else if ( op == "<=" )               { c.op = SemverRange::OP_LE; }
+          else if ( op == ">" )                { c.op = SemverRange::OP_GT; }
+          else                                 { c.op = SemverRange::OP_GE; }
+        }
+      out.push_back( std::move( c ) );
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::optional<SemverRange>
+SemverRange::parse( std::string_view range, bool loose, bool includePrerelease )
+{
+  SemverRange rsl;
+  rsl._loose             = loose;
+  rsl._includePrerelease = includePrerelease;
+
+  /* Collapse whitespace before splitting on `||'. */
+  std::string raw = joinSpaces( splitSpaces( std::string( trimSpace( range ) ) ) );
+
+  try
+    {
+      size_t start = 0;
+      while ( true )
+        {
+          size_t end = raw.find( "||", start );
+          std::string member( trimSpace(
+            std::string_view( raw ).substr(
+              start
+            , ( end == std::string::npos ) ? std::string::npos : ( end - start )
+            )
+          ) );
+          std::vector<Comparator> comps;
+          if ( ! parseRangeSet( member, loose, includePrerelease, comps ) )
+            {
+              return std::nullopt;
+            }
+          /* Empty sets are discarded, which only occurs in loose mode. */
+          if ( ! comps.empty() ) { rsl._set.push_back( std::move( comps ) ); }
+          if ( end == std::string::npos ) { break; }
+          start = end + 2;
+        }
+    }
+  catch( const std::exception & )
+    {
+      /* Version components which overflow when incremented. */
+      return std::nullopt;
+    }
+
+  if ( rsl._set.empty() ) { return std::nullopt; }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+SemverRange::Comparator::test( const Semver & version ) const
+{
+  switch ( this->op )
+    {
+      case OP_ANY: return true;                                    break;
+      case OP_EQ:  return version.compare( this->version ) == 0;   break;
+      case OP_LT:  return version.compare( this->version ) <  0;   break;
+      case OP_LE:  return version.compare( this->version ) <= 0;   break;
+      case OP_GT:  return version.compare( this->version ) >  0;   break;
+      case OP_GE:  return version.compare( this->version ) >= 0;   break;
+      default:     return false;                                   break;
+    }
+}
+
+
+  bool
+SemverRange::test( const Semver & version ) const
+{
+  for ( const std::vector<Comparator> & comps : this->_set )
+    {
+      bool ok = true;
+      for ( const Comparator & c : comps )
+        {
+          if ( ! c.test( version ) ) { ok = false; break; }
+        }
+      if ( ! ok ) { continue; }
+
+      if ( version.prerelease.empty() || this->_includePrerelease )
+        {
+          return true;
+        }
+
+      /* Prereleases are only allowed to match comparators which explicitly
+       * name a prerelease on the same `[major, minor, patch]' tuple. */
+      for ( const Comparator & c : comps )
+        {
+          if ( ( c.op != OP_ANY ) && ( ! c.version.prerelease.empty() ) &&
+               ( c.version.major == version.major ) &&
+               ( c.version.minor == version.minor ) &&
+               ( c.version.patch == version.patch )
+             )
+            {
+              return true;
+            }
+        }
+    }
+  return false;
+}
+
+
+  bool
+SemverRange::test( std::string_view version ) const
+{
+  std::optional<Semver> v = parseSemver( version, this->_loose );
+  return v.has_value() && this->test( v.value() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  std::string
+SemverRange::toString() const
+{
+  std::string rsl;
+  for ( size_t i = 0; i < this->_set.size(); ++i )
+    {
+      if ( i != 0 ) { rsl += "||"; }
+      for ( size_t j = 0; j < this->_set[i].size(); ++j )
+        {
+          const Comparator & c = this->_set[i][j];
+          if ( j != 0 ) { rsl += ' '; }
+          switch ( c.op )
+            {
+              case OP_ANY: continue;    break;
+              case OP_EQ:               break;
+              case OP_LT:  rsl += "<";  break;
+              case OP_LE:  rsl += "<="; break;
+              case OP_GT:  rsl += ">";  break;
+              case OP_GE:  rsl += ">="; break;
+            }
+          rsl += c.version.toString();
+        }
+    }
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 #ifndef SEMVER_PATH
@@ -186,19 +964,24 @@ runSemver( const std::list<std::string> & args )
   std::list<std::string>
 semverSat( const std::string & range, const std::list<std::string> & versions )
 {
-  std::list<std::string> args = {
-    "--include-prerelease", "--loose", "--range", range
-  };
-  for ( auto & v : versions ) { args.push_back( v ); }
-  auto [ec, lines] = runSemver( args );
-  if ( ! nix::statusOk( ec ) ) { return {}; }
-  std::list<std::string> rsl;
-  std::stringstream ss( lines );
-  std::string l;
-  while ( std::getline( ss, l, '\n' ) )
+  std::optional<SemverRange> r = SemverRange::parse( range, true, true );
+  if ( ! r.has_value() ) { return {}; }
+
+  /* Like `semver' we only consider versions which are strictly valid, but
+   * test them against the range using loose parsing. */
+  std::vector<Semver> sats;
+  for ( const std::string & v : versions )
     {
-      if ( ! l.empty() ) { rsl.push_back( std::move( l ) ); }
+      std::optional<Semver> sv = parseSemver( v, false );
+      if ( sv.has_value() && r->test( sv.value() ) )
+        {
+          sats.push_back( std::move( sv.value() ) );
+        }
     }
+  std::stable_sort( sats.begin(), sats.end() );
+
+  std::list<std::string> rsl;
+  for ( const Semver & sv : sats ) { rsl.push_back( sv.toString() ); }
   return rsl;
 }
 
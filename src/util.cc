@@ -5,6 +5,8 @@
  * -------------------------------------------------------------------------- */
 
 #include <algorithm>
+#include <map>
+#include <tuple>
 #include "flox/util.hh"
 #include "flox/types.hh"
 #include "flox/resolved.hh"
@@ -88,6 +90,62 @@ isSubstitutable( std::string_view storePath )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  nix::ref<nix::eval_cache::EvalCache>
+getEvalCache( nix::ref<nix::EvalState>                 state
+            , std::shared_ptr<nix::flake::LockedFlake> flake
+            )
+{
+  bool useDb = nix::evalSettings.useEvalCache && nix::evalSettings.pureEval;
+  nix::flake::Fingerprint fingerprint = flake->getFingerprint();
+
+  /* Handles are only held weakly here, so they close with their last user.
+   * The root loader holds `state', so a live entry's key can't be reused by
+   * another `EvalState'. */
+  using Key = std::tuple<nix::EvalState *, std::string, bool>;
+  static std::map<Key, std::weak_ptr<nix::eval_cache::EvalCache>> handles;
+
+  Key key( & * state, fingerprint.to_string( nix::Base16, false ), useDb );
+  if ( auto search = handles.find( key ); search != handles.end() )
+    {
+      if ( auto cache = search->second.lock() )
+        {
+          return nix::ref<nix::eval_cache::EvalCache>( cache );
+        }
+    }
+  for ( auto it = handles.begin(); it != handles.end(); )
+    {
+      if ( it->second.expired() ) { it = handles.erase( it ); }
+      else                        { ++it;                     }
+    }
+
+  nix::ref<nix::eval_cache::EvalCache> cache =
+    nix::make_ref<nix::eval_cache::EvalCache>(
+      useDb ? std::optional { std::cref( fingerprint ) } : std::nullopt
+    , * state
+    , [state, flake]()
+      {
+        nix::Value * vFlake = state->allocValue();
+        nix::flake::callFlake( * state, * flake, * vFlake );
+        state->forceAttrs(
+          * vFlake, nix::noPos, "while parsing cached flake data"
+        );
+        nix::Attr * aOutputs = vFlake->attrs->get(
+          state->symbols.create( "outputs" )
+        );
+        assert( aOutputs != nullptr );
+        return aOutputs->value;
+      }
+    );
+  handles.insert_or_assign(
+    key
+  , (std::shared_ptr<nix::eval_cache::EvalCache>) cache
+  );
+  return cache;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   }  /* End namespace `flox::resolve' */
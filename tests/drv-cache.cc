@@ -4,6 +4,8 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <filesystem>
+#include <unistd.h>
 #include "test.hh"
 #include "resolve.hh"
 #include "flox/drv-cache.hh"
@@ -44,6 +46,262 @@ test_getDrvInfos1( DrvDb * cache )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Ensure filtered queries agree with the equivalent predicates. */
+  bool
+test_getDrvInfosFiltered1( DrvDb * cache, Preferences & prefs )
+{
+  Descriptor desc( nlohmann::json { { "name", "hello" } } );
+  predicates::PkgPred pred = prefs.pred_V2();
+  pred = pred && desc.pred();
+
+  std::list<nlohmann::json> filtered = cache->getDrvInfos(
+    "legacyPackages", "x86_64-linux", prefs.filter_V2() && desc.filter()
+  );
+  size_t expected = 0;
+  for ( const nlohmann::json & info :
+          cache->getDrvInfos( "legacyPackages", "x86_64-linux" )
+      )
+    {
+      if ( pred( CachedPackage( info ) ) ) { ++expected; }
+    }
+  for ( const nlohmann::json & info : filtered )
+    {
+      if ( ! pred( CachedPackage( info ) ) ) { return false; }
+    }
+  return ( 0 < expected ) && ( filtered.size() == expected );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure sets with the highest recorded cost are claimed first. */
+  bool
+test_claimSubtree1( DrvDb * cache )
+{
+  const std::optional<std::string_view> stability = std::nullopt;
+  cache->pushSubtree( "test", "x86_64-linux", { "a" } );
+  cache->pushSubtree( "test", "x86_64-linux", { "b" } );
+  cache->resetSubtrees( "test", "x86_64-linux", stability );
+  for ( size_t i = 0; i < 2; ++i )
+    {
+      auto path = cache->claimSubtree( "test", "x86_64-linux", stability, 1 );
+      if ( ! path.has_value() ) { return false; }
+      cache->finishSubtree( "test", "x86_64-linux", path.value()
+                          , ( path.value()[0] == "b" ) ? 10 : 1
+                          );
+    }
+  if ( cache->countOpenSubtrees( "test", "x86_64-linux", stability ) != 0 )
+    {
+      return false;
+    }
+
+  cache->resetSubtrees( "test", "x86_64-linux", stability );
+  auto first = cache->claimSubtree( "test", "x86_64-linux", stability, 1 );
+  if ( first != std::vector<std::string> { "b" } ) { return false; }
+  cache->finishSubtree( "test", "x86_64-linux", first.value(), 10 );
+  auto second = cache->claimSubtree( "test", "x86_64-linux", stability, 1 );
+  if ( second != std::vector<std::string> { "a" } ) { return false; }
+  cache->finishSubtree( "test", "x86_64-linux", second.value(), 1 );
+  return ! cache->claimSubtree( "test", "x86_64-linux", stability, 1 )
+             .has_value();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure a claim left behind by a failed run of the waiting worker is
+ * released so that it may be claimed again, instead of being waited on. */
+  bool
+test_releaseStaleSubtrees1( DrvDb * cache )
+{
+  const std::optional<std::string_view> stability = std::nullopt;
+  int64_t self = getpid();
+  cache->pushSubtree( "test", "armv7l-linux", { "f" } );
+  cache->resetSubtrees( "test", "armv7l-linux", stability );
+  auto stale = cache->claimSubtree( "test", "armv7l-linux", stability, self );
+  if ( ( ! stale.has_value() ) ||
+       cache->claimSubtree( "test", "armv7l-linux", stability, self )
+         .has_value() ||
+       ( cache->releaseStaleSubtrees( "test", "armv7l-linux", stability, self )
+         != 1
+       )
+     )
+    {
+      return false;
+    }
+  auto again = cache->claimSubtree( "test", "armv7l-linux", stability, self );
+  if ( again != stale ) { return false; }
+  cache->finishSubtree( "test", "armv7l-linux", again.value(), 1 );
+  return cache->countOpenSubtrees( "test", "armv7l-linux", stability ) == 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure interrupted sets are resumed from their checkpoint. */
+  bool
+test_resumeSubtrees1( DrvDb * cache )
+{
+  const std::optional<std::string_view> stability = std::nullopt;
+  cache->pushSubtree( "test", "aarch64-linux", { "d" } );
+  cache->pushSubtree( "test", "aarch64-linux", { "e" } );
+  cache->resetSubtrees( "test", "aarch64-linux", stability );
+
+  /* One worker is killed after a checkpoint, while another finishes. */
+  auto killed = cache->claimSubtree( "test", "aarch64-linux", stability, 2 );
+  auto done   = cache->claimSubtree( "test", "aarch64-linux", stability, 3 );
+  if ( ( ! killed.has_value() ) || ( ! done.has_value() ) ) { return false; }
+  cache->checkpointSubtree( "test", "aarch64-linux", killed.value(), "x" );
+  cache->finishSubtree( "test", "aarch64-linux", done.value(), 1 );
+
+  if ( cache->resumeSubtrees( "test", "aarch64-linux", stability ) != 1 )
+    {
+      return false;
+    }
+  auto resumed = cache->claimSubtree( "test", "aarch64-linux", stability, 4 );
+  if ( ( resumed != killed ) ||
+       ( cache->getSubtreeCheckpoint( "test", "aarch64-linux"
+                                    , resumed.value()
+                                    ) != "x"
+       )
+     )
+    {
+      return false;
+    }
+  cache->finishSubtree( "test", "aarch64-linux", resumed.value(), 1 );
+
+  /* Finished runs aren't resumed, and start over without checkpoints. */
+  if ( cache->resumeSubtrees( "test", "aarch64-linux", stability ) != 0 )
+    {
+      return false;
+    }
+  cache->resetSubtrees( "test", "aarch64-linux", stability );
+  return ! cache->getSubtreeCheckpoint( "test", "aarch64-linux", { "d" } )
+             .has_value();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure stabilities track progress separately, falling back to the
+ * progress of their subtree/system. */
+  bool
+test_ProgressStability1( DrvDb * cache )
+{
+  cache->promoteProgress( "test", "i686-linux", "stable", DBPS_INFO_DONE );
+  if ( ( cache->getProgress( "test", "i686-linux", "stable" ) !=
+         DBPS_INFO_DONE
+       ) ||
+       ( cache->getProgress( "test", "i686-linux", "unstable" ) !=
+         DBPS_NONE
+       ) ||
+       ( cache->getProgress( "test", "i686-linux" ) != DBPS_NONE )
+     )
+    {
+      return false;
+    }
+  cache->setProgress( "test", "i686-linux", DBPS_INFO_DONE );
+  return cache->getProgress( "test", "i686-linux", "unstable" ) ==
+         DBPS_INFO_DONE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure probed prefixes are recorded, and missing catalogs hide their
+ * stabilities. */
+  bool
+test_recordPrefix1( DrvDb * cache )
+{
+  if ( cache->hasPrefix( "test", "x86_64-darwin", std::nullopt ).has_value() )
+    {
+      return false;
+    }
+  cache->recordPrefix( "test", "x86_64-darwin", std::nullopt, true );
+  cache->recordPrefix( "test", "aarch64-darwin", std::nullopt, false );
+  return ( cache->hasPrefix( "test", "x86_64-darwin", std::nullopt ) ==
+           true
+         ) &&
+         ( cache->getProgress( "test", "x86_64-darwin" ) == DBPS_NONE ) &&
+         ( cache->hasPrefix( "test", "aarch64-darwin", "stable" ) == false ) &&
+         ( cache->getProgress( "test", "aarch64-darwin" ) == DBPS_MISSING );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure failures are recorded and remembered. */
+  bool
+test_FailedDrvs1( DrvDb * cache )
+{
+  const std::optional<std::string_view> stability = std::nullopt;
+  if ( cache->isFailedDrv( "test", "x86_64-linux", { "broken" } ) )
+    {
+      return false;
+    }
+  /* Only evaluation errors are expected to recur. */
+  try
+    {
+      throw nix::SysError( "oops" );
+    }
+  catch( ... )
+    {
+      if ( getEvalErrorClass().has_value() ) { return false; }
+    }
+  try
+    {
+      throw nix::TypeError( "oops" );
+    }
+  catch( ... )
+    {
+      std::optional<std::string> err = getEvalErrorClass();
+      if ( err != "type" ) { return false; }
+      cache->setFailedDrv( "test", "x86_64-linux", { "broken" }, * err );
+    }
+  if ( ! cache->isFailedDrv( "test", "x86_64-linux", { "broken" } ) )
+    {
+      return false;
+    }
+
+  cache->pushSubtree( "test", "x86_64-linux", { "c" } );
+  cache->resetSubtrees( "test", "x86_64-linux", stability );
+  while ( auto path =
+            cache->claimSubtree( "test", "x86_64-linux", stability, 1 )
+        )
+    {
+      cache->finishSubtree( "test", "x86_64-linux", path.value(), 1, 2 );
+    }
+  return ( cache->countFailedDrvs( "test", "x86_64-linux" ) == 1 ) &&
+         ( 2 <= cache->countSkippedSubtrees( "test", "x86_64-linux"
+                                           , stability
+                                           )
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure paths recorded without info are reported until it is filled. */
+  bool
+test_getDrvPathsMissingInfo1( DrvDb * cache )
+{
+  if ( ! cache->getDrvPathsMissingInfo( "legacyPackages"
+                                      , "x86_64-linux"
+                                      ).empty()
+     )
+    {
+      return false;
+    }
+  cache->setDrv( "test", "x86_64-linux", { "pathOnly" } );
+  std::list<std::vector<std::string>> missing =
+    cache->getDrvPathsMissingInfo( "test", "x86_64-linux" );
+  return ( missing.size() == 1 ) &&
+         ( missing.front() == std::vector<std::string> { "pathOnly" } );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   bool
@@ -110,6 +368,10 @@ main()
   Preferences     prefs;
   ResolverState   rs( inputs, prefs );
   DrvDb         * cache = nullptr;
+  /* Tests which write are run against a fresh database so that they don't
+   * see the rows of earlier runs. */
+  std::string     tmpDir  = nix::createTempDir();
+  DrvDb         * scratch = nullptr;
   {
     std::shared_ptr<nix::flake::LockedFlake> flake  =
       rs.getInput( "nixpkgs" ).value()->getLockedFlake();
@@ -121,16 +383,27 @@ main()
                          );
       cachePackageSet( fps );
     }
-    cache = new DrvDb( flake->getFingerprint() );
+    cache   = new DrvDb( flake->getFingerprint() );
+    scratch = new DrvDb( flake->getFingerprint(), tmpDir + "/drvs.sqlite" );
   }
 
   RUN_TEST( getDrvInfo1, cache );
   RUN_TEST( getDrvInfos1, cache );
+  RUN_TEST( getDrvInfosFiltered1, cache, prefs );
+  RUN_TEST( claimSubtree1, scratch );
+  RUN_TEST( releaseStaleSubtrees1, scratch );
+  RUN_TEST( resumeSubtrees1, scratch );
+  RUN_TEST( ProgressStability1, scratch );
+  RUN_TEST( recordPrefix1, scratch );
+  RUN_TEST( FailedDrvs1, scratch );
+  RUN_TEST( getDrvPathsMissingInfo1, scratch );
   RUN_TEST( CachedPackageFromDb1, cache );
   RUN_TEST( CachedPackageFromDb2, cache, prefs );
   RUN_TEST( CachedPackageFromInfo1, cache );
 
   delete cache;
+  delete scratch;
+  std::filesystem::remove_all( tmpDir );
 
   return ec;
 }
@@ -12,6 +12,8 @@
 #include "flox/db-package-set.hh"
 #include "flox/flake-package-set.hh"
 #include "flox/cached-package-set.hh"
+#include "flox/index-package-set.hh"
+#include "flox/columnar-package-set.hh"
 #include "flox/resolver-state.hh"
 
 
@@ -126,6 +128,94 @@ test_RawPackageSet_addPackage1()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+  bool
+test_ColumnarPackageSet1()
+{
+  RawPackageSet raw {
+    {}
+  , ST_LEGACY
+  , "x86_64-linux"
+  , std::nullopt
+  , nix::parseFlakeRef( nixpkgsRef )
+  };
+  raw.addPackage( RawPackage(
+    std::vector<std::string> { "legacyPackages", "x86_64-linux", "hello" }
+  , "hello-2.12.1"
+  , "hello"
+  , "2.12.1"
+  , "2.12.1"
+  , "GPL-3.0-or-later"
+  , std::vector<std::string> { "out" }
+  , std::vector<std::string> { "out" }
+  , std::make_optional( false )
+  , std::make_optional( false )
+  , true
+  , true
+  , true
+  ) );
+  raw.addPackage( RawPackage(
+    std::vector<std::string> { "legacyPackages", "x86_64-linux", "bash" }
+  , "bash-5.2"
+  , "bash"
+  , "5.2"
+  , std::nullopt
+  , std::nullopt
+  , std::vector<std::string> { "out", "man" }
+  , std::vector<std::string> { "out" }
+  , std::nullopt
+  , std::make_optional( true )
+  , true
+  , true
+  , true
+  ) );
+
+  ColumnarPackageSet ps( raw );
+  if ( ps.size() != 2 ) { return false; }
+
+  std::shared_ptr<Package> p = ps.maybeGetRelPath( { "hello" } );
+  if ( ( p == nullptr ) ||
+       ( p->getPathStrs() !=
+         std::vector<std::string> { "legacyPackages", "x86_64-linux", "hello" }
+       ) ||
+       ( p->getLicense() != "GPL-3.0-or-later" ) ||
+       ( p->isBroken() != false )
+     )
+    {
+      return false;
+    }
+
+  std::shared_ptr<Package> b = ps.maybeGetRelPath( { "bash" } );
+  if ( ( b == nullptr ) ||
+       b->getLicense().has_value() ||
+       b->isBroken().has_value() ||
+       ( b->getOutputs() != std::vector<std::string> { "out", "man" } )
+     )
+    {
+      return false;
+    }
+
+  DrvInfoFilter byName;
+  byName.name = "hello-2.12.1";
+  DrvInfoFilter noUnfree;
+  noUnfree.excludeUnfree = true;
+  DrvInfoFilter byLicense;
+  byLicense.licenses = std::vector<std::string> { "MIT" };
+
+  size_t c = 0;
+  for ( auto & pkg : ps ) { (void) pkg; ++c; }
+
+  return ( c == 2 ) &&
+         ( ps.filter( byName ).size() == 1 ) &&
+         ( ps.filter( noUnfree ).size() == 1 ) &&
+         ( ps.filter( byLicense ).empty() ) &&
+         ( ps.filter( DrvInfoFilter(), predicates::hasVersion( "5.2" ) )
+             .size() == 1
+         );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   bool
@@ -154,6 +244,94 @@ test_DbPackageSet_size1( std::shared_ptr<nix::flake::LockedFlake> flake )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Ensure lookups are answered by stored rows once paths are known. */
+  bool
+test_CachedPackageSet_hybrid1(
+  ResolverState                            & rs
+, std::shared_ptr<nix::flake::LockedFlake>   flake
+)
+{
+  DrvDb db( flake->getFingerprint() );
+  db.setProgress( "legacyPackages", "x86_64-linux", DBPS_PATHS_DONE );
+  bool rsl = false;
+  {
+    CachedPackageSet ps( rs.getEvalState()
+                       , flake
+                       , ST_LEGACY
+                       , "x86_64-linux"
+                       );
+    std::shared_ptr<Package> hello = ps.maybeGetRelPath( { "hello" } );
+    rsl = ( hello != nullptr ) &&
+          ( dynamic_cast<CachedPackage *>( hello.get() ) != nullptr ) &&
+          ps.hasRelPath( { "hello" } ) &&
+          ( ! ps.hasRelPath( { "not-a-package" } ) ) &&
+          ( ps.maybeGetRelPath( { "not-a-package" } ) == nullptr ) &&
+          ( ps.size() == db.countDrvs( "legacyPackages", "x86_64-linux" ) );
+  }
+  db.setProgress( "legacyPackages", "x86_64-linux", DBPS_INFO_DONE );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure populating a prefix whose paths are known only fills their info,
+ * after which iteration reads stored rows. */
+  bool
+test_CachedPackageSet_populate1(
+  ResolverState                            & rs
+, std::shared_ptr<nix::flake::LockedFlake>   flake
+)
+{
+  DrvDb db( flake->getFingerprint() );
+  db.setProgress( "legacyPackages", "x86_64-linux", DBPS_PATHS_DONE );
+  CachedPackageSet ps( rs.getEvalState(), flake, ST_LEGACY, "x86_64-linux" );
+  ps.populate();
+  DbPackageSet dps( flake, ST_LEGACY, "x86_64-linux" );
+  size_t c = 0;
+  for ( auto & p : ps ) { (void) p; ++c; }
+  return ( db.getProgress( "legacyPackages", "x86_64-linux" ) ==
+           DBPS_INFO_DONE
+         ) &&
+         ( c == dps.size() ) &&
+         ( ps.size() == c );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Index the cached DB and compare it with `DbPackageSet'. */
+  bool
+test_IndexPackageSet1( std::shared_ptr<nix::flake::LockedFlake> flake )
+{
+  std::string path = nix::createTempDir() + "/test.fpi";
+  {
+    DrvDb db( flake->getFingerprint(), false, false );
+    writePackageIndex( db, path );
+  }
+  DbPackageSet    dps( flake, ST_LEGACY, "x86_64-linux" );
+  IndexPackageSet ips( std::make_shared<const PackageIndex>( path )
+                     , flake->flake.lockedRef
+                     , ST_LEGACY
+                     , "x86_64-linux"
+                     );
+  size_t c = 0;
+  for ( auto & p : ips ) { (void) p; ++c; }
+  if ( ( c != ips.size() ) || ( c != dps.size() ) ) { return false; }
+
+  std::shared_ptr<Package> p = ips.maybeGetRelPath( { "hello" } );
+  std::shared_ptr<Package> d = dps.maybeGetRelPath( { "hello" } );
+  return ( p != nullptr ) &&
+         ( p->getPathStrs() == d->getPathStrs() ) &&
+         ( p->getFullName() == d->getFullName() ) &&
+         ( p->getOutputs() == d->getOutputs() ) &&
+         ( ! ips.hasRelPath( { "hello", "nope" } ) ) &&
+         ( ! ips.getPname( "hello" ).empty() );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   bool
@@ -209,6 +387,27 @@ test_FlakePackageSet_iterator1(
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Ensure package sets on the same flake share one `EvalCache'. */
+  bool
+test_getEvalCache1(
+  ResolverState                            & rs
+, std::shared_ptr<nix::flake::LockedFlake>   flake
+)
+{
+  nix::ref<nix::eval_cache::EvalCache> a =
+    getEvalCache( rs.getEvalState(), flake );
+  nix::ref<nix::eval_cache::EvalCache> b =
+    getEvalCache( rs.getEvalState(), flake );
+  FlakePackageSet ps( rs.getEvalState(), flake, ST_LEGACY, "x86_64-linux" );
+  return ( & * a == & * b ) &&
+         ps.hasRelPath( { "hello" } ) &&
+         ( ps.maybeGetRelPath( { "hello" } ) != nullptr ) &&
+         ( & * rs.getInput( "nixpkgs" ).value()->openEvalCache() == & * a );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   int
@@ -219,6 +418,7 @@ main()
 
   RUN_TEST( RawPackageSet_iterator1 );
   RUN_TEST( RawPackageSet_addPackage1 );
+  RUN_TEST( ColumnarPackageSet1 );
 
   Inputs      inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
   Preferences prefs;
@@ -237,11 +437,15 @@ main()
 
   RUN_TEST( DbPackageSet_size1,     flake );
   RUN_TEST( DbPackageSet_iterator1, flake );
+  RUN_TEST( IndexPackageSet1,       flake );
+  RUN_TEST( CachedPackageSet_hybrid1, rs, flake );
+  RUN_TEST( CachedPackageSet_populate1, rs, flake );
 
   RUN_TEST( FlakePackageSet_hasRelPath1,      rs, flake );
   RUN_TEST( FlakePackageSet_maybeGetRelPath1, rs, flake );
   RUN_TEST( FlakePackageSet_size1,            rs, flake );
   RUN_TEST( FlakePackageSet_iterator1,        rs, flake );
+  RUN_TEST( getEvalCache1,                    rs, flake );
 
   return ec;
 }
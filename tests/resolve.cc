@@ -8,7 +8,12 @@
 #include <nlohmann/json.hpp>
 #include <nix/flake/flake.hh>
 #include <nix/fetchers.hh>
+#include <filesystem>
 #include "resolve.hh"
+#include "flox/result-cache.hh"
+#include "flox/lock-cache.hh"
+#include "flox/drv-cache.hh"
+#include "flox/package-index.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -63,6 +68,112 @@ test_resolveInInput2()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Ensure uncached package sets are populated through our `CachedInput',
+ * skipping attributes which fail to evaluate, and marked as done.
+ * Then ensure a package index is read in place of the database. */
+  bool
+test_resolveInInput3()
+{
+  std::string dir = nix::createTempDir();
+  nix::writeFile( dir + "/flake.nix", R"nix({
+  outputs = _: {
+    legacyPackages.x86_64-linux = {
+      broken = throw "broken";
+      hello  = derivation {
+        pname   = "hello";
+        version = "2.12";
+        name    = "hello-2.12";
+        system  = "x86_64-linux";
+        builder = "/bin/sh";
+      };
+    };
+  };
+})nix" );
+  Inputs      inputs( nlohmann::json { { "local", "path:" + dir } } );
+  Preferences prefs;
+  bool rsl = false;
+  {
+    ResolverState rs( inputs, prefs );
+    Descriptor    desc( nlohmann::json { { "name", "hello" } } );
+    std::list<Resolved> results = rs.resolveInInput( "local", desc );
+    nix::ref<DrvDb> cache = rs.getCachedInput( "local" ).value()->getDrvDb();
+    rsl = ( results.size() == 1 ) &&
+          ( results.front().info["x86_64-linux"]["version"] == "2.12" ) &&
+          ( cache->getProgress( "legacyPackages", "x86_64-linux" ) ==
+            DBPS_INFO_DONE
+          ) &&
+          cache->isFailedDrv( "legacyPackages", "x86_64-linux", { "broken" } );
+
+    /* Once indexed, later states read the same results from the index. */
+    std::string index = getPackageIndexName( cache->fingerprint );
+    writePackageIndex( * cache, index );
+    ResolverState rs2( inputs, prefs );
+    rsl = rsl &&
+          ( rs2.getCachedInput( "local" ).value()->getPackageIndex() !=
+            nullptr
+          ) &&
+          ( nlohmann::json( rs2.resolveInInput( "local", desc ) ) ==
+            nlohmann::json( results )
+          );
+    std::filesystem::remove( index );
+  }
+  std::filesystem::remove_all( dir );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure absolute and relative paths agree, and are cached once looked up. */
+  bool
+test_resolvePathInInput1()
+{
+  Inputs        inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
+  Preferences   prefs;
+  ResolverState rs( inputs, prefs );
+  Descriptor    abs( nlohmann::json {
+    { "path", { "legacyPackages", "x86_64-linux", "hello" } }
+  } );
+  Descriptor    glob( nlohmann::json {
+    { "path", { "legacyPackages", nullptr, "hello" } }
+  } );
+  Descriptor    rel( nlohmann::json { { "path", { "hello" } } } );
+  std::list<Resolved> a = rs.resolveInInput( "nixpkgs", abs );
+  std::list<Resolved> g = rs.resolveInInput( "nixpkgs", glob );
+  std::list<Resolved> r = rs.resolveInInput( "nixpkgs", rel );
+  if ( ( a.size() != 1 ) || ( g.size() != 1 ) || ( r.size() != 1 ) )
+    {
+      return false;
+    }
+  DrvDb cache( rs.getInput( "nixpkgs" ).value()->getFingerprint() );
+  return ( a.front().info["x86_64-linux"] ==
+           g.front().info["x86_64-linux"]
+         ) &&
+         ( nlohmann::json( g ) == nlohmann::json( r ) ) &&
+         cache.getDrvInfo( "legacyPackages", "x86_64-linux", { "hello" } )
+           .has_value();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure ranked search picks the best of a full resolution. */
+  bool
+test_resolveOneInInput1()
+{
+  Inputs        inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
+  Preferences   prefs;
+  ResolverState rs( inputs, prefs );
+  Descriptor    desc( nlohmann::json { { "name", "hello" } } );
+  std::list<Resolved>     results = rs.resolveInInput( "nixpkgs", desc );
+  std::optional<Resolved> one     = rs.resolveOneInInput( "nixpkgs", desc );
+  if ( results.empty() || ( ! one.has_value() ) ) { return false; }
+  return results.front().toJSON() == one.value().toJSON();
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /* Ensure name resolution works. */
@@ -83,6 +194,226 @@ test_resolve_V2_1()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Ensure batches produce the same results as individual resolutions. */
+  bool
+test_resolveBatch_V2_1()
+{
+  Inputs        inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
+  Preferences   prefs;
+  ResolverState rs( inputs, prefs );
+  rs.setUseResultCache( false );
+  std::vector<Descriptor> descs = {
+    Descriptor( nlohmann::json { { "name", "hello" } } )
+  , Descriptor( nlohmann::json { { "path", { "hello" } } } )
+  , Descriptor( nlohmann::json { { "name", "not-a-real-package" } } )
+  };
+  std::vector<std::list<Resolved>> results = resolveBatch_V2( rs, descs );
+  if ( results.size() != descs.size() ) { return false; }
+  for ( size_t i = 0; i < descs.size(); ++i )
+    {
+      if ( nlohmann::json( results[i] ) !=
+           nlohmann::json( resolve_V2( rs, descs[i] ) )
+         )
+        {
+          return false;
+        }
+    }
+  return results[2].empty();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure `one' picks the same catalog result in batches as `resolveOne_V2',
+ * following stability preferences rather than the shortest version. */
+  bool
+test_resolveBatch_V2_2()
+{
+  std::string dir = nix::createTempDir();
+  nix::writeFile( dir + "/flake.nix", R"nix({
+  outputs = _: let
+    mk = version: derivation {
+      pname   = "hello";
+      inherit version;
+      name    = "hello-" + version;
+      system  = "x86_64-linux";
+      builder = "/bin/sh";
+    };
+  in {
+    catalog.x86_64-linux = {
+      stable.hello   = { recurseForDerivations = true; "2_10" = mk "2.10"; };
+      unstable.hello = { recurseForDerivations = true; "2_12" = mk "2.12"; };
+    };
+  };
+})nix" );
+  Inputs      inputs( nlohmann::json { { "catalog", "path:" + dir } } );
+  Preferences prefs( nlohmann::json {
+    { "stabilities", { { "catalog", { "unstable", "stable" } } } }
+  } );
+  bool rsl = false;
+  {
+    ResolverState rs( inputs, prefs );
+    rs.setUseResultCache( false );
+    Descriptor desc( nlohmann::json { { "name", "hello" } } );
+    std::optional<Resolved>          best  = resolveOne_V2( rs, desc );
+    std::vector<std::list<Resolved>> batch = resolveBatch_V2( rs, { desc }
+                                                            , true
+                                                            );
+    rsl = best.has_value() && ( batch.size() == 1 ) &&
+          ( batch[0].size() == 1 ) &&
+          ( best.value().toJSON() == batch[0].front().toJSON() ) &&
+          ( best.value().info["x86_64-linux"]["version"] == "2.12" );
+  }
+  std::filesystem::remove_all( dir );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure worker processes agree with in-process resolution. */
+  bool
+test_resolve_V2_2()
+{
+  Inputs inputs( nlohmann::json {
+    { "nixpkgs", nixpkgsRef }, { "nixpkgs2", nixpkgsRef }
+  } );
+  Preferences prefs( nlohmann::json {
+    { "inputs", { "nixpkgs2", "nixpkgs" } }
+  } );
+  ResolverState rs( inputs, prefs );
+  Descriptor    desc( nlohmann::json { { "name", "hello" } } );
+  rs.setUseResultCache( false );
+  rs.setJobs( 1 );
+  std::list<Resolved> serial      = resolve_V2( rs, desc );
+  std::list<Resolved> serialOne   = resolve_V2( rs, desc, true );
+  /* Workers execute `resolver --worker', which `make check' builds. */
+  rs.setJobs( 2 );
+  rs.setWorkerProgram( "bin/resolver" );
+  std::list<Resolved> parallel    = resolve_V2( rs, desc );
+  std::list<Resolved> parallelOne = resolve_V2( rs, desc, true );
+  return ( ! serial.empty() ) &&
+         ( nlohmann::json( serial ) == nlohmann::json( parallel ) ) &&
+         ( nlohmann::json( serialOne ) == nlohmann::json( parallelOne ) ) &&
+         ( parallelOne.size() == 1 ) &&
+         ( parallelOne.front().inputId == "nixpkgs2" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure a `CachedInput' reports the prefixes it has, and reuses its
+ * package sets. */
+  bool
+test_CachedInput1()
+{
+  Inputs        inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
+  Preferences   prefs;
+  ResolverState rs( inputs, prefs );
+  nix::ref<CachedInput> input = rs.getCachedInput( "nixpkgs" ).value();
+  std::shared_ptr<PackageSet> ps =
+    input->getPackageSet( "legacyPackages", "x86_64-linux" );
+  return input->hasSubtree( ST_LEGACY ) &&
+         ( ! input->hasSubtree( ST_CATALOG ) ) &&
+         input->hasSystem( ST_LEGACY, "x86_64-linux" ) &&
+         input->getStabilities( "x86_64-linux" ).empty() &&
+         ( ps != nullptr ) &&
+         ( ps == input->getPackageSet( ST_LEGACY, "x86_64-linux" ) ) &&
+         ps->hasRelPath( { "hello" } ) &&
+         ( ! rs.getCachedInput( "not-an-input" ).has_value() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure results are stored, including empty ones, and evicted. */
+  bool
+test_ResultCache1()
+{
+  std::string path = nix::createTempDir() + "/results.sqlite";
+  ResultCache cache( path, 64 );
+  nlohmann::json big = nlohmann::json::array( { std::string( 48, 'x' ) } );
+  cache.put( "empty", nlohmann::json::array() );
+  if ( cache.get( "empty" ) != nlohmann::json::array() ) { return false; }
+  if ( cache.get( "missing" ).has_value() )              { return false; }
+  cache.put( "big", big );
+  cache.put( "bigger", big );
+  bool evicted = ! ( cache.get( "empty" ).has_value() &&
+                    cache.get( "big" ).has_value() &&
+                    cache.get( "bigger" ).has_value()
+                  );
+  std::filesystem::remove_all( std::filesystem::path( path ).parent_path() );
+  return evicted;
+}
+
+
+/* Ensure replacing results doesn't count their size again. */
+  bool
+test_ResultCache2()
+{
+  std::string path = nix::createTempDir() + "/results.sqlite";
+  ResultCache cache( path, 64 );
+  nlohmann::json big = nlohmann::json::array( { std::string( 48, 'x' ) } );
+  for ( int i = 0; i < 3; ++i ) { cache.put( "big", big ); }
+  bool rsl = cache.get( "big" ).has_value();
+  std::filesystem::remove_all( std::filesystem::path( path ).parent_path() );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure locked references map to their fingerprint without locking. */
+  bool
+test_LockCache1()
+{
+  std::string   path = nix::createTempDir() + "/locks.sqlite";
+  Inputs        inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
+  Preferences   prefs;
+  ResolverState rs( inputs, prefs );
+  nix::ref<FloxFlake> flake = rs.getInput( "nixpkgs" ).value();
+  std::shared_ptr<nix::flake::LockedFlake> locked = flake->getLockedFlake();
+  LockCache cache( path );
+  bool      rsl = ! cache.get( flake->getFlakeRef() ).has_value();
+  cache.put( flake->getFlakeRef(), * locked );
+  std::optional<LockedRefInfo> info = cache.get( flake->getFlakeRef() );
+  rsl = rsl && info.has_value() &&
+        ( info.value().fingerprint == locked->getFingerprint() ) &&
+        ( info.value().lockedRef == locked->flake.lockedRef );
+  std::filesystem::remove_all( std::filesystem::path( path ).parent_path() );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure unlocked references expire while locked references don't. */
+  bool
+test_LockCache2()
+{
+  std::string   path = nix::createTempDir() + "/locks.sqlite";
+  Inputs        inputs( nlohmann::json { { "nixpkgs", nixpkgsRef } } );
+  Preferences   prefs;
+  ResolverState rs( inputs, prefs );
+  std::shared_ptr<nix::flake::LockedFlake> locked =
+    rs.getInput( "nixpkgs" ).value()->getLockedFlake();
+  FloxFlakeRef unlocked = nix::parseFlakeRef( "github:NixOS/nixpkgs" );
+  LockCache( path, 0 ).put( unlocked, * locked );
+  LockCache expired( path, 0 );
+  LockCache fresh( path );
+  bool rsl = ( ! expired.get( unlocked ).has_value() ) &&
+             expired.get( locked->flake.lockedRef ).has_value() &&
+             fresh.get( unlocked ).has_value() &&
+             ( fresh.get( unlocked ).value().lockedRef ==
+               locked->flake.lockedRef
+             );
+  std::filesystem::remove_all( std::filesystem::path( path ).parent_path() );
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   int
@@ -94,7 +425,18 @@ main()
   RUN_TEST( ResolverStateLocking1 );
   RUN_TEST( resolveInInput1 );
   RUN_TEST( resolveInInput2 );
+  RUN_TEST( resolveInInput3 );
+  RUN_TEST( resolvePathInInput1 );
+  RUN_TEST( resolveOneInInput1 );
   RUN_TEST( resolve_V2_1 );
+  RUN_TEST( resolve_V2_2 );
+  RUN_TEST( resolveBatch_V2_1 );
+  RUN_TEST( resolveBatch_V2_2 );
+  RUN_TEST( CachedInput1 );
+  RUN_TEST( ResultCache1 );
+  RUN_TEST( ResultCache2 );
+  RUN_TEST( LockCache1 );
+  RUN_TEST( LockCache2 );
 
   return ec;
 }
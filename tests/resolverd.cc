@@ -0,0 +1,127 @@
+/* ========================================================================== *
+ *
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include "test.hh"
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <thread>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include <nix/util.hh>
+#include "resolve.hh"
+#include "flox/resolverd.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+using namespace flox::resolve;
+
+/* -------------------------------------------------------------------------- */
+
+/** Start `bin/resolverd', which `make check' builds, listening on @a path. */
+  static pid_t
+startDaemon( const std::string & path )
+{
+  pid_t pid = fork();
+  if ( pid == 0 )
+    {
+      execl( "bin/resolverd", "bin/resolverd", "--socket", path.c_str()
+           , (char *) nullptr
+           );
+      _exit( 127 );
+    }
+  return pid;
+}
+
+
+/** Wait for a daemon to accept requests, giving up after a minute. */
+  static bool
+waitForDaemon( const std::string & path )
+{
+  nlohmann::json ping = {
+    { "inputs", nlohmann::json::object() }
+  , { "descriptors", nlohmann::json::array() }
+  };
+  for ( int i = 0; i < 600; ++i )
+    {
+      try
+        {
+          resolverdRequest( path, ping );
+          return true;
+        }
+      catch( const std::exception & )
+        {
+          std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+        }
+    }
+  return false;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Ensure a descriptor resolved by the daemon matches in-process resolution,
+ * and that a second daemon refuses to take over its socket. */
+  bool
+test_resolverdRequest1()
+{
+  std::string dir  = nix::createTempDir();
+  std::string path = dir + "/resolverd.sock";
+  pid_t       pid  = startDaemon( path );
+  if ( pid < 0 ) { return false; }
+
+  bool rsl = waitForDaemon( path );
+  if ( rsl )
+    {
+      nlohmann::json inputs = { { "nixpkgs", nixpkgsRef } };
+      nlohmann::json desc   = { { "name", "hello" } };
+      nlohmann::json result = resolverdRequest( path
+                                              , { { "inputs",     inputs }
+                                                , { "descriptor", desc   }
+                                                , { "one",        true   }
+                                                }
+                                              );
+      ResolverState rs( Inputs( inputs ), Preferences() );
+      rs.setUseResultCache( false );
+      std::optional<Resolved> expected =
+        resolveOne_V2( rs, Descriptor( desc ) );
+      rsl = expected.has_value() && ( result == expected.value().toJSON() );
+
+      int status = 0;
+      pid_t other = startDaemon( path );
+      rsl &= ( 0 < other ) && ( 0 <= waitpid( other, & status, 0 ) ) &&
+             WIFEXITED( status ) && ( WEXITSTATUS( status ) != 0 );
+    }
+
+  kill( pid, SIGTERM );
+  waitpid( pid, nullptr, 0 );
+  std::filesystem::remove_all( dir );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main()
+{
+  int ec = EXIT_SUCCESS;
+# define RUN_TEST( ... )  _RUN_TEST( ec, __VA_ARGS__ )
+
+  RUN_TEST( resolverdRequest1 );
+
+  return ec;
+}
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -6,6 +6,7 @@
 
 #include "test.hh"
 #include "semver.hh"
+#include <sstream>
 
 
 /* -------------------------------------------------------------------------- */
@@ -22,6 +23,162 @@ test_semverSat1()
          ( std::find( sats.begin(), sats.end(), "4.3.0" ) != sats.end() );
 }
 
+/* -------------------------------------------------------------------------- */
+
+  bool
+test_parseSemver1()
+{
+  std::optional<versions::Semver> v = versions::parseSemver( "1.2.3-pre.01" );
+  if ( v.has_value() ) { return false; }
+  v = versions::parseSemver( "v1.2.3-pre.1+build.5" );
+  if ( ! v.has_value() ) { return false; }
+  return ( v->major == 1 ) && ( v->minor == 2 ) && ( v->patch == 3 ) &&
+         ( v->prerelease == std::vector<std::string> { "pre", "1" } ) &&
+         ( v->toString() == "1.2.3-pre.1" );
+}
+
+
+  bool
+test_parseSemverLoose1()
+{
+  if ( versions::parseSemver( "=1.2.3beta" ).has_value() ) { return false; }
+  std::optional<versions::Semver> v =
+    versions::parseSemver( "=1.2.3beta", true );
+  return v.has_value() && ( v->toString() == "1.2.3-beta" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+test_semverCompare1()
+{
+  std::vector<std::string> ordered = {
+    "1.0.0-0", "1.0.0-2", "1.0.0-10", "1.0.0-alpha", "1.0.0-alpha.1"
+  , "1.0.0-alpha.beta", "1.0.0-beta", "1.0.0-rc.1", "1.0.0", "1.0.1"
+  , "1.1.0", "2.0.0"
+  };
+  for ( size_t i = 1; i < ordered.size(); ++i )
+    {
+      versions::Semver a = versions::parseSemver( ordered[i - 1] ).value();
+      versions::Semver b = versions::parseSemver( ordered[i] ).value();
+      if ( ! ( ( a < b ) && ( a.compare( b ) == -1 ) &&
+               ( b.compare( a ) == 1 ) && ( a.compare( a ) == 0 ) ) )
+        {
+          std::cerr << "  Expected: " << ordered[i - 1] << " < " << ordered[i]
+                    << std::endl;
+          return false;
+        }
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+test_SemverRange1()
+{
+  std::optional<versions::SemverRange> r =
+    versions::SemverRange::parse( "^1.2.3 || ~0.1.2 || 3.x" );
+  return r.has_value() &&
+         ( r->toString() ==
+           ">=1.2.3 <2.0.0-0||>=0.1.2 <0.2.0-0||>=3.0.0 <4.0.0-0"
+         ) &&
+         r->test( "1.9.0" ) && r->test( "0.1.9" ) && r->test( "3.4.5" ) &&
+         ( ! r->test( "2.0.0" ) ) && ( ! r->test( "0.2.0" ) ) &&
+         ( ! r->test( "1.9.0-pre" ) ) && ( ! r->test( "garbage" ) );
+}
+
+
+  bool
+test_SemverRangePrerelease1()
+{
+  std::optional<versions::SemverRange> strict =
+    versions::SemverRange::parse( ">=1.2.3-pre <2.0.0" );
+  std::optional<versions::SemverRange> incPre =
+    versions::SemverRange::parse( ">=1.2.3-pre <2.0.0", false, true );
+  return strict.has_value() && incPre.has_value() &&
+         strict->test( "1.2.3-pre.2" ) && ( ! strict->test( "1.5.0-pre" ) ) &&
+         incPre->test( "1.2.3-pre.2" ) && incPre->test( "1.5.0-pre" );
+}
+
+
+  bool
+test_SemverRangeInvalid1()
+{
+  return ( ! versions::SemverRange::parse( "garbage" ).has_value() ) &&
+         ( ! versions::SemverRange::parse( "1.2.3 garbage" ).has_value() ) &&
+         versions::SemverRange::parse( "1.2.3 garbage", true ).has_value() &&
+         ( ! versions::SemverRange::parse( "garbage", true ).has_value() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Compare the native implementation of `semverSat' against the `semver'
+ * executable for a corpus of ranges and versions.
+ */
+  bool
+test_semverSatDifferential1()
+{
+  /* Note that `semver' splits arguments on `=', so we avoid versions such as
+   * `=1.2.3' here. */
+  std::list<std::string> vs = {
+    "0.0.0", "0.0.1", "0.1.0", "0.1.1", "0.2.0", "1.0.0", "1.0.0-alpha"
+  , "1.0.0-alpha.1", "1.0.0-0", "1.0.0-beta.2", "1.0.0-rc.1", "1.0.0+build"
+  , "1.2.3", "1.2.3-pre", "1.2.4", "1.3.0", "1.3.0-0", "2.0.0", "2.0.0-rc.1"
+  , "2.1.0", "3.0.0", "3.4.5", "4.2.0", "4.2.1", "4.3.0-pre.01"
+  , "4.3.0-pre.1", "4.3.0-pre.10", "5.0.0", "10.0.0", "v1.2.3", "1.2.3beta"
+  , "01.2.3", "1.2", "1.2.3.4", "1.2.3-", "1.2.3--x", "1.2.3-01", "1.2.3-0a"
+  , "1.2.3-x.7.z.92", "9007199254740991.0.0", "9007199254740992.0.0"
+  , "0.0.0-0", "1.0.0-a.b", "1.0.0-a.1", "1.0.0-a"
+  };
+  std::list<std::string> ranges = {
+    "^4.2.0", "*", "", "x", "1.x", "1.2.x", "~1.2.3", "~1.2", "~1"
+  , "~>1.2.3", "^0.0.1", "^0.1.0", "^0.1", "^1.2", "^1", "^1.2.3-pre"
+  , "~1.2.3-pre", ">=1.2.3", "> 1.2.3", "<2.0.0", "<=2.0.0"
+  , ">=1.0.0 <2.0.0", "1.2.3 - 2.3.4", "1.2 - 2.3", "1 - 2", "1.2.3 - 2"
+  , "1.0.0-alpha - 1.0.0", "1.x || >=2.5.0 || 5.0.0 - 7.2.3", ">1", ">1.2"
+  , "<=1.2", "<1.x", ">*", "<*", "=1.2.x", "1.2.3", "=1.2.3", "v1.2.3"
+  , "1.2.3beta", ">= 1.2.3 < 3", "~ 1.2", "^ 1.2", "garbage"
+  , "1.2.3 garbage", ">=01.2.3", "^01.2.3", ">=0.0.0", ">=0.0.0-0"
+  , "<0.0.0-0", "1.2.3 || garbage", "||", "1.0.0 ||", "   ^1.2.3   "
+  , "^1.2.3 ^1.3", ">1.0.0-alpha <1.0.0-rc.1", "~0.0.1", "^0.0", "^0"
+  , "1.2.3-pre - 1.2.4-pre", "*.*.*", "x.x", "1.2.*", "^1.x", "~1.x.x"
+  , ">=1.2.3-pre", ">4.3.0-pre.1", "4.3.0-pre.01", "^4.3.0-pre.1"
+  , "9007199254740991.x", ">9007199254740991.0.0", "1.2.3 - *", "* - 1.2.3"
+  };
+
+  bool rsl = true;
+  for ( const std::string & range : ranges )
+    {
+      std::list<std::string> args = {
+        "--include-prerelease", "--loose", "--range", range
+      };
+      for ( const std::string & v : vs ) { args.push_back( v ); }
+      auto [ec, lines] = versions::runSemver( args );
+      std::list<std::string> expected;
+      if ( nix::statusOk( ec ) )
+        {
+          std::stringstream ss( lines );
+          std::string l;
+          while ( std::getline( ss, l, '\n' ) )
+            {
+              if ( ! l.empty() ) { expected.push_back( std::move( l ) ); }
+            }
+        }
+      if ( versions::semverSat( range, vs ) != expected )
+        {
+          std::cerr << "  Mismatch for range: '" << range << "'" << std::endl;
+          rsl = false;
+        }
+    }
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
   int
@@ -30,6 +187,13 @@ main()
   int ec = EXIT_SUCCESS;
 # define RUN_TEST( ... )  _RUN_TEST( ec, __VA_ARGS__ )
   RUN_TEST( semverSat1 );
+  RUN_TEST( parseSemver1 );
+  RUN_TEST( parseSemverLoose1 );
+  RUN_TEST( semverCompare1 );
+  RUN_TEST( SemverRange1 );
+  RUN_TEST( SemverRangePrerelease1 );
+  RUN_TEST( SemverRangeInvalid1 );
+  RUN_TEST( semverSatDifferential1 );
   return ec;
 }
 